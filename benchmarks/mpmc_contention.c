@@ -0,0 +1,136 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+    Contention benchmark of the pipe transports allowing several threads
+    on the same side of a pipe: N producers move empty buffers to full ones
+    and N consumers give them back, for N = 1, 2, 4, 8, 16.
+    Prints the number of buffer hand-offs per second.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// clang-format off
+#include "mtdp.h"
+#include "impl/pipe.h"
+// clang-format on
+
+#include "thread.h"
+
+#define MAX_THREADS 16
+#define N_BUFFERS   256
+#define N_HANDOFFS  (1 << 20)
+
+static mtdp_pipe     g_pipe;
+static atomic_size_t produced, consumed;
+
+static int
+producer(void* arg)
+{
+    mtdp_buffer buf;
+
+    (void)arg;
+    while(atomic_fetch_add(&produced, 1) < N_HANDOFFS) {
+        while(!(buf = mtdp_pipe_get_empty_buffer(&g_pipe))) {
+            thrd_yield();
+        }
+        mtdp_pipe_push_buffer(&g_pipe, buf);
+    }
+    return 0;
+}
+
+static int
+consumer(void* arg)
+{
+    mtdp_buffer buf;
+
+    (void)arg;
+    while(atomic_load(&consumed) < N_HANDOFFS) {
+        if((buf = mtdp_pipe_get_full_buffer(&g_pipe))) {
+            mtdp_pipe_put_back(&g_pipe, buf);
+            atomic_fetch_add(&consumed, 1);
+        }
+        else {
+            thrd_yield();
+        }
+    }
+    return 0;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static double
+run(mtdp_pipe_transport transport, size_t n_threads)
+{
+    thrd_t       producers[MAX_THREADS], consumers[MAX_THREADS];
+    mtdp_buffer* buffers;
+    double       start;
+
+    if(!mtdp_pipe_init(&g_pipe) || !mtdp_pipe_set_transport(&g_pipe, transport) || !(buffers = mtdp_pipe_resize(&g_pipe, N_BUFFERS))) {
+        fprintf(stderr, "pipe initialization failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for(size_t i = 0; i != N_BUFFERS; ++i) {
+        buffers[i] = (mtdp_buffer)(i + 1);
+    }
+    g_pipe.n_producers = g_pipe.n_consumers = n_threads;
+    mtdp_pipe_prepare(&g_pipe);
+    mtdp_pipe_hand_over(&g_pipe);
+    atomic_store(&produced, 0);
+    atomic_store(&consumed, 0);
+
+    start = now();
+    for(size_t i = 0; i != n_threads; ++i) {
+        thrd_create(&producers[i], producer, NULL);
+        thrd_create(&consumers[i], consumer, NULL);
+    }
+    for(size_t i = 0; i != n_threads; ++i) {
+        thrd_join(producers[i], NULL);
+        thrd_join(consumers[i], NULL);
+    }
+    start = now() - start;
+
+    mtdp_pipe_clear(&g_pipe);
+    mtdp_pipe_destroy(&g_pipe);
+    return N_HANDOFFS / start;
+}
+
+int
+main(void)
+{
+    static const struct {
+        mtdp_pipe_transport transport;
+        const char*         name;
+    } transports[] = {
+        {MTDP_PIPE_TRANSPORT_LOCKED, "locked"},
+        {MTDP_PIPE_TRANSPORT_MPMC, "mpmc"},
+    };
+
+    printf("%-10s %12s %16s\n", "transport", "threads/side", "hand-offs/s");
+    for(size_t i = 0; i != sizeof(transports) / sizeof(*transports); ++i) {
+        for(size_t n_threads = 1; n_threads <= MAX_THREADS; n_threads *= 2) {
+            printf("%-10s %12zu %16.0f\n", transports[i].name, n_threads, run(transports[i].transport, n_threads));
+        }
+    }
+    return EXIT_SUCCESS;
+}
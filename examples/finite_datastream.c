@@ -165,7 +165,7 @@ int main()
     mtdp_buffer* buffers;
 
     /* 0. Retrieve memory for a pipeline and preconfigure it */
-    mtdp_pipeline_parameters parameters;
+    mtdp_pipeline_parameters parameters = {0};
     parameters.params.internal_stages = N_STAGES;
     pipeline = mtdp_pipeline_create(&parameters);
     if (!pipeline) {
@@ -48,6 +48,7 @@ extern "C" {
 #endif
 
 #include "mtdp/errno.h"
+#include "mtdp/executor.h"
 #include "mtdp/pipeline.h"
 
 #ifdef __cplusplus
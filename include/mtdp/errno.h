@@ -55,6 +55,9 @@ enum mtdp_error {
     MTDP_MTX_ERROR,
     /** Error on a cnd_* function call */
     MTDP_CND_ERROR,
+
+    /** The pipeline configuration is not supported (e.g. a pipe transport unsuitable for a stage) */
+    MTDP_BAD_CONFIG,
 };
 
 /**
@@ -0,0 +1,91 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+mtdp is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+mtdp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/**
+ * @file
+ *
+ * @brief Header containing the executor opaque struct and APIs to interact with it.
+ * @note Do not import this file in user code, use the mtdp.h umbrella header instead.
+ */
+
+#ifndef MTDP_EXECUTOR_H
+#define MTDP_EXECUTOR_H
+
+#ifndef MTDP_H
+#  error do not #include <mtdp/executor.h> directly, #include <mtdp.h> instead
+#endif
+
+/**
+ * @brief Opaque struct used to run many pipelines on a shared pool of threads.
+ *
+ * @details By default every pipeline spawns its own threads when enabled, so
+ * the number of threads of a process grows with the number of pipelines.
+ * An executor owns instead a fixed pool of threads, created along with it,
+ * on which the stages of every pipeline attached to it are scheduled
+ * as tasks: the threads are shared fairly, in round-robin, between
+ * the pipelines with work to do, and they sleep when no pipeline has any.
+ *
+ * A pipeline is attached to an executor through the `executor` field of its
+ * creation parameters: its tasks are added when it is enabled, and removed
+ * when it is disabled.
+ *
+ * @code {.c}
+ * mtdp_executor* executor = mtdp_executor_create(0, 1024);
+ * mtdp_pipeline_parameters parameters = {0};
+ * parameters.params.internal_stages = N_STAGES;
+ * parameters.params.executor = executor;
+ * for(int i = 0; i != N_PIPELINES; ++i) {
+ *     pipelines[i] = mtdp_pipeline_create(&parameters);
+ *     // ...
+ * }
+ * // ...
+ * for(int i = 0; i != N_PIPELINES; ++i) {
+ *     mtdp_pipeline_destroy(pipelines[i]);
+ * }
+ * mtdp_executor_destroy(executor);
+ * @endcode
+ */
+typedef struct mtdp_executor mtdp_executor;
+
+/**
+ * @brief Creates an executor and starts its threads.
+ *
+ * @details Every source, stage replica and sink of an enabled pipeline is a task.
+ * The memory of the scheduling queues is reserved upfront for @p capacity tasks,
+ * so that no memory is requested while the pipelines run: enabling a pipeline
+ * whose tasks would exceed the capacity of its executor fails.
+ *
+ * @param n_threads number of threads to start, 0 for one per available processor
+ * @param capacity maximum number of tasks of the pipelines enabled at the same time
+ * @return mtdp_executor* the executor, NULL on error
+ * @retval MTDP_OK
+ * @retval MTDP_NO_MEM
+ * @retval MTDP_THRD_ERROR
+ */
+MTDP_API mtdp_executor* mtdp_executor_create(size_t n_threads, size_t capacity);
+
+/**
+ * @brief Stops the threads of an executor and deallocates it.
+ *
+ * @warning Every pipeline attached to the executor shall be disabled
+ * (or destroyed) before.
+ *
+ * @param executor the executor to destroy
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ */
+MTDP_API void mtdp_executor_destroy(mtdp_executor* executor);
+
+#endif
@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
  */
 
 #include "mtdp/buffer.h"
+#include "mtdp/stage.h"
 
 /**
  * @brief Opaque struct used to configure a pipe.
@@ -82,6 +83,124 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
  */
 typedef struct mtdp_pipe mtdp_pipe;
 
+/**
+ * @brief Mechanism used by a pipe to hand the full buffers over from its
+ * producer stage to its consumer stage.
+ */
+typedef enum {
+    /**
+     * @brief Default transport: full buffers are queued in a mutex-protected FIFO
+     * that grows on demand.
+     */
+    MTDP_PIPE_TRANSPORT_LOCKED,
+
+    /**
+     * @brief Lock-free single-producer/single-consumer ring.
+     *
+     * @details The ring is sized once on the total number of buffers of the pipe,
+     * so no memory is requested while the pipeline is active. Since every pipe
+     * of a linear pipeline has exactly one producer and one consumer, unless it is
+     * connected to a replicated stage, this transport may be used on most of them,
+     * and it is recommended when the stages process small buffers at high rates.
+     *
+     * Empty buffers are handed back to the producer through a second ring of the same
+     * size, so neither the full nor the empty buffers path takes a lock. The producer
+     * still reuses the most recently returned buffers first.
+     */
+    MTDP_PIPE_TRANSPORT_SPSC,
+
+    /**
+     * @brief Single circulating ring of buffers shared by producer and consumer.
+     *
+     * @details The buffers returned by mtdp_pipe_resize() are used in place
+     * as a fixed ring of slots: the producer fills the slots in order, the consumer
+     * releases them in the same order, and no buffer is ever moved between an empty
+     * pool and a full FIFO. Each hand-off costs a single atomic store on each side,
+     * and the slots are always visited sequentially.
+     *
+     * As the SPSC transport it requires exactly one producer and one consumer,
+     * each holding at most one buffer of the pipe at a time, as every pipe
+     * of a linear pipeline not connected to a replicated stage does.
+     */
+    MTDP_PIPE_TRANSPORT_RING,
+
+    /**
+     * @brief Lock-free multi-producer/multi-consumer queues.
+     *
+     * @details Both the full buffers and the empty ones are moved through bounded
+     * queues of sequence-numbered cells, sized once on the total number of buffers
+     * of the pipe: any number of threads may push to and pull from the pipe,
+     * each one paying a single compare-and-swap per hand-off instead of serializing
+     * on a mutex. Use it on the pipes of the unordered replicated stages.
+     */
+    MTDP_PIPE_TRANSPORT_MPMC,
+} mtdp_pipe_transport;
+
+/**
+ * @brief Order in which the consumer of a pipe pulls the full buffers of the pipe
+ * and those of the pipelines merged into it with mtdp_pipeline_add_input().
+ *
+ * @details The inputs of a pipe are numbered from 0, the pipe itself, then every
+ * input pipeline in the order they were added.
+ */
+typedef enum {
+    /**
+     * @brief Default policy: the inputs are served in turn, skipping those with no full buffer,
+     * so that a busy input cannot starve the others.
+     */
+    MTDP_PIPE_MERGE_ROUND_ROBIN,
+
+    /**
+     * @brief The first input with a full buffer is always served first:
+     * the inputs are prioritized in their order.
+     */
+    MTDP_PIPE_MERGE_FIRST_AVAILABLE,
+
+    /**
+     * @brief The buffers are pulled in the order of a sequence number read from each of them.
+     *
+     * @details Every input shall push its buffers in increasing order of their sequence
+     * numbers, which need not be dense, as timestamps: the buffers of all the inputs
+     * are merged into a single sorted stream. The consumer waits for a full buffer
+     * from every input not ended, then pulls the one with the smallest number, ties
+     * going to the first input. An input that stops pushing without ending thus holds
+     * the whole merge back.
+     */
+    MTDP_PIPE_MERGE_SEQUENCE,
+} mtdp_pipe_merge_policy;
+
+/**
+ * @brief Reads the sequence number of a full buffer, for `MTDP_PIPE_MERGE_SEQUENCE`.
+ *
+ * @details Called by the consumer of the pipe: it shall neither block nor modify the buffer.
+ */
+typedef size_t (*mtdp_pipe_sequence_fn)(const mtdp_buffer buffer);
+
+/**
+ * @brief How a pipe joins its own buffers with those of the pipeline merged into it.
+ */
+typedef enum {
+    /**
+     * @brief Default: the buffers are merged, not joined.
+     */
+    MTDP_PIPE_JOIN_NONE,
+
+    /**
+     * @brief A buffer is matched with a buffer of the other stream with the same key.
+     */
+    MTDP_PIPE_JOIN_KEY,
+
+    /**
+     * @brief A buffer is matched with a buffer of the other stream whose key,
+     * a timestamp, is within a tolerance from its own.
+     *
+     * @details The timestamps of each stream shall not decrease: a buffer is also
+     * expired as soon as the other stream has moved past its timestamp plus
+     * the tolerance, as it cannot be matched anymore.
+     */
+    MTDP_PIPE_JOIN_TIMESTAMP,
+} mtdp_pipe_join_mode;
+
 /**
  * @brief Returns the next pipe entry from a previous entry.
  * 
@@ -110,7 +229,9 @@ MTDP_API mtdp_pipe* mtdp_pipe_next(mtdp_pipe* pipe);
  * 
  * @note This function is not thread-safe, and it should not be called
  * while the pipeline is active. It is only useful to preallocate memory
- * or to expand it at runtime (after pausing the pipeline).
+ * or to expand it at runtime (after pausing the pipeline). To grow or
+ * shrink a pipe while the pipeline runs, use mtdp_pipe_add_buffers() and
+ * mtdp_pipe_remove_buffers() instead.
  * 
  * @warning If a smaller number of buffers is requested, these buffers
  * owned memory, and they were not properly destructed, that memory will leak.
@@ -148,4 +269,130 @@ MTDP_API mtdp_buffer* mtdp_pipe_resize(mtdp_pipe* pipe, size_t n_buffers);
  */
 MTDP_API mtdp_buffer* mtdp_pipe_buffers(mtdp_pipe* pipe);
 
+/**
+ * @brief Adds buffers to the empty pool of a pipe, even while the pipeline runs.
+ *
+ * @details The buffers, allocated and initialized by the caller, are ready to be used
+ * by the producer of the pipe as soon as the function returns, and a producer waiting
+ * for an empty buffer is woken up. Either all of them are added or none is.
+ * Unlike mtdp_pipe_resize(), this function is thread-safe: bursts may be absorbed
+ * by growing the pipes on demand rather than sizing all of them for the worst case.
+ * The buffers then belong to the pipe, like the others, until they are removed.
+ *
+ * @note Only pipes using `MTDP_PIPE_TRANSPORT_LOCKED` can grow while the pipeline runs.
+ * The lock-free transports size their memory on the number of buffers when the
+ * pipeline is enabled. Pipes broadcasting their buffers to branches, merged into
+ * another pipe, or fused (see mtdp_stage::fused) cannot either.
+ *
+ * @warning The array returned by mtdp_pipe_buffers() or mtdp_pipe_resize() may be
+ * reallocated: retrieve it again afterwards.
+ *
+ * @param pipe the pipe to grow
+ * @param buffers the buffers to add
+ * @param n the number of buffers to add
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_BAD_CONFIG if the pipe cannot grow while the pipeline runs
+ * @retval MTDP_NO_MEM
+ */
+MTDP_API bool mtdp_pipe_add_buffers(mtdp_pipe* pipe, const mtdp_buffer* buffers, size_t n);
+
+/**
+ * @brief Retires empty buffers from the pool of a pipe, even while the pipeline runs.
+ *
+ * @details Up to @p n buffers that no stage holds are taken out of the pipe and stored
+ * in @p buffers, for the caller to destroy. Buffers in use are never waited for.
+ * When fewer empty buffers are available, the others may be retired by calling
+ * the function again later, once they have been consumed. A pipe always keeps
+ * a buffer for each of the threads pushing to and pulling from it, so that none
+ * of them waits forever: fewer buffers are retired if needed. The same conditions
+ * as mtdp_pipe_add_buffers() apply, and the function is thread-safe as well.
+ *
+ * @param pipe the pipe to shrink
+ * @param buffers where to store the buffers retired, room for @p n of them
+ * @param n the maximum number of buffers to retire
+ * @return size_t the number of buffers retired, 0 on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_BAD_CONFIG if the pipe cannot shrink while the pipeline runs
+ */
+MTDP_API size_t mtdp_pipe_remove_buffers(mtdp_pipe* pipe, mtdp_buffer* buffers, size_t n);
+
+/**
+ * @brief Selects the transport used by the pipe to move full buffers.
+ *
+ * @details The transport may be selected either before or after a resize:
+ * the memory it requires is reserved on the total number of buffers of the pipe,
+ * and it is updated on every subsequent resize. By default a pipe uses
+ * `MTDP_PIPE_TRANSPORT_LOCKED`.
+ * Switching from or to `MTDP_PIPE_TRANSPORT_RING` returns every buffer
+ * to the empty pool, as mtdp_pipeline_disable() does.
+ *
+ * @note This function is not thread-safe, and it shall not be called
+ * while the pipeline is enabled.
+ *
+ * @param pipe the pipe to configure
+ * @param transport the transport to use
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_NO_MEM
+ */
+MTDP_API bool mtdp_pipe_set_transport(mtdp_pipe* pipe, mtdp_pipe_transport transport);
+
+/**
+ * @brief Selects the order in which the inputs merged into a pipe are served.
+ *
+ * @details The policy only matters once other pipelines are merged into the pipe
+ * with mtdp_pipeline_add_input(). By default a pipe uses `MTDP_PIPE_MERGE_ROUND_ROBIN`.
+ *
+ * @note This function is not thread-safe, and it shall not be called
+ * while the pipeline is enabled.
+ *
+ * @param pipe the pipe to configure
+ * @param policy the merge policy to use
+ * @param sequence the function reading the sequence number of a buffer,
+ * only used (and required) by `MTDP_PIPE_MERGE_SEQUENCE`
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_BAD_CONFIG if @p sequence is required and NULL
+ * @retval MTDP_NO_MEM
+ */
+MTDP_API bool mtdp_pipe_set_merge_policy(mtdp_pipe* pipe, mtdp_pipe_merge_policy policy, mtdp_pipe_sequence_fn sequence);
+
+/**
+ * @brief Joins the buffers pushed to a pipe with those of the pipeline merged into it.
+ *
+ * @details The stage pulling from the pipe receives matched pairs of buffers: one pushed
+ * to the pipe itself in the @p input field of its context, and one of the single input
+ * pipeline merged into the pipe with mtdp_pipeline_add_input() in the @p joined field.
+ * The buffers waiting for a match are held in a window, one per stream, of at most
+ * @p window buffers: when a window is full its oldest buffer expires, going back
+ * unprocessed to the pool it comes from, as do the buffers that cannot be matched
+ * anymore in `MTDP_PIPE_JOIN_TIMESTAMP` mode. A window never holds all the buffers of
+ * its stream, so that the producers are never starved by the join: the buffer of
+ * a stream of a single buffer goes back as soon as it finds no match.
+ *
+ * Enabling the pipeline fails with `MTDP_BAD_CONFIG` unless exactly one pipeline is
+ * merged into the pipe, and the pipe is the input of an internal stage.
+ *
+ * @note This function is not thread-safe, and it shall not be called
+ * while the pipeline is enabled.
+ *
+ * @param pipe the pipe to configure
+ * @param mode the join mode, `MTDP_PIPE_JOIN_NONE` to merge the buffers instead
+ * @param key the function reading the key (or the timestamp) of a buffer
+ * @param tolerance the largest difference between matched timestamps, only used by
+ * `MTDP_PIPE_JOIN_TIMESTAMP`
+ * @param window the number of unmatched buffers held for each stream
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_BAD_CONFIG if @p key is NULL or @p window is 0 while joining
+ * @retval MTDP_NO_MEM
+ */
+MTDP_API bool mtdp_pipe_set_join(mtdp_pipe* pipe, mtdp_pipe_join_mode mode, mtdp_stage_key_fn key, size_t tolerance, size_t window);
+
 #endif
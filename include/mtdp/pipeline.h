@@ -90,6 +90,7 @@ typedef struct mtdp_pipeline mtdp_pipeline;
  * 
  * @note This struct may be subject to changes in future
  * releases adding fields that may cover up to 1024 bytes.
+ * Zero-initialize it, so that the fields you do not set keep their default.
  * Use the pipeline_parameters convenience union to update the
  * library (if shared) keeping the same ABI.
  */
@@ -106,6 +107,41 @@ typedef struct {
      * only describes the internal stages which are not a source nor a sink.
      */
     size_t internal_stages;
+
+    /**
+     * @brief Number of threads running the whole pipeline, 0 for a thread per stage.
+     * 
+     * @details By default every source, stage (replica) and sink runs on its own thread.
+     * With a non-zero number of executor threads, the iterations of the stages are
+     * scheduled instead as tasks on a fixed pool of threads with work-stealing deques:
+     * a stage is descheduled as soon as it cannot proceed, and it is scheduled again
+     * when one of its neighbors moves a buffer through a pipe they share.
+     * This avoids oversubscribing the cores with long pipelines.
+     * 
+     * Stages are multiplexed cooperatively: an iteration that cannot proceed returns
+     * to the executor instead of blocking its thread, and switching to another stage
+     * takes no system call, as long as the executor threads have work to do.
+     * 
+     * @note Stages running on executor threads never wait for buffers,
+     * so their wait policies are not applied.
+     */
+    size_t executor_threads;
+
+    /**
+     * @brief Executor shared with other pipelines, NULL for none.
+     * 
+     * @details When set, the stages of the pipeline are scheduled as tasks on the
+     * threads of the given executor, like with executor_threads, but without
+     * spawning any thread of its own: many pipelines may thus run on a pool
+     * of threads sized for the machine rather than for their total number of stages.
+     * The executor_threads parameter is ignored.
+     * 
+     * @note The executor shall outlive the pipeline, or at least its being enabled.
+     * Enabling the pipeline fails with MTDP_BAD_CONFIG if its tasks exceed the
+     * capacity left in the executor.
+     * @see mtdp_executor_create
+     */
+    mtdp_executor* executor;
 } mtdp_pipeline_params;
 
 /**
@@ -122,6 +158,49 @@ typedef union {
     uint8_t              padding[1024];
 } mtdp_pipeline_parameters;
 
+/**
+ * @brief Kind of the link an edge of a pipeline graph makes between two nodes.
+ */
+typedef enum {
+    /**
+     * @brief The buffers of a pipe of the `from` node are broadcast to the first
+     * stage (or the sink) of the `to` node, see mtdp_pipeline_add_branch().
+     */
+    MTDP_PIPELINE_EDGE_BRANCH,
+
+    /**
+     * @brief The buffers of the last pipe of the `from` node are merged into
+     * a pipe of the `to` node, see mtdp_pipeline_add_input().
+     */
+    MTDP_PIPELINE_EDGE_INPUT,
+} mtdp_pipeline_edge_kind;
+
+/**
+ * @brief An edge of a pipeline graph, carrying buffers from a node to another one.
+ */
+typedef struct {
+    /**
+     * @brief The kind of link between the nodes.
+     */
+    mtdp_pipeline_edge_kind kind;
+
+    /**
+     * @brief The index of the node producing the buffers.
+     */
+    size_t from;
+
+    /**
+     * @brief The index of the node consuming the buffers.
+     */
+    size_t to;
+
+    /**
+     * @brief The index of the pipe of the edge: the broadcast pipe of the
+     * `from` node for a branch, the merging pipe of the `to` node for an input.
+     */
+    size_t pipe;
+} mtdp_pipeline_edge;
+
 /**
  * @brief Creates a multi-threaded data pipeline and returns a pointer to it.
  * 
@@ -146,6 +225,55 @@ typedef union {
  */
 MTDP_API mtdp_pipeline* mtdp_pipeline_create(const mtdp_pipeline_parameters* params);
 
+/**
+ * @brief Creates the pipelines of a directed acyclic graph of sources, stages and sinks.
+ *
+ * @details Every node of the graph is a pipeline, created from its own parameters
+ * as with mtdp_pipeline_create() and stored at the same index in @p pipelines:
+ * a linear chain of stages, split and joined with the others through the pipes
+ * of the edges. A branch edge lets a node process the stream of a pipe of another
+ * one in parallel with its consumer, while input edges join the streams of many
+ * nodes into one of their pipes.
+ *
+ * The nodes shall then be configured as standalone pipelines, but for the sources
+ * of branch nodes and the sinks of input nodes, which are never run, and for the
+ * first pipes of branch nodes, which need no buffers. A node joining inputs into
+ * its first pipe still runs its source, which may finish right away if the node
+ * only processes its inputs. The nodes connected by the
+ * edges are enabled, started, stopped, waited for and disabled together by the
+ * same calls on any of them.
+ *
+ * @code {.c}
+ * // demuxer -+-> video -+
+ * //          +-> audio -+-> muxer
+ * mtdp_pipeline_parameters nodes[4] = {0};
+ * mtdp_pipeline_edge       edges[]  = {
+ *     {MTDP_PIPELINE_EDGE_BRANCH, 0, 1, 0},
+ *     {MTDP_PIPELINE_EDGE_BRANCH, 0, 2, 0},
+ *     {MTDP_PIPELINE_EDGE_INPUT, 1, 3, 0},
+ *     {MTDP_PIPELINE_EDGE_INPUT, 2, 3, 0},
+ * };
+ * mtdp_pipeline* pipelines[4];
+ * nodes[1].params.internal_stages = nodes[2].params.internal_stages = 2;
+ * mtdp_pipeline_create_graph(nodes, 4, edges, 4, pipelines);
+ * @endcode
+ *
+ * @param nodes the parameters of the pipelines, one per node
+ * @param n_nodes the number of nodes
+ * @param edges the edges between the nodes
+ * @param n_edges the number of edges
+ * @param pipelines the array receiving the @p n_nodes pipelines created
+ * @return true on success, false on error, in which case no pipeline is left
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_BAD_CONFIG if an edge refers to a node or pipe out of range,
+ * or an edge could not be added as per mtdp_pipeline_add_branch() and
+ * mtdp_pipeline_add_input(), such as one closing a cycle
+ * @retval MTDP_NO_MEM
+ */
+MTDP_API bool mtdp_pipeline_create_graph(const mtdp_pipeline_parameters* nodes, size_t n_nodes,
+                                         const mtdp_pipeline_edge* edges, size_t n_edges, mtdp_pipeline** pipelines);
+
 /**
  * @brief Destroys a pipeline.
  * 
@@ -257,6 +385,8 @@ MTDP_API mtdp_pipe* mtdp_pipeline_get_pipes(mtdp_pipeline* pipeline);
  * @retval MTDP_OK
  * @retval MTDP_BAD_PTR
  * @retval MTDP_ENABLED
+ * @retval MTDP_BAD_CONFIG
+ * @retval MTDP_NO_MEM
  */
 MTDP_API bool mtdp_pipeline_enable(mtdp_pipeline* pipeline);
 
@@ -279,6 +409,7 @@ MTDP_API bool mtdp_pipeline_enable(mtdp_pipeline* pipeline);
  * @retval MTDP_OK
  * @retval MTDP_BAD_PTR
  * @retval MTDP_NOT_ENABLED
+ * @retval MTDP_BAD_CONFIG
  */
 MTDP_API bool mtdp_pipeline_disable(mtdp_pipeline* pipeline);
 
@@ -294,6 +425,7 @@ MTDP_API bool mtdp_pipeline_disable(mtdp_pipeline* pipeline);
  * @retval MTDP_BAD_PTR
  * @retval MTDP_ACTIVE
  * @retval MTDP_NOT_ENABLED
+ * @retval MTDP_BAD_CONFIG
  */
 MTDP_API bool mtdp_pipeline_start(mtdp_pipeline* pipeline);
 
@@ -312,6 +444,7 @@ MTDP_API bool mtdp_pipeline_start(mtdp_pipeline* pipeline);
  * @retval MTDP_BAD_PTR
  * @retval MTDP_ENABLED 
  * @retval MTDP_NOT_ENABLED
+ * @retval MTDP_BAD_CONFIG
  */
 MTDP_API bool mtdp_pipeline_stop(mtdp_pipeline* pipeline);
 
@@ -321,6 +454,7 @@ MTDP_API bool mtdp_pipeline_stop(mtdp_pipeline* pipeline);
  * @details This function will return when it will dynamically detect
  * any of these conditions:
  * - the pipeline is not enabled
+ * - the source finished and its last buffer went through the sink
  * - all the stages are not processing any data from at least 100 ms
  * The function does not return if the pipeline is in the enabled state
  * (i.e. the threads are sleeping).
@@ -336,4 +470,357 @@ MTDP_API bool mtdp_pipeline_stop(mtdp_pipeline* pipeline);
  */
 MTDP_API void mtdp_pipeline_wait(mtdp_pipeline* pipeline);
 
+/**
+ * @brief Waits for the buffers pushed so far to go through the whole pipeline.
+ *
+ * @details Returns once every buffer pushed by the source before the call has been
+ * processed by every stage, each output pushed in turn, and consumed by the sink.
+ * The pipeline keeps running meanwhile and the buffers pushed after the call flow
+ * as usual, so the call gives a consistent cut point of the stream, for instance
+ * to checkpoint the files written by the sink, without draining nor idling the threads.
+ * The steps are waited for one after the other, from the source to the sink, through
+ * the pipelines nested in place of its stages. Every pipeline linked to it is flushed
+ * as well (see mtdp_pipeline_add_branch(), mtdp_pipeline_add_input() and
+ * mtdp_pipeline_bridge()), each one after those its buffers come from. The calling
+ * thread spins briefly on every step, then parks until its consumers let go of a buffer.
+ *
+ * Only buffers are waited for. An output a stage keeps filling across several inputs
+ * is not pushed by a flush. The pipeline shall not be stopped, nor its stages spliced,
+ * while flushing.
+ *
+ * @code {.c}
+ * mtdp_pipeline_start(pipeline);
+ * // Later, while it runs
+ * mtdp_pipeline_flush(pipeline);
+ * checkpoint(output_file);
+ * @endcode
+ *
+ * @param pipeline the pipeline to flush
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_NOT_ENABLED
+ * @retval MTDP_ENABLED if the pipeline is enabled but stopped: the buffers cannot go through
+ * @retval MTDP_BAD_CONFIG if a pipe of the linked pipelines joins buffers or merges them by
+ * sequence: the buffers it holds wait for a match, which may never come
+ */
+MTDP_API bool mtdp_pipeline_flush(mtdp_pipeline* pipeline);
+
+/**
+ * @brief Takes an internal stage out of a pipeline, even while it runs.
+ *
+ * @details The stage is marked as spliced out (see mtdp_stage::spliced_out), so the next
+ * step pulls the buffers of its input pipe. While the pipeline runs, only the steps
+ * around the stage are paused. The previous step stops producing, the stage processes
+ * the buffers left in its input pipe, and the next step drains the output pipe before
+ * it moves to the input pipe. Then the thread of the stage is joined. The other stages
+ * keep running, and no buffer is lost or moved to another pool. An output buffer the
+ * stage holds without having asked to push it is put back unprocessed.
+ * When the pipeline is not enabled, only the flag is set.
+ *
+ * The call blocks until the pipes are drained. A step waiting for room in its output
+ * pipe is only paused once its wait ends, which takes at most
+ * `MTDP_PIPELINE_CONSUMER_TIMEOUT_US`. Call it from the thread controlling the pipeline.
+ *
+ * @note Splicing fails with `MTDP_BAD_CONFIG` (also when enabling a pipeline with
+ * spliced out stages) if:
+ * - the pipeline runs on an executor,
+ * - the stage, the previous step still in the pipeline or the next one is replicated
+ *   or fused, or the stage following this one is fused,
+ * - a pipe between the previous and the next step is linked to another pipeline
+ *   or joins buffers.
+ *
+ * @code {.c}
+ * mtdp_pipeline_get_stages(pipeline)[1].spliced_out = true;
+ * mtdp_pipeline_enable(pipeline);
+ * mtdp_pipeline_start(pipeline);
+ * // Later, on the fly
+ * mtdp_pipeline_splice_in(pipeline, 1);
+ * @endcode
+ *
+ * @param pipeline the pipeline
+ * @param stage the index of the internal stage
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_BAD_CONFIG if @p stage is out of range or already spliced out,
+ * or the pipeline cannot splice it
+ * @retval MTDP_ENABLED if the pipeline is enabled but stopped: the pipes cannot drain
+ */
+MTDP_API bool mtdp_pipeline_splice_out(mtdp_pipeline* pipeline, size_t stage);
+
+/**
+ * @brief Puts an internal stage spliced out back in a pipeline, even while it runs.
+ *
+ * @details This is the reverse of mtdp_pipeline_splice_out(). The previous step is paused,
+ * and the next one drains the pipe they share. The next step then pulls from the output
+ * pipe of the stage, and the stage gets a thread pulling from its input pipe.
+ * The stage context is reset, as it is when the pipeline is enabled. The same conditions
+ * and blocking behavior apply.
+ *
+ * @param pipeline the pipeline
+ * @param stage the index of the internal stage
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_BAD_CONFIG if @p stage is out of range or not spliced out,
+ * or the pipeline cannot splice it
+ * @retval MTDP_ENABLED if the pipeline is enabled but stopped: the pipes cannot drain
+ */
+MTDP_API bool mtdp_pipeline_splice_in(mtdp_pipeline* pipeline, size_t stage);
+
+/**
+ * @brief Replaces the callback and the user data of an internal stage, even while it runs.
+ *
+ * @details On a running pipeline, every replica of the stage switches to @p process and
+ * @p self before pulling its next input buffer. The buffer being processed finishes with
+ * the old callback. The call returns once every replica has switched, so the buffers
+ * pulled afterwards are all processed by @p process. The threads of the stage are not
+ * restarted, and @p init is not called again: the state the stage keeps, and its caches,
+ * stay warm. The new callback and data are also stored in the stage (mtdp_stage::process
+ * and mtdp_stage::self), for the next time the pipeline is enabled. When the pipeline is not
+ * enabled or the stage is spliced out, only these fields are set.
+ *
+ * An idle stage waits for input buffers for up to `MTDP_PIPELINE_CONSUMER_TIMEOUT_US`
+ * before switching. Call it from the thread controlling the pipeline.
+ *
+ * @code {.c}
+ * mtdp_pipeline_swap_stage(pipeline, 0, filter, &new_coefficients);
+ * // Every buffer pulled by the stage from now on is filtered with the new coefficients.
+ * @endcode
+ *
+ * @param pipeline the pipeline
+ * @param stage the index of the internal stage
+ * @param process the new stage callback
+ * @param self the new user data, copied on the context of every replica
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR if @p pipeline or @p process is NULL
+ * @retval MTDP_BAD_CONFIG if @p stage is out of range
+ * @retval MTDP_ENABLED if the pipeline is enabled but stopped: the stage cannot switch
+ */
+MTDP_API bool mtdp_pipeline_swap_stage(mtdp_pipeline* pipeline, size_t stage, mtdp_stage_callback process,
+                                       mtdp_stage_data self);
+
+/**
+ * @brief Broadcasts the buffers of a pipe to another pipeline.
+ *
+ * @details Every buffer pushed to the pipe @p pipe of @p pipeline (0 being the
+ * output of the source, `internal_stages` the input of the sink) is also
+ * delivered, without being copied, to the first pipe of @p branch: the first
+ * stage (or the sink) of the branch processes the same data stream as the
+ * consumer of the pipe, and its source is never run. A buffer returns to the
+ * pool of @p pipeline once every consumer has released it, so consumers of a
+ * broadcast buffer shall only read it.
+ *
+ * The branch is run along with @p pipeline: pipelines linked by branches and
+ * inputs (see mtdp_pipeline_add_input()) are enabled, started, stopped and
+ * disabled together by the same calls on any of them, and `mtdp_pipeline_wait`
+ * returns once all of them are drained. A branch may have branches of its own,
+ * from any pipe but its first one.
+ *
+ * Enabling fails with MTDP_BAD_CONFIG if
+ * - a broadcast pipe uses a transport other than MTDP_PIPE_TRANSPORT_LOCKED
+ *   and MTDP_PIPE_TRANSPORT_MPMC, or its consumer is fused,
+ * - the first pipe of a branch uses MTDP_PIPE_TRANSPORT_RING,
+ * - a linked pipeline runs on an executor.
+ *
+ * @code {.c}
+ * mtdp_pipeline_add_branch(decoder, 1, recorder);
+ * mtdp_pipeline_add_branch(decoder, 1, preview);
+ * mtdp_pipeline_enable(decoder);
+ * mtdp_pipeline_start(decoder);
+ * mtdp_pipeline_wait(decoder);
+ * @endcode
+ *
+ * @param pipeline the pipeline owning the buffers
+ * @param pipe the index of the broadcast pipe
+ * @param branch the pipeline receiving the buffers
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_ENABLED if any of the pipelines is enabled
+ * @retval MTDP_BAD_CONFIG if @p pipe is out of range or merges inputs, @p branch
+ * is already a branch or its first pipe broadcasts or merges buffers, either
+ * pipeline is nested (see mtdp_pipeline_add_nested()), or the pipelines would
+ * form a cycle
+ * @retval MTDP_NO_MEM
+ */
+MTDP_API bool mtdp_pipeline_add_branch(mtdp_pipeline* pipeline, size_t pipe, mtdp_pipeline* branch);
+
+/**
+ * @brief Detaches a branch from the pipeline it was added to.
+ *
+ * @details The branch becomes a standalone pipeline again, fed by its own source.
+ * Destroying a branch, or the pipeline it is attached to, detaches it as well.
+ *
+ * @param pipeline the pipeline the branch was added to
+ * @param branch the branch to detach
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_BAD_CONFIG if @p branch is not a branch of @p pipeline
+ * @retval MTDP_ENABLED
+ */
+MTDP_API bool mtdp_pipeline_remove_branch(mtdp_pipeline* pipeline, mtdp_pipeline* branch);
+
+/**
+ * @brief Merges the last pipe of another pipeline into a pipe.
+ *
+ * @details The buffers pushed by the last stage (or the source) of @p input are
+ * pulled by the consumer of the pipe @p pipe of @p pipeline, along with those
+ * pushed to the pipe itself, in the order given by its merge policy (see
+ * mtdp_pipe_set_merge_policy()); the sink of @p input is never run. Every
+ * buffer is put back in the pool of the pipe it was pushed to, so the inputs
+ * may hold buffers of different sizes, as long as the consumer knows them.
+ *
+ * The input is run along with @p pipeline, as a branch would (see
+ * mtdp_pipeline_add_branch()). Enabling fails with MTDP_BAD_CONFIG if
+ * - a merging pipe or the last pipe of an input uses MTDP_PIPE_TRANSPORT_RING,
+ * - the consumer of a merging pipe is fused or replicated,
+ * - a linked pipeline runs on an executor.
+ *
+ * @code {.c}
+ * mtdp_pipeline_add_input(mixer, 0, left);
+ * mtdp_pipeline_add_input(mixer, 0, right);
+ * mtdp_pipeline_enable(mixer);
+ * mtdp_pipeline_start(mixer);
+ * mtdp_pipeline_wait(mixer);
+ * @endcode
+ *
+ * @param pipeline the pipeline consuming the buffers
+ * @param pipe the index of the merging pipe
+ * @param input the pipeline producing the buffers
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_ENABLED if any of the pipelines is enabled
+ * @retval MTDP_BAD_CONFIG if @p pipe is out of range, broadcasts buffers or does
+ * not own them, @p input is already an input or its last pipe merges buffers or
+ * does not own them, either pipeline is nested, or the pipelines would form a cycle
+ * @retval MTDP_NO_MEM
+ */
+MTDP_API bool mtdp_pipeline_add_input(mtdp_pipeline* pipeline, size_t pipe, mtdp_pipeline* input);
+
+/**
+ * @brief Detaches an input from the pipeline it was merged into.
+ *
+ * @details The input becomes a standalone pipeline again, drained by its own sink.
+ * Destroying an input, or the pipeline it is merged into, detaches it as well.
+ *
+ * @param pipeline the pipeline the input was merged into
+ * @param input the input to detach
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_BAD_CONFIG if @p input is not an input of @p pipeline
+ * @retval MTDP_ENABLED
+ */
+MTDP_API bool mtdp_pipeline_remove_input(mtdp_pipeline* pipeline, mtdp_pipeline* input);
+
+/**
+ * @brief Runs another pipeline in place of a stage.
+ *
+ * @details The first stage of @p nested pulls the buffers from the input pipe of
+ * the stage @p stage of @p pipeline, and its last stage pushes to the output pipe
+ * of that stage: buffers cross both pipelines without being copied, while the
+ * pipes between the stages of @p nested keep their own buffers and settings. The
+ * stage replaced, the source and the sink of @p nested are never run, and the
+ * first and last pipes of @p nested need no buffers.
+ *
+ * The nested pipeline is run along with @p pipeline, as a branch would (see
+ * mtdp_pipeline_add_branch()), and may itself hold nested pipelines. It is not
+ * linked to any other pipeline. Enabling fails with MTDP_BAD_CONFIG if
+ * - the stage replaced is replicated, fused, spliced out or followed by a fused stage,
+ * - the first or last stage of @p nested is replicated or spliced out,
+ * - a linked pipeline runs on an executor.
+ *
+ * @code {.c}
+ * // source -> decode -> [resize -> sharpen] -> encode -> sink
+ * mtdp_pipeline_add_nested(transcoder, 1, filters);
+ * mtdp_pipeline_enable(transcoder);
+ * mtdp_pipeline_start(transcoder);
+ * mtdp_pipeline_wait(transcoder);
+ * @endcode
+ *
+ * @param pipeline the outer pipeline
+ * @param stage the index of the stage replaced
+ * @param nested the pipeline run in place of the stage
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_ENABLED if any of the pipelines is enabled
+ * @retval MTDP_BAD_CONFIG if @p stage is out of range or already replaced,
+ * @p nested has no stages, is linked to other pipelines or contains @p pipeline
+ * @retval MTDP_NO_MEM
+ */
+MTDP_API bool mtdp_pipeline_add_nested(mtdp_pipeline* pipeline, size_t stage, mtdp_pipeline* nested);
+
+/**
+ * @brief Detaches a nested pipeline from the pipeline it runs in.
+ *
+ * @details The nested pipeline becomes a standalone pipeline again, and the stage
+ * it replaced runs its own callback. Destroying either pipeline detaches it as well.
+ *
+ * @param pipeline the outer pipeline
+ * @param nested the nested pipeline to detach
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_BAD_CONFIG if @p nested does not run in @p pipeline
+ * @retval MTDP_ENABLED
+ */
+MTDP_API bool mtdp_pipeline_remove_nested(mtdp_pipeline* pipeline, mtdp_pipeline* nested);
+
+/**
+ * @brief Bridges the last pipe of a pipeline to the first stage of another.
+ *
+ * @details The first stage (or the sink) of @p to pulls the buffers pushed to the
+ * last pipe of @p from, and puts them back in its pool once processed: the two
+ * pipelines run as a longer one, without copying the buffers nor queueing them
+ * in between. The sink of @p from and the source of @p to are never run, and the
+ * first pipe of @p to needs no buffers.
+ *
+ * Bridged pipelines are run together, as a branch would (see
+ * mtdp_pipeline_add_branch()), and may be chained further. Enabling fails with
+ * MTDP_BAD_CONFIG if
+ * - the first stage of @p to is replicated or spliced out,
+ * - a linked pipeline runs on an executor.
+ *
+ * @code {.c}
+ * // capture -> denoise -> sink | source -> encode -> upload
+ * mtdp_pipeline_bridge(capture, encoder);
+ * mtdp_pipeline_enable(capture);
+ * mtdp_pipeline_start(capture);
+ * @endcode
+ *
+ * @param from the pipeline producing the buffers
+ * @param to the pipeline consuming the buffers
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_ENABLED if any of the pipelines is enabled
+ * @retval MTDP_BAD_CONFIG if @p from is already bridged to a pipeline, merged or
+ * nested, @p to is already bridged from a pipeline, is a branch or nested, or its
+ * first pipe broadcasts, merges or is merged, or the pipelines would form a cycle
+ */
+MTDP_API bool mtdp_pipeline_bridge(mtdp_pipeline* from, mtdp_pipeline* to);
+
+/**
+ * @brief Removes the bridge between two pipelines.
+ *
+ * @details Both pipelines become standalone again, @p from being drained by its
+ * own sink and @p to fed by its own source. Destroying either pipeline removes
+ * the bridge as well.
+ *
+ * @param from the pipeline producing the buffers
+ * @param to the pipeline consuming the buffers
+ * @return true on success, false on error
+ * @retval MTDP_OK
+ * @retval MTDP_BAD_PTR
+ * @retval MTDP_BAD_CONFIG if @p from is not bridged to @p to
+ * @retval MTDP_ENABLED
+ */
+MTDP_API bool mtdp_pipeline_unbridge(mtdp_pipeline* from, mtdp_pipeline* to);
+
 #endif
@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #endif
 
 #include "mtdp/buffer.h"
+#include "mtdp/wait.h"
 
 /**
  * @brief Convenience wrapper around data given to a sink.
@@ -135,6 +136,14 @@ typedef struct {
      * will not be updated and the sink thoughput will be zeroed.
      */
     mtdp_sink_callback process;
+
+    /**
+     * @brief How the sink waits for buffers when it cannot proceed.
+     * 
+     * @details Applied while waiting for a full buffer from the input pipe.
+     * It is optional to set: by default the thread blocks (`MTDP_WAIT_BLOCK`).
+     */
+    mtdp_wait_policy wait_policy;
 } mtdp_sink;
 
 /**
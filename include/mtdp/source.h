@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #endif
 
 #include "mtdp/buffer.h"
+#include "mtdp/wait.h"
 
 /**
  * @brief Convenience wrapper around data given to a source.
@@ -122,6 +123,14 @@ typedef struct {
      * will not be updated and the source thoughput will be zeroed.
      */
     mtdp_source_callback process;
+
+    /**
+     * @brief How the source waits for buffers when it cannot proceed.
+     * 
+     * @details Applied while waiting for an empty buffer from the output pipe.
+     * It is optional to set: by default the thread blocks (`MTDP_WAIT_BLOCK`).
+     */
+    mtdp_wait_policy wait_policy;
 } mtdp_source;
 
 /**
@@ -130,7 +139,10 @@ typedef struct {
  * @details Use this function from within the source stage to
  * instruct the pipeline that input data is finished and to
  * wake any thread waiting on the pipeline with 
- * mtdp_pipeline_wait. 
+ * mtdp_pipeline_wait. The end of the stream is passed down the
+ * pipes behind the last buffer pushed: every stage, and then the
+ * sink, is done as soon as it has processed it, without waiting
+ * for its input to time out.
  * 
  */
 MTDP_API void mtdp_source_finished(mtdp_source_context*);
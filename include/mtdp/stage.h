@@ -28,6 +28,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #endif
 
 #include "mtdp/buffer.h"
+#include "mtdp/wait.h"
 
 /**
  * @brief Convenience wrapper around data given to a stage.
@@ -104,6 +105,15 @@ typedef struct {
      * thus reducing the stage throughput to zero.
      */
     bool ready_to_pull;
+
+    /**
+     * @brief The buffer of the second input matched with @p input, when the input pipe
+     * joins two streams (see mtdp_pipe_set_join()), NULL otherwise.
+     * 
+     * @details It is pulled and released along with @p input, and it goes back to the
+     * pool it comes from: only read it.
+     */
+    mtdp_buffer joined;
 } mtdp_stage_context;
 
 /**
@@ -111,6 +121,15 @@ typedef struct {
  */
 typedef void (*mtdp_stage_callback)(mtdp_stage_context*);
 
+/**
+ * @brief Reads the key of a full buffer, routing it to a replica of a partitioned stage
+ * or matching it with the buffers of another stream in a joining pipe.
+ *
+ * @details Called by the producer pushing the buffer, or by the consumer of the joining pipe:
+ * it shall neither block nor modify the buffer.
+ */
+typedef size_t (*mtdp_stage_key_fn)(const mtdp_buffer buffer);
+
 /**
  * @brief Struct to be filled by the user with data describing an internal stage.
  * 
@@ -165,6 +184,95 @@ typedef struct {
      * will not be updated and the stage thoughput will be zeroed.
      */
     mtdp_stage_callback process;
+
+    /**
+     * @brief How the stage waits for buffers when it cannot proceed.
+     * 
+     * @details Applied both while waiting for a full buffer from the input pipe
+     * and for an empty buffer from the output pipe.
+     * It is optional to set: by default the thread blocks (`MTDP_WAIT_BLOCK`).
+     */
+    mtdp_wait_policy wait_policy;
+
+    /**
+     * @brief Number of threads running the stage callback.
+     * 
+     * @details With more than one replica, successive input buffers are processed
+     * concurrently by different threads, each one with its own context, and the output
+     * buffers are reassembled in the input order before reaching the next stage.
+     * Every replica calls @p init before its first iteration, while @p self is shared.
+     * It is optional to set: 0 and 1 both mean a single thread.
+     * 
+     * @note Unless @p unordered is set, a replicated stage shall push at most one output
+     * buffer for each input buffer, requesting the push before (or together with)
+     * the release of the input. A second push for the same input is dropped, its
+     * output buffer kept to be filled again, and `mtdp_errno` is set to `MTDP_BAD_CONFIG`
+     * on the thread of the replica, where the callback finds it on its next call.
+     * Both the pipes of a replicated stage shall use the `MTDP_PIPE_TRANSPORT_LOCKED`
+     * transport (or `MTDP_PIPE_TRANSPORT_MPMC` if @p unordered is set), or enabling
+     * the pipeline will fail with `MTDP_BAD_CONFIG`.
+     */
+    size_t replicas;
+
+    /**
+     * @brief Lets the replicas of the stage push their outputs as soon as they are ready.
+     * 
+     * @details The output buffers of a replicated stage reach the next stage in completion
+     * order rather than in input order, with no sequence tracking nor reordering:
+     * use it when the records are independent from each other.
+     * Any number of outputs may then be pushed for each input.
+     * It is optional to set, and it has no effect on a stage with a single replica.
+     */
+    bool unordered;
+
+    /**
+     * @brief Routes every input buffer to the replica chosen by its key,
+     * NULL to let any replica pull it.
+     * 
+     * @details The buffers pushed to the input pipe of the stage are routed by a hash
+     * of their key to one of the replicas, each one pulling from a private input pipe:
+     * the buffers sharing a key are always processed by the same replica, in the order
+     * they were pushed, so the state a replica keeps per key is never shared and needs
+     * no locks (on executor threads a replica may move between threads, but it never
+     * runs concurrently with itself). The buffers go back to the pool of the input pipe.
+     * The outputs reach the next stage in completion order, as with @p unordered.
+     * It is optional to set, and it has no effect on a stage with a single replica.
+     * 
+     * @note Both the pipes of a partitioned stage shall use the `MTDP_PIPE_TRANSPORT_LOCKED`
+     * or the `MTDP_PIPE_TRANSPORT_MPMC` transport, or enabling the pipeline will fail
+     * with `MTDP_BAD_CONFIG`. A key shared by most of the buffers serializes them
+     * on a single replica.
+     */
+    mtdp_stage_key_fn key;
+
+    /**
+     * @brief Runs the stage on the thread of the previous internal stage.
+     * 
+     * @details Cheap adjacent stages may spend more time handing buffers over through
+     * their pipe than processing them: a fused stage is run right after the previous
+     * one on the same thread, and the pipe between them is bypassed, with no locks nor
+     * wakeups, so that the buffers are processed again while still in cache.
+     * Any number of consecutive stages may be fused together, the callbacks and the
+     * buffers of the pipe in between being used as usual.
+     * It is optional to set, and it has no effect on the first internal stage.
+     * 
+     * @note Neither a fused stage nor the stage it is fused to may be replicated,
+     * and the pipe in between shall use the `MTDP_PIPE_TRANSPORT_LOCKED` transport,
+     * or enabling the pipeline will fail with `MTDP_BAD_CONFIG`.
+     * The @p name of a fused stage is not used.
+     */
+    bool fused;
+
+    /**
+     * @brief Leaves the stage out of the pipeline, the next step pulling the buffers
+     * of its input pipe instead of those of its output pipe.
+     * 
+     * @details A stage spliced out gets no thread and its output pipe stays empty:
+     * its slot is kept, to be spliced in later. Set it before enabling the pipeline,
+     * or call mtdp_pipeline_splice_out() and mtdp_pipeline_splice_in() while it runs.
+     * It is optional to set.
+     */
+    bool spliced_out;
 } mtdp_stage;
 
 /**
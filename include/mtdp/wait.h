@@ -0,0 +1,70 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+mtdp is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+mtdp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/** 
+ * @file 
+ * 
+ * @brief Header containing the policies used by the stages to wait for buffers.
+ * @note Do not import this file in user code, use the mtdp.h umbrella header instead.
+ */
+
+#ifndef MTDP_WAIT_H
+#define MTDP_WAIT_H
+
+#ifndef MTDP_H
+#  error do not #include <mtdp/wait.h> directly, #include <mtdp.h> instead
+#endif
+
+/**
+ * @brief How a source, stage or sink waits when it cannot proceed.
+ * 
+ * @details The policy is applied both when waiting for a full buffer
+ * on the input pipe (input starvation) and when waiting for an empty
+ * buffer on the output pipe (output pool exhaustion). In any case the wait
+ * is bounded, so that stop and disable requests are honored.
+ */
+typedef enum {
+    /**
+     * @brief Park the thread in the kernel until the buffer is available.
+     * 
+     * @details Lowest CPU usage, at the cost of a syscall and a wake-up latency
+     * on every wait. This is the default.
+     */
+    MTDP_WAIT_BLOCK,
+
+    /**
+     * @brief Busy-poll for a bounded number of iterations, then park the thread.
+     * 
+     * @details Short gaps between buffers are served with microsecond latencies,
+     * while long ones do not burn the core. The number of iterations is set
+     * with the `MTDP_WAIT_SPIN_COUNT` build setting.
+     */
+    MTDP_WAIT_SPIN_THEN_PARK,
+
+    /**
+     * @brief Poll, yielding the processor to other threads between attempts.
+     */
+    MTDP_WAIT_YIELD,
+
+    /**
+     * @brief Busy-poll with a CPU relax (e.g. PAUSE) instruction, never parking.
+     * 
+     * @details Best latency, but it keeps the core fully busy even when idle:
+     * only use it on cores isolated for the pipeline.
+     */
+    MTDP_WAIT_SPIN,
+} mtdp_wait_policy;
+
+#endif
@@ -27,8 +27,23 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #  define atomic_uchar                  volatile uint32_t
 #  define atomic_uint32_t               volatile uint32_t
 #  define atomic_flag                   volatile uint32_t
+#  define atomic_size_t                 volatile size_t
 #  define atomic_load(PTR)              (*PTR)
 #  define atomic_store(PTR, VAL)        (*(PTR) = (VAL))
+/* MSVC volatile accesses have acquire/release semantics (/volatile:ms) */
+#  define atomic_load_explicit(PTR, MO)       (*(PTR))
+#  define atomic_store_explicit(PTR, VAL, MO) (*(PTR) = (VAL))
+#  define atomic_exchange(PTR, VAL)     InterlockedExchange((PTR), (VAL))
+#  define atomic_thread_fence(MO)       MemoryBarrier()
+#  define atomic_fetch_add(PTR, VAL)    InterlockedExchangeAdd((PTR), (VAL))
+#  define atomic_fetch_sub(PTR, VAL)    InterlockedExchangeAdd((PTR), -(LONG)(VAL))
+#  if defined(_WIN64)
+#    define atomic_fetch_add_size(PTR, VAL) ((size_t)InterlockedExchangeAdd64((volatile LONG64*)(PTR), (LONG64)(VAL)))
+#    define atomic_fetch_sub_size(PTR, VAL) ((size_t)InterlockedExchangeAdd64((volatile LONG64*)(PTR), -(LONG64)(VAL)))
+#  else
+#    define atomic_fetch_add_size(PTR, VAL) ((size_t)InterlockedExchangeAdd((volatile LONG*)(PTR), (LONG)(VAL)))
+#    define atomic_fetch_sub_size(PTR, VAL) ((size_t)InterlockedExchangeAdd((volatile LONG*)(PTR), -(LONG)(VAL)))
+#  endif
 #  define atomic_fetch_or(PTR, VAL)     InterlockedOr((PTR), (VAL))
 #  define atomic_fetch_and(PTR, VAL)    InterlockedAnd((PTR), (VAL))
 #  define atomic_flag_test_and_set(PTR) InterlockedCompareExchange((PTR), 1, 0)
@@ -36,11 +51,48 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
     {                                                                                                                            \
       0                                                                                                                          \
     }
+#  define atomic_compare_exchange_strong(PTR, EXP, VAL)                  mtdp_atomic_compare_exchange((PTR), (EXP), (VAL))
+#  define atomic_compare_exchange_weak_explicit(PTR, EXP, VAL, MO1, MO2) mtdp_atomic_compare_exchange((PTR), (EXP), (VAL))
+#  define atomic_compare_exchange_weak_size_explicit(PTR, EXP, VAL, MO1, MO2)                                               \
+    mtdp_atomic_compare_exchange_size((PTR), (EXP), (VAL))
+#  define atomic_compare_exchange_strong_size(PTR, EXP, VAL) mtdp_atomic_compare_exchange_size((PTR), (EXP), (VAL))
+
+static inline bool
+mtdp_atomic_compare_exchange(volatile uint32_t* obj, uint32_t* expected, uint32_t desired)
+{
+    uint32_t prev = (uint32_t)InterlockedCompareExchange((volatile LONG*)obj, (LONG)desired, (LONG)*expected);
+    if(prev == *expected) {
+        return true;
+    }
+    *expected = prev;
+    return false;
+}
+
+static inline bool
+mtdp_atomic_compare_exchange_size(volatile size_t* obj, size_t* expected, size_t desired)
+{
+    size_t prev = (size_t)InterlockedCompareExchangePointer((PVOID volatile*)obj, (PVOID)desired, (PVOID)*expected);
+    if(prev == *expected) {
+        return true;
+    }
+    *expected = prev;
+    return false;
+}
 #elif __unix__
 #  include <stdatomic.h>
 #  define atomic_uint32_t _Atomic(uint32_t)
+/* The Windows emulation needs to tell size_t from uint32_t operands */
+#  define atomic_compare_exchange_weak_size_explicit atomic_compare_exchange_weak_explicit
+#  define atomic_compare_exchange_strong_size        atomic_compare_exchange_strong
+#  define atomic_fetch_add_size                      atomic_fetch_add
+#  define atomic_fetch_sub_size                      atomic_fetch_sub
 #else
 #  error atomic not implemented on this platform
 #endif
 
+#if !defined(MTDP_CACHE_LINE_SIZE) || !MTDP_CACHE_LINE_SIZE
+#  undef MTDP_CACHE_LINE_SIZE
+#  define MTDP_CACHE_LINE_SIZE 64
+#endif
+
 #endif
\ No newline at end of file
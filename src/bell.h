@@ -19,16 +19,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "futex.h"
 #include "thread.h"
 
+/* Waiters are only woken up on an actual transition, so ringing an already rung bell costs no syscall. */
+
 #define mtdp_set_done(ftx)                                                                                                       \
   do {                                                                                                                           \
-    atomic_store((ftx), 1);                                                                                                      \
-    mtdp_futex_notify_all(ftx);                                                                                                  \
+    if(atomic_load(ftx) != 1 && atomic_exchange((ftx), 1) != 1) {                                                                \
+      mtdp_futex_notify_all(ftx);                                                                                                \
+    }                                                                                                                            \
   } while(0)
 
 #define mtdp_unset_done(ftx)                                                                                                     \
   do {                                                                                                                           \
-    atomic_store((ftx), 0);                                                                                                      \
-    mtdp_futex_notify_all(ftx);                                                                                                  \
+    if(atomic_load(ftx) != 0 && atomic_exchange((ftx), 0) != 0) {                                                                \
+      mtdp_futex_notify_all(ftx);                                                                                                \
+    }                                                                                                                            \
   } while(0)
 
 #endif
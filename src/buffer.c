@@ -14,6 +14,8 @@ You should have received a copy of the GNU Lesser General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 // clang-format off
 #include "mtdp.h"
@@ -124,28 +126,17 @@ mtdp_buffer_pool_size(const mtdp_buffer_pool* self)
 bool
 mtdp_buffer_pool_resize(mtdp_buffer_pool* self, size_t size)
 {
-    bool ret = true;
-
-#if MTDP_BUFFER_POOL_STATIC_SIZE
-    size_t capacity = MTDP_BUFFER_POOL_STATIC_SIZE;
-#else
-    size_t capacity = self->capacity;
-#endif
-    signed long delta = (signed long) size - (signed long) capacity;
-    if(delta < 0) {
-        self->size += delta;
-    }
-    else if(delta > 0) {
 #if MTDP_BUFFER_POOL_STATIC_SIZE
+    if(size > MTDP_BUFFER_POOL_STATIC_SIZE) {
         return false;
+    }
 #else
-        ret = mtdp_buffer_pool_realloc(self, size);
-        if(ret) {
-            self->size += delta;
-        }
-#endif
+    if(size > self->capacity && !mtdp_buffer_pool_realloc(self, size)) {
+        return false;
     }
-    return ret;
+#endif
+    self->size = size;
+    return true;
 }
 
 #undef MTDP_MEMORY_ACCESS
@@ -477,3 +468,391 @@ mtdp_buffer_fifo_size(const mtdp_buffer_fifo* self)
 {
     return self->size;
 }
+
+inline static size_t
+mtdp_buffer_ring_next(const mtdp_buffer_ring* self, size_t index)
+{
+    return ++index == self->n_slots ? 0 : index;
+}
+
+void
+mtdp_buffer_ring_init(mtdp_buffer_ring* self)
+{
+#if MTDP_BUFFER_POOL_STATIC_SIZE
+    self->n_slots = MTDP_BUFFER_POOL_STATIC_SIZE + 1;
+#else
+    self->slots   = NULL;
+    self->n_slots = 0;
+#endif
+    self->cached_head = self->cached_tail = 0;
+    atomic_store(&self->head, 0);
+    atomic_store(&self->tail, 0);
+}
+
+void
+mtdp_buffer_ring_destroy(mtdp_buffer_ring* self)
+{
+#if MTDP_BUFFER_POOL_STATIC_SIZE
+    (void)self;
+#else
+    free(self->slots);
+    self->slots   = NULL;
+    self->n_slots = 0;
+#endif
+}
+
+bool
+mtdp_buffer_ring_resize(mtdp_buffer_ring* self, size_t capacity)
+{
+    size_t size = mtdp_buffer_ring_size(self);
+    size_t head = atomic_load(&self->head);
+
+    if(capacity < size) {
+        return false;
+    }
+#if MTDP_BUFFER_POOL_STATIC_SIZE
+    if(capacity > MTDP_BUFFER_POOL_STATIC_SIZE) {
+        return false;
+    }
+    /* Rotate the elements to the beginning of the storage. */
+    mtdp_buffer tmp[MTDP_BUFFER_POOL_STATIC_SIZE + 1];
+    for(size_t i = 0; i != size; ++i, head = mtdp_buffer_ring_next(self, head)) {
+        tmp[i] = self->slots[head];
+    }
+    memcpy(self->slots, tmp, size * sizeof(mtdp_buffer));
+#else
+    mtdp_buffer* slots = (mtdp_buffer*)malloc((capacity + 1) * sizeof(mtdp_buffer));
+    if(!slots) {
+        return false;
+    }
+    for(size_t i = 0; i != size; ++i, head = mtdp_buffer_ring_next(self, head)) {
+        slots[i] = self->slots[head];
+    }
+    free(self->slots);
+    self->slots   = slots;
+    self->n_slots = capacity + 1;
+#endif
+    self->cached_head = 0;
+    self->cached_tail = size;
+    atomic_store(&self->head, 0);
+    atomic_store(&self->tail, size);
+    return true;
+}
+
+bool
+mtdp_buffer_ring_push(mtdp_buffer_ring* self, const mtdp_buffer e)
+{
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    size_t next = mtdp_buffer_ring_next(self, tail);
+
+    if(unlikely(next == self->cached_head)) {
+        self->cached_head = atomic_load_explicit(&self->head, memory_order_acquire);
+        if(next == self->cached_head) {
+            return false;
+        }
+    }
+    self->slots[tail] = e;
+    atomic_store_explicit(&self->tail, next, memory_order_release);
+    return true;
+}
+
+bool
+mtdp_buffer_ring_pop(mtdp_buffer_ring* self, mtdp_buffer* ret)
+{
+    size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+
+    if(unlikely(head == self->cached_tail)) {
+        self->cached_tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+        if(head == self->cached_tail) {
+            return false;
+        }
+    }
+    if(ret) {
+        *ret = self->slots[head];
+    }
+    atomic_store_explicit(&self->head, mtdp_buffer_ring_next(self, head), memory_order_release);
+    return true;
+}
+
+size_t
+mtdp_buffer_ring_size(const mtdp_buffer_ring* self)
+{
+    size_t head = atomic_load(&self->head);
+    size_t tail = atomic_load(&self->tail);
+    return tail >= head ? tail - head : self->n_slots - head + tail;
+}
+
+void
+mtdp_buffer_mpmc_init(mtdp_buffer_mpmc* self)
+{
+#if MTDP_BUFFER_POOL_STATIC_SIZE
+    /* Neither writable nor readable until resized. */
+    atomic_store(&self->cells[0].sequence, SIZE_MAX);
+#else
+    self->cells = NULL;
+#endif
+    self->mask = 0;
+    atomic_store(&self->enqueue_pos, 0);
+    atomic_store(&self->dequeue_pos, 0);
+}
+
+void
+mtdp_buffer_mpmc_destroy(mtdp_buffer_mpmc* self)
+{
+#if MTDP_BUFFER_POOL_STATIC_SIZE
+    (void)self;
+#else
+    free(self->cells);
+    mtdp_buffer_mpmc_init(self);
+#endif
+}
+
+bool
+mtdp_buffer_mpmc_resize(mtdp_buffer_mpmc* self, size_t capacity)
+{
+    size_t      size = mtdp_buffer_mpmc_size(self);
+    size_t      n_cells;
+    mtdp_buffer tmp;
+
+    if(capacity < size) {
+        return false;
+    }
+    for(n_cells = 1; n_cells < capacity; n_cells <<= 1) {}
+#if MTDP_BUFFER_POOL_STATIC_SIZE
+    if(capacity > MTDP_BUFFER_POOL_STATIC_SIZE) {
+        return false;
+    }
+    /* Rotate the elements to the beginning of the storage. */
+    mtdp_buffer elements[MTDP_BUFFER_POOL_STATIC_SIZE];
+    for(size_t i = 0; mtdp_buffer_mpmc_pop(self, &tmp); ++i) {
+        elements[i] = tmp;
+    }
+#else
+    struct mtdp_buffer_mpmc_cell* cells = (struct mtdp_buffer_mpmc_cell*)malloc(n_cells * sizeof(struct mtdp_buffer_mpmc_cell));
+    if(!cells) {
+        return false;
+    }
+    for(size_t i = 0; mtdp_buffer_mpmc_pop(self, &tmp); ++i) {
+        cells[i].buffer = tmp;
+    }
+    free(self->cells);
+    self->cells = cells;
+#endif
+    self->mask = n_cells - 1;
+    for(size_t i = 0; i != n_cells; ++i) {
+#if MTDP_BUFFER_POOL_STATIC_SIZE
+        if(i < size) {
+            self->cells[i].buffer = elements[i];
+        }
+#endif
+        /* Cells already holding an element are ready to be read. */
+        atomic_store(&self->cells[i].sequence, i < size ? i + 1 : i);
+    }
+    atomic_store(&self->enqueue_pos, size);
+    atomic_store(&self->dequeue_pos, 0);
+    return true;
+}
+
+bool
+mtdp_buffer_mpmc_push(mtdp_buffer_mpmc* self, const mtdp_buffer e)
+{
+    struct mtdp_buffer_mpmc_cell* cell;
+    size_t                        pos = atomic_load_explicit(&self->enqueue_pos, memory_order_relaxed);
+    ptrdiff_t                     diff;
+
+#if !MTDP_BUFFER_POOL_STATIC_SIZE
+    if(unlikely(!self->cells)) {
+        return false;
+    }
+#endif
+    while(true) {
+        cell = &self->cells[pos & self->mask];
+        diff = (ptrdiff_t)atomic_load_explicit(&cell->sequence, memory_order_acquire) - (ptrdiff_t)pos;
+        if(diff == 0) {
+            if(atomic_compare_exchange_weak_size_explicit(&self->enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if(diff < 0) {
+            /* The cell has not been read since the previous lap: full. */
+            return false;
+        }
+        else {
+            pos = atomic_load_explicit(&self->enqueue_pos, memory_order_relaxed);
+        }
+    }
+    cell->buffer = e;
+    atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+bool
+mtdp_buffer_mpmc_pop(mtdp_buffer_mpmc* self, mtdp_buffer* ret)
+{
+    struct mtdp_buffer_mpmc_cell* cell;
+    size_t                        pos = atomic_load_explicit(&self->dequeue_pos, memory_order_relaxed);
+    ptrdiff_t                     diff;
+
+#if !MTDP_BUFFER_POOL_STATIC_SIZE
+    if(unlikely(!self->cells)) {
+        return false;
+    }
+#endif
+    while(true) {
+        cell = &self->cells[pos & self->mask];
+        diff = (ptrdiff_t)atomic_load_explicit(&cell->sequence, memory_order_acquire) - (ptrdiff_t)(pos + 1);
+        if(diff == 0) {
+            if(atomic_compare_exchange_weak_size_explicit(&self->dequeue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if(diff < 0) {
+            /* The cell has not been written in this lap: empty. */
+            return false;
+        }
+        else {
+            pos = atomic_load_explicit(&self->dequeue_pos, memory_order_relaxed);
+        }
+    }
+    if(ret) {
+        *ret = cell->buffer;
+    }
+    atomic_store_explicit(&cell->sequence, pos + self->mask + 1, memory_order_release);
+    return true;
+}
+
+size_t
+mtdp_buffer_mpmc_size(const mtdp_buffer_mpmc* self)
+{
+    size_t dequeue_pos = atomic_load(&self->dequeue_pos);
+    size_t enqueue_pos = atomic_load(&self->enqueue_pos);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
+
+enum {
+    MTDP_BUFFER_REORDER_EMPTY,
+    MTDP_BUFFER_REORDER_BUFFER,
+    MTDP_BUFFER_REORDER_SKIPPED
+};
+
+void
+mtdp_buffer_reorder_init(mtdp_buffer_reorder* self)
+{
+    self->entries  = NULL;
+    self->capacity = 0;
+    self->next     = 0;
+}
+
+void
+mtdp_buffer_reorder_destroy(mtdp_buffer_reorder* self)
+{
+    free(self->entries);
+    mtdp_buffer_reorder_init(self);
+}
+
+inline static bool
+mtdp_buffer_reorder_reserve(mtdp_buffer_reorder* self, size_t seq)
+{
+    struct mtdp_buffer_reorder_entry* entries;
+    size_t                            capacity = self->capacity ? self->capacity : 16;
+
+    if(seq - self->next < self->capacity) {
+        return true;
+    }
+    while(seq - self->next >= capacity) {
+        capacity *= 2;
+    }
+    entries = (struct mtdp_buffer_reorder_entry*)calloc(capacity, sizeof(struct mtdp_buffer_reorder_entry));
+    if(!entries) {
+        return false;
+    }
+    /* Entries are rehashed on the new capacity, the window starting at the same sequence */
+    for(size_t i = 0; i != self->capacity; ++i) {
+        entries[(self->next + i) & (capacity - 1)] = self->entries[(self->next + i) & (self->capacity - 1)];
+    }
+    free(self->entries);
+    self->entries  = entries;
+    self->capacity = capacity;
+    return true;
+}
+
+inline static bool
+mtdp_buffer_reorder_set(mtdp_buffer_reorder* self, size_t seq, const mtdp_buffer e, uint8_t state)
+{
+    struct mtdp_buffer_reorder_entry* entry;
+
+    if(seq < self->next || !mtdp_buffer_reorder_reserve(self, seq)) {
+        return false;
+    }
+    entry         = &self->entries[seq & (self->capacity - 1)];
+    entry->buffer = e;
+    entry->state  = state;
+    return true;
+}
+
+bool
+mtdp_buffer_reorder_put(mtdp_buffer_reorder* self, size_t seq, const mtdp_buffer e)
+{
+    return mtdp_buffer_reorder_set(self, seq, e, MTDP_BUFFER_REORDER_BUFFER);
+}
+
+bool
+mtdp_buffer_reorder_skip(mtdp_buffer_reorder* self, size_t seq)
+{
+    return mtdp_buffer_reorder_set(self, seq, NULL, MTDP_BUFFER_REORDER_SKIPPED);
+}
+
+bool
+mtdp_buffer_reorder_pop(mtdp_buffer_reorder* self, mtdp_buffer* ret)
+{
+    struct mtdp_buffer_reorder_entry* entry;
+
+    /* Skipped sequence numbers are consumed silently. */
+    while(self->capacity) {
+        entry = &self->entries[self->next & (self->capacity - 1)];
+        if(entry->state == MTDP_BUFFER_REORDER_EMPTY) {
+            break;
+        }
+        ++self->next;
+        if(entry->state == MTDP_BUFFER_REORDER_BUFFER) {
+            entry->state = MTDP_BUFFER_REORDER_EMPTY;
+            *ret         = entry->buffer;
+            return true;
+        }
+        entry->state = MTDP_BUFFER_REORDER_EMPTY;
+    }
+    return false;
+}
+
+bool
+mtdp_buffer_reorder_take_any(mtdp_buffer_reorder* self, mtdp_buffer* ret)
+{
+    for(size_t i = 0; i != self->capacity; ++i) {
+        if(self->entries[i].state == MTDP_BUFFER_REORDER_BUFFER) {
+            self->entries[i].state = MTDP_BUFFER_REORDER_EMPTY;
+            *ret                   = self->entries[i].buffer;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+mtdp_buffer_reorder_reset(mtdp_buffer_reorder* self)
+{
+    for(size_t i = 0; i != self->capacity; ++i) {
+        self->entries[i].state = MTDP_BUFFER_REORDER_EMPTY;
+    }
+    self->next = 0;
+}
+
+size_t
+mtdp_buffer_reorder_size(const mtdp_buffer_reorder* self)
+{
+    size_t out = 0;
+
+    for(size_t i = 0; i != self->capacity; ++i) {
+        out += self->entries[i].state == MTDP_BUFFER_REORDER_BUFFER;
+    }
+    return out;
+}
@@ -59,6 +59,7 @@ mtdp_strerror(enum mtdp_error error)
     case MTDP_THRD_ERROR: return "thrd error";
     case MTDP_MTX_ERROR: return "mtx error";
     case MTDP_CND_ERROR: return "cnd error";
+    case MTDP_BAD_CONFIG: return "unsupported configuration";
     default: return "errno error";
     }
 }
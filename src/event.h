@@ -0,0 +1,79 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+mtdp is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+mtdp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef MTDP_EVENT_H
+#define MTDP_EVENT_H
+
+#include "futex.h"
+
+#include <stdint.h>
+
+/*
+    Eventcount: lets a thread sleep until a condition it polls becomes true,
+    without the notifier paying a syscall when nobody sleeps.
+
+    Waiter:                                 Notifier:
+        key = mtdp_event_prepare(ev);           make the condition true;
+        if(condition) {                         mtdp_event_notify(ev);
+            mtdp_event_cancel(ev);
+        } else {
+            mtdp_event_wait_for(ev, key, us);
+        }
+*/
+typedef struct {
+    mtdp_futex      epoch;
+    atomic_uint32_t waiters;
+} mtdp_event;
+
+static inline void
+mtdp_event_init(mtdp_event* self)
+{
+    atomic_store(&self->epoch, 0);
+    atomic_store(&self->waiters, 0);
+}
+
+static inline uint32_t
+mtdp_event_prepare(mtdp_event* self)
+{
+    atomic_fetch_add(&self->waiters, 1);
+    return atomic_load(&self->epoch);
+}
+
+static inline void
+mtdp_event_cancel(mtdp_event* self)
+{
+    atomic_fetch_sub(&self->waiters, 1);
+}
+
+static inline void
+mtdp_event_wait_for(mtdp_event* self, uint32_t key, uint64_t microseconds)
+{
+    mtdp_futex_wait_for(&self->epoch, key, microseconds);
+    atomic_fetch_sub(&self->waiters, 1);
+}
+
+static inline void
+mtdp_event_notify(mtdp_event* self)
+{
+    /* Orders the condition change before reading the waiters, pairing with mtdp_event_prepare */
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load(&self->waiters)) {
+        atomic_fetch_add(&self->epoch, 1);
+        mtdp_futex_notify_all(&self->epoch);
+    }
+}
+
+#endif
@@ -0,0 +1,432 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+mtdp is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+mtdp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+// clang-format off
+#include "mtdp.h"
+#include "impl/errno.h"
+#include "impl/executor.h"
+// clang-format on
+
+#include "api.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+MTDP_DEFINE_DYNAMIC_INSTANCE(mtdp_executor)
+
+/* Iterations a task runs in a row before its thread looks for other tasks */
+#define MTDP_EXECUTOR_BATCH 64
+
+/* Tasks a thread takes from its own deque before checking the injection queue first */
+#define MTDP_EXECUTOR_FAIRNESS_TICKS 61
+
+enum {
+    MTDP_TASK_IDLE,
+    MTDP_TASK_SCHEDULED,
+    MTDP_TASK_RUNNING,
+    /* Running, and scheduled again by a neighbor meanwhile */
+    MTDP_TASK_NOTIFIED
+};
+
+/* Indices start from 1, so that the owner may decrement the bottom of an empty deque. */
+static bool
+mtdp_task_deque_init(mtdp_task_deque* self, size_t capacity)
+{
+    size_t n_slots;
+
+    for(n_slots = 1; n_slots < capacity; n_slots <<= 1) {}
+    self->slots = (atomic_size_t*)malloc(n_slots * sizeof(atomic_size_t));
+    self->mask  = n_slots - 1;
+    atomic_store(&self->top, 1);
+    atomic_store(&self->bottom, 1);
+    return self->slots != NULL;
+}
+
+/* Owner only */
+static void
+mtdp_task_deque_push(mtdp_task_deque* self, mtdp_task* task)
+{
+    size_t bottom = atomic_load_explicit(&self->bottom, memory_order_relaxed);
+
+    atomic_store_explicit(&self->slots[bottom & self->mask], (size_t)task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&self->bottom, bottom + 1, memory_order_relaxed);
+}
+
+/* Owner only, takes the most recently pushed task */
+static mtdp_task*
+mtdp_task_deque_take(mtdp_task_deque* self)
+{
+    size_t     bottom = atomic_load_explicit(&self->bottom, memory_order_relaxed) - 1;
+    size_t     top;
+    mtdp_task* task = NULL;
+
+    atomic_store_explicit(&self->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    top = atomic_load_explicit(&self->top, memory_order_relaxed);
+    if(top <= bottom) {
+        task = (mtdp_task*)atomic_load_explicit(&self->slots[bottom & self->mask], memory_order_relaxed);
+        if(top == bottom) {
+            /* Last task: the thieves may be racing for it. */
+            if(!atomic_compare_exchange_strong_size(&self->top, &top, top + 1)) {
+                task = NULL;
+            }
+            atomic_store_explicit(&self->bottom, bottom + 1, memory_order_relaxed);
+        }
+    }
+    else {
+        atomic_store_explicit(&self->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+/* Any thread, takes the least recently pushed task */
+static mtdp_task*
+mtdp_task_deque_steal(mtdp_task_deque* self)
+{
+    size_t     top = atomic_load_explicit(&self->top, memory_order_acquire);
+    size_t     bottom;
+    mtdp_task* task;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    bottom = atomic_load_explicit(&self->bottom, memory_order_acquire);
+    if(top < bottom) {
+        task = (mtdp_task*)atomic_load_explicit(&self->slots[top & self->mask], memory_order_relaxed);
+        if(atomic_compare_exchange_strong_size(&self->top, &top, top + 1)) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/* Queues a task already marked as scheduled, behind every runnable task if fair, on the deque of the calling executor thread otherwise */
+static void
+mtdp_executor_enqueue(mtdp_executor* self, mtdp_task* task, mtdp_executor_thread* thread, bool fair)
+{
+    if(fair || !thread) {
+        /*
+            The injection queue has room for every task, but a cell is only reusable once its previous
+            pop completes: a thread preempted while popping may make the queue look full for a while.
+        */
+        while(!mtdp_buffer_mpmc_push(&self->injected, (mtdp_buffer)task)) {
+            if(thread) {
+                mtdp_task_deque_push(&thread->deque, task);
+                break;
+            }
+            thrd_yield();
+        }
+    }
+    else {
+        mtdp_task_deque_push(&thread->deque, task);
+    }
+    mtdp_event_notify(&self->event);
+}
+
+/* Makes a task runnable */
+static void
+mtdp_executor_schedule(mtdp_executor* self, mtdp_task* task, mtdp_executor_thread* thread)
+{
+    uint32_t state = atomic_load(&task->state);
+
+    while(true) {
+        switch(state) {
+        case MTDP_TASK_IDLE:
+            if(atomic_compare_exchange_strong(&task->state, &state, MTDP_TASK_SCHEDULED)) {
+                atomic_fetch_add_size(&task->set->active, 1);
+                mtdp_executor_enqueue(self, task, thread, false);
+                return;
+            }
+            break;
+        case MTDP_TASK_RUNNING:
+            if(atomic_compare_exchange_strong(&task->state, &state, MTDP_TASK_NOTIFIED)) {
+                return;
+            }
+            break;
+        default: return;
+        }
+    }
+}
+
+/* The tasks of the same level and of the adjacent ones share a pipe with the given task */
+static void
+mtdp_executor_schedule_neighbors(mtdp_executor* self, mtdp_task* task, mtdp_executor_thread* thread)
+{
+    mtdp_task_set* set   = task->set;
+    size_t         level = task->level;
+    size_t         first = set->levels[level ? level - 1 : 0];
+    size_t         last  = set->levels[level + 2 <= set->n_levels ? level + 2 : set->n_levels];
+
+    for(size_t i = first; i != last; ++i) {
+        if(&set->tasks[i] != task) {
+            mtdp_executor_schedule(self, &set->tasks[i], thread);
+        }
+    }
+}
+
+/* Accounts for a task gone idle, once its state has been updated */
+static void
+mtdp_executor_deactivate(mtdp_executor* self, mtdp_task_set* set)
+{
+    /* The set may be detached as soon as the counter drops: the event belongs to the executor. */
+    if(atomic_fetch_sub_size(&set->active, 1) == 1) {
+        mtdp_event_notify(&self->idle_event);
+    }
+}
+
+static mtdp_task*
+mtdp_executor_next_task(mtdp_executor_thread* thread)
+{
+    mtdp_executor* self = thread->executor;
+    mtdp_task*     task;
+    mtdp_buffer    injected;
+
+    if(++thread->ticks % MTDP_EXECUTOR_FAIRNESS_TICKS == 0 && mtdp_buffer_mpmc_pop(&self->injected, &injected)) {
+        return (mtdp_task*)injected;
+    }
+    if((task = mtdp_task_deque_take(&thread->deque))) {
+        return task;
+    }
+    if(mtdp_buffer_mpmc_pop(&self->injected, &injected)) {
+        return (mtdp_task*)injected;
+    }
+    for(size_t i = self->n_threads; i--;) {
+        thread->victim = (thread->victim + 1) % self->n_threads;
+        if(&self->threads[thread->victim] != thread && (task = mtdp_task_deque_steal(&self->threads[thread->victim].deque))) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+static int
+mtdp_executor_routine(void* data)
+{
+    mtdp_executor_thread* thread = (mtdp_executor_thread*)data;
+    mtdp_executor*        self   = thread->executor;
+    mtdp_task*            task   = mtdp_executor_next_task(thread);
+    uint32_t              key, expected = MTDP_TASK_RUNNING;
+    int                   progress = 0;
+
+    if(!task) {
+        key = mtdp_event_prepare(&self->event);
+        if(!(task = mtdp_executor_next_task(thread))) {
+            mtdp_event_wait_for(&self->event, key, MTDP_PIPELINE_CONSUMER_TIMEOUT_US);
+            return 0;
+        }
+        mtdp_event_cancel(&self->event);
+    }
+
+    if(!mtdp_worker_running(task->worker)) {
+        /* Stopped or finished: mtdp_executor_schedule_set will schedule it again. */
+        atomic_store(&task->state, MTDP_TASK_IDLE);
+        mtdp_executor_deactivate(self, task->set);
+        return 0;
+    }
+    atomic_store(&task->state, MTDP_TASK_RUNNING);
+    for(uint32_t i = MTDP_EXECUTOR_BATCH; i-- && mtdp_worker_running(task->worker) && task->worker->cb(task->worker->args);) {
+        progress = 1;
+    }
+    if(progress) {
+        mtdp_executor_schedule_neighbors(self, task, thread);
+    }
+    else if(atomic_compare_exchange_strong(&task->state, &expected, MTDP_TASK_IDLE)) {
+        mtdp_executor_deactivate(self, task->set);
+        return 0;
+    }
+
+    /* Still runnable: requeued fairly, so that it does not monopolize the thread. */
+    atomic_store(&task->state, MTDP_TASK_SCHEDULED);
+    mtdp_executor_enqueue(self, task, thread, true);
+    return progress;
+}
+
+bool
+mtdp_executor_init(mtdp_executor* self, size_t n_threads, size_t capacity)
+{
+    self->threads   = (mtdp_executor_thread*)calloc(n_threads, sizeof(mtdp_executor_thread));
+    self->n_threads = 0;
+    self->capacity  = capacity;
+    atomic_store(&self->reserved, 0);
+    mtdp_buffer_mpmc_init(&self->injected);
+    mtdp_event_init(&self->event);
+    mtdp_event_init(&self->idle_event);
+    if(!self->threads || !mtdp_buffer_mpmc_resize(&self->injected, capacity)) {
+        mtdp_executor_deinit(self);
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+        return false;
+    }
+    for(size_t i = 0; i != n_threads; ++i) {
+        if(!mtdp_task_deque_init(&self->threads[i].deque, capacity)) {
+            /* Also frees the deque of the failing thread. */
+            self->n_threads = i + 1;
+            mtdp_executor_deinit(self);
+            *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+            return false;
+        }
+        mtdp_worker_init(&self->threads[i].worker);
+        self->threads[i].worker.cb   = mtdp_executor_routine;
+        self->threads[i].worker.args = &self->threads[i];
+        self->threads[i].executor    = self;
+        self->threads[i].victim      = i;
+        self->n_threads              = i + 1;
+    }
+    for(size_t i = 0; i != n_threads; ++i) {
+        if(!mtdp_worker_create_thread(&self->threads[i].worker)) {
+            /* Only the threads created so far are to be joined. */
+            for(size_t j = i; j != n_threads; ++j) {
+                self->threads[j].worker.pooled = true;
+            }
+            mtdp_executor_deinit(self);
+            *mtdp_errno_ptr_mutable() = MTDP_THRD_ERROR;
+            return false;
+        }
+        mtdp_worker_enable(&self->threads[i].worker);
+    }
+    return true;
+}
+
+void
+mtdp_executor_deinit(mtdp_executor* self)
+{
+    for(size_t i = 0; i != self->n_threads; ++i) {
+        mtdp_worker_destroy(&self->threads[i].worker);
+    }
+    /* Wakes up the idle threads, waiting on the event rather than on their state. */
+    atomic_fetch_add(&self->event.epoch, 1);
+    mtdp_futex_notify_all(&self->event.epoch);
+    for(size_t i = 0; i != self->n_threads; ++i) {
+        mtdp_worker_join(&self->threads[i].worker);
+        free(self->threads[i].deque.slots);
+    }
+    free(self->threads);
+    mtdp_buffer_mpmc_destroy(&self->injected);
+    self->threads   = NULL;
+    self->n_threads = 0;
+}
+
+bool
+mtdp_task_set_init(mtdp_task_set* self, size_t n_tasks)
+{
+    self->tasks    = (mtdp_task*)malloc(n_tasks * sizeof(mtdp_task));
+    self->n_tasks  = 0;
+    self->levels   = NULL;
+    self->n_levels = 0;
+    atomic_store(&self->active, 0);
+    return self->tasks != NULL;
+}
+
+void
+mtdp_task_set_add(mtdp_task_set* self, mtdp_worker* worker, size_t level)
+{
+    mtdp_task* task = &self->tasks[self->n_tasks++];
+
+    worker->pooled = true;
+    task->worker   = worker;
+    task->level    = level;
+    task->set      = self;
+    atomic_store(&task->state, MTDP_TASK_IDLE);
+}
+
+void
+mtdp_task_set_destroy(mtdp_task_set* self)
+{
+    free(self->tasks);
+    free(self->levels);
+    self->tasks   = NULL;
+    self->levels  = NULL;
+    self->n_tasks = self->n_levels = 0;
+}
+
+bool
+mtdp_executor_attach(mtdp_executor* self, mtdp_task_set* set)
+{
+    size_t reserved = atomic_load(&self->reserved);
+
+    do {
+        if(set->n_tasks > self->capacity - reserved) {
+            *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+            return false;
+        }
+    } while(!atomic_compare_exchange_weak_size_explicit(&self->reserved, &reserved, reserved + set->n_tasks,
+                                                        memory_order_seq_cst, memory_order_seq_cst));
+    set->n_levels = set->n_tasks ? set->tasks[set->n_tasks - 1].level + 1 : 0;
+    if(!(set->levels = (size_t*)malloc((set->n_levels + 1) * sizeof(size_t)))) {
+        atomic_fetch_sub_size(&self->reserved, set->n_tasks);
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+        return false;
+    }
+    for(size_t level = 0, i = 0; level <= set->n_levels; ++level) {
+        while(i != set->n_tasks && set->tasks[i].level < level) {
+            ++i;
+        }
+        set->levels[level] = i;
+    }
+    return true;
+}
+
+void
+mtdp_executor_schedule_set(mtdp_executor* self, mtdp_task_set* set)
+{
+    for(size_t i = 0; i != set->n_tasks; ++i) {
+        mtdp_executor_schedule(self, &set->tasks[i], NULL);
+    }
+}
+
+void
+mtdp_executor_detach(mtdp_executor* self, mtdp_task_set* set)
+{
+    uint32_t key;
+
+    /* The tasks still queued are dropped by the threads, as their workers are not running. */
+    while(true) {
+        key = mtdp_event_prepare(&self->idle_event);
+        if(mtdp_task_set_idle(set)) {
+            mtdp_event_cancel(&self->idle_event);
+            break;
+        }
+        mtdp_event_wait_for(&self->idle_event, key, MTDP_PIPELINE_CONSUMER_TIMEOUT_US);
+    }
+    atomic_fetch_sub_size(&self->reserved, set->n_tasks);
+}
+
+MTDP_API_INTERNAL mtdp_executor*
+mtdp_executor_create(size_t n_threads, size_t capacity)
+{
+    mtdp_executor* out = mtdp_executor_alloc();
+
+    if(!out) {
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+        return NULL;
+    }
+    if(!mtdp_executor_init(out, n_threads ? n_threads : mtdp_thread_hardware_concurrency(), capacity)) {
+        mtdp_executor_dealloc(out);
+        return NULL;
+    }
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return out;
+}
+
+MTDP_API_INTERNAL void
+mtdp_executor_destroy(mtdp_executor* executor)
+{
+    if(executor) {
+        mtdp_executor_deinit(executor);
+        mtdp_executor_dealloc(executor);
+        *mtdp_errno_ptr_mutable() = MTDP_OK;
+    }
+    else {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+    }
+}
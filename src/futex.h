@@ -38,9 +38,17 @@ along with this program.  If not, see
 
 #  include <linux/futex.h>
 #  include <sys/syscall.h>
+#  include <time.h>
 #  define mtdp_futex_wait(ftx, val)                                                                                              \
     while(atomic_load(ftx) == val && syscall(SYS_futex, (ftx), FUTEX_WAIT_PRIVATE, val, NULL) == 0) {                            \
     }
+#  define mtdp_futex_wait_for(ftx, val, us)                                                                                      \
+    do {                                                                                                                         \
+      struct timespec ts_ = {(time_t)((us) / 1000000), (long)((us) % 1000000) * 1000};                                           \
+      if(atomic_load(ftx) == val) {                                                                                              \
+        syscall(SYS_futex, (ftx), FUTEX_WAIT_PRIVATE, val, &ts_);                                                                \
+      }                                                                                                                          \
+    } while(0)
 #  define mtdp_futex_notify_one(ftx) (syscall(SYS_futex, (ftx), FUTEX_WAKE_PRIVATE, 1))
 #  define mtdp_futex_notify_all(ftx) (syscall(SYS_futex, (ftx), FUTEX_WAKE_PRIVATE, INT_MAX))
 #elif _WIN32
@@ -52,6 +60,13 @@ along with this program.  If not, see
       do {                                                                                                                       \
       } while((atomic_load(ftx) == val) && !WaitOnAddress((PVOID)ftx, &val_, sizeof(uint32_t), INFINITE));                       \
     } while(0)
+#  define mtdp_futex_wait_for(ftx, val, us)                                                                                      \
+    do {                                                                                                                         \
+      uint32_t val_ = val;                                                                                                       \
+      if(atomic_load(ftx) == val) {                                                                                              \
+        WaitOnAddress((PVOID)ftx, &val_, sizeof(uint32_t), (DWORD)(((us) + 999) / 1000));                                        \
+      }                                                                                                                          \
+    } while(0)
 #  define mtdp_futex_notify_one(ftx) WakeByAddressSingle((PVOID)ftx)
 #  define mtdp_futex_notify_all(ftx) WakeByAddressAll((PVOID)ftx)
 #else
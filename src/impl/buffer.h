@@ -16,6 +16,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #ifndef MTDP_IMPL_BUFFER_H
 #define MTDP_IMPL_BUFFER_H
 
+#include "atomic.h"
 #include "memory.h"
 #include "mtdp/buffer.h"
 
@@ -114,4 +115,109 @@ bool   mtdp_buffer_fifo_push_back(mtdp_buffer_fifo* self, const mtdp_buffer);
 bool   mtdp_buffer_fifo_pop_front(mtdp_buffer_fifo* self, mtdp_buffer*);
 size_t mtdp_buffer_fifo_size(const mtdp_buffer_fifo* self);
 
+/**
+ * @brief Bounded lock-free single-producer/single-consumer ring of `mtdp_buffer`s.
+ *
+ * @details One slot is always left unused to tell a full ring from an empty one,
+ * so a ring resized to hold N buffers owns N + 1 slots. The consumer owns `head`,
+ * the producer owns `tail`: each side keeps a cached copy of the other side's index
+ * and only reloads it (acquiring) when the cached value says the ring is empty/full.
+ * The two indices live on separate cache lines to avoid false sharing.
+ *
+ * Push may only be called from one thread and pop from one (possibly different) thread;
+ * resize, init and destroy are not thread-safe.
+ */
+typedef struct {
+#if MTDP_BUFFER_POOL_STATIC_SIZE
+    mtdp_buffer slots[MTDP_BUFFER_POOL_STATIC_SIZE + 1];
+#else
+    mtdp_buffer* slots;
+#endif
+    size_t  n_slots;
+    uint8_t slots_padding[MTDP_CACHE_LINE_SIZE];
+
+    atomic_size_t head;
+    size_t        cached_tail;
+    uint8_t       head_padding[MTDP_CACHE_LINE_SIZE - sizeof(atomic_size_t) - sizeof(size_t)];
+
+    atomic_size_t tail;
+    size_t        cached_head;
+    uint8_t       tail_padding[MTDP_CACHE_LINE_SIZE - sizeof(atomic_size_t) - sizeof(size_t)];
+} mtdp_buffer_ring;
+
+void   mtdp_buffer_ring_init(mtdp_buffer_ring* self);
+void   mtdp_buffer_ring_destroy(mtdp_buffer_ring* self);
+bool   mtdp_buffer_ring_resize(mtdp_buffer_ring* self, size_t capacity);
+bool   mtdp_buffer_ring_push(mtdp_buffer_ring* self, const mtdp_buffer);
+bool   mtdp_buffer_ring_pop(mtdp_buffer_ring* self, mtdp_buffer*);
+size_t mtdp_buffer_ring_size(const mtdp_buffer_ring* self);
+
+/**
+ * @brief Bounded lock-free multi-producer/multi-consumer queue of `mtdp_buffer`s.
+ *
+ * @details Every cell carries a sequence number telling whether it is ready to be written
+ * (it equals the enqueue position) or read (it equals the dequeue position + 1), so producers
+ * and consumers only contend on their own position with a single compare-and-swap, and never
+ * wait for each other unless the queue is full or empty. The number of cells is a power of two
+ * not smaller than the requested capacity.
+ *
+ * Push and pop may be called from any number of threads; resize, init and destroy are not thread-safe.
+ */
+typedef struct {
+#if MTDP_BUFFER_POOL_STATIC_SIZE
+    struct mtdp_buffer_mpmc_cell {
+        atomic_size_t sequence;
+        mtdp_buffer   buffer;
+    } cells[2 * MTDP_BUFFER_POOL_STATIC_SIZE];
+#else
+    struct mtdp_buffer_mpmc_cell {
+        atomic_size_t sequence;
+        mtdp_buffer   buffer;
+    }* cells;
+#endif
+    size_t  mask;
+    uint8_t cells_padding[MTDP_CACHE_LINE_SIZE];
+
+    atomic_size_t enqueue_pos;
+    uint8_t       enqueue_padding[MTDP_CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+
+    atomic_size_t dequeue_pos;
+    uint8_t       dequeue_padding[MTDP_CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+} mtdp_buffer_mpmc;
+
+void   mtdp_buffer_mpmc_init(mtdp_buffer_mpmc* self);
+void   mtdp_buffer_mpmc_destroy(mtdp_buffer_mpmc* self);
+bool   mtdp_buffer_mpmc_resize(mtdp_buffer_mpmc* self, size_t capacity);
+bool   mtdp_buffer_mpmc_push(mtdp_buffer_mpmc* self, const mtdp_buffer);
+bool   mtdp_buffer_mpmc_pop(mtdp_buffer_mpmc* self, mtdp_buffer*);
+size_t mtdp_buffer_mpmc_size(const mtdp_buffer_mpmc* self);
+
+/**
+ * @brief Window reordering `mtdp_buffer`s tagged with a sequence number.
+ *
+ * @details Buffers may be put in any order, each one with its own sequence number
+ * (or a skip mark for a sequence number producing no buffer), and are popped in sequence
+ * order starting from 0. The window is indexed by sequence modulo its capacity,
+ * a power of two, and it is grown on the heap when a sequence number falls beyond it.
+ *
+ * Not thread-safe.
+ */
+typedef struct {
+    struct mtdp_buffer_reorder_entry {
+        mtdp_buffer buffer;
+        uint8_t     state;
+    }* entries;
+    size_t capacity;
+    size_t next;
+} mtdp_buffer_reorder;
+
+void   mtdp_buffer_reorder_init(mtdp_buffer_reorder* self);
+void   mtdp_buffer_reorder_destroy(mtdp_buffer_reorder* self);
+bool   mtdp_buffer_reorder_put(mtdp_buffer_reorder* self, size_t seq, const mtdp_buffer);
+bool   mtdp_buffer_reorder_skip(mtdp_buffer_reorder* self, size_t seq);
+bool   mtdp_buffer_reorder_pop(mtdp_buffer_reorder* self, mtdp_buffer*);
+bool   mtdp_buffer_reorder_take_any(mtdp_buffer_reorder* self, mtdp_buffer*);
+void   mtdp_buffer_reorder_reset(mtdp_buffer_reorder* self);
+size_t mtdp_buffer_reorder_size(const mtdp_buffer_reorder* self);
+
 #endif
@@ -0,0 +1,117 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+mtdp is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+mtdp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef MTDP_IMPL_EXECUTOR_H
+#define MTDP_IMPL_EXECUTOR_H
+
+#include "atomic.h"
+#include "event.h"
+#include "impl/buffer.h"
+#include "memory.h"
+#include "mtdp/executor.h"
+#include "worker.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+    Runs the iterations of pooled workers (tasks) on a fixed number of threads.
+
+    Every thread owns a Chase-Lev deque of runnable tasks: it pops from the bottom of its own,
+    and steals from the top of the others' when it runs dry. Tasks are scheduled from outside
+    the executor, and requeued after running a batch of iterations, through an MPMC injection
+    queue, which every thread also checks first from time to time: the runnable tasks of all
+    the pipelines are thus served in round-robin. A task sits in at most one queue at a time,
+    so no queue ever holds more than the capacity of the executor.
+
+    The tasks of a pipeline form a set, grouped in levels, one per pipeline step: a task making
+    progress may have made room or data for its neighbors, so it schedules the tasks of the
+    previous and next level. A task making no progress is descheduled until one of its
+    neighbors schedules it again.
+*/
+
+struct mtdp_task_set;
+
+typedef struct {
+    mtdp_worker*          worker;
+    size_t                level;
+    atomic_uint32_t       state;
+    struct mtdp_task_set* set;
+} mtdp_task;
+
+typedef struct mtdp_task_set {
+    mtdp_task* tasks;
+    size_t     n_tasks;
+    size_t*    levels;
+    size_t     n_levels;
+    /* Tasks scheduled or running */
+    atomic_size_t active;
+} mtdp_task_set;
+
+typedef struct {
+    atomic_size_t* slots;
+    size_t         mask;
+    uint8_t        slots_padding[MTDP_CACHE_LINE_SIZE];
+
+    atomic_size_t top;
+    uint8_t       top_padding[MTDP_CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+
+    atomic_size_t bottom;
+    uint8_t       bottom_padding[MTDP_CACHE_LINE_SIZE - sizeof(atomic_size_t)];
+} mtdp_task_deque;
+
+typedef struct {
+    mtdp_worker           worker;
+    mtdp_task_deque       deque;
+    struct mtdp_executor* executor;
+    size_t                victim;
+    uint32_t              ticks;
+} mtdp_executor_thread;
+
+struct mtdp_executor {
+    mtdp_executor_thread* threads;
+    size_t                n_threads;
+    /* Tasks the queues may hold, and tasks of the attached sets */
+    size_t           capacity;
+    atomic_size_t    reserved;
+    mtdp_buffer_mpmc injected;
+    mtdp_event       event;
+    /* Signaled whenever the last active task of a set goes idle */
+    mtdp_event idle_event;
+};
+
+/* Starts n_threads threads, able to run capacity tasks */
+bool mtdp_executor_init(mtdp_executor*, size_t n_threads, size_t capacity);
+/* Joins the threads, once every set has been detached */
+void mtdp_executor_deinit(mtdp_executor*);
+
+/* Allocates room for n_tasks tasks, to be added in non-decreasing level order */
+bool mtdp_task_set_init(mtdp_task_set*, size_t n_tasks);
+void mtdp_task_set_add(mtdp_task_set*, mtdp_worker* worker, size_t level);
+void mtdp_task_set_destroy(mtdp_task_set*);
+
+/* True when no task of the set is scheduled or running: none of them can make progress without being scheduled again */
+#define mtdp_task_set_idle(set) (atomic_load(&(set)->active) == 0)
+
+/* Reserves room for the tasks of a set, once all of them have been added */
+bool mtdp_executor_attach(mtdp_executor*, mtdp_task_set*);
+/* Schedules every task of the set */
+void mtdp_executor_schedule_set(mtdp_executor*, mtdp_task_set*);
+/* Waits for the tasks of the set, whose workers shall be destroyed, to leave the queues */
+void mtdp_executor_detach(mtdp_executor*, mtdp_task_set*);
+
+MTDP_DECLARE_INSTANCE(mtdp_executor)
+
+#endif
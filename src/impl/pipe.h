@@ -16,6 +16,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #ifndef MTDP_IMPL_PIPE_H
 #define MTDP_IMPL_PIPE_H
 
+#include "event.h"
 #include "impl/buffer.h"
 #include "sem.h"
 #include "thread.h"
@@ -23,25 +24,228 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <stddef.h>
 #include <stdint.h>
 
+/**
+ * @brief Sequences of a pipe using the `MTDP_PIPE_TRANSPORT_RING` transport.
+ *
+ * @details The buffers of the pool are used in place as a circular array of slots:
+ * slot `i % n` is claimed by the producer, published once full, acquired by the consumer
+ * and finally released, after which the producer may claim it again. Every sequence only
+ * grows, and the atomic ones are the only state shared by the two sides, which keep
+ * a cached copy of the other side's sequence and reload it only when it seems to block them.
+ */
+typedef struct {
+    uint8_t padding[MTDP_CACHE_LINE_SIZE];
+
+    atomic_size_t published;
+    size_t        claimed;
+    size_t        cached_released;
+    uint8_t       producer_padding[MTDP_CACHE_LINE_SIZE - sizeof(atomic_size_t) - 2 * sizeof(size_t)];
+
+    atomic_size_t released;
+    size_t        acquired;
+    size_t        cached_published;
+    uint8_t       consumer_padding[MTDP_CACHE_LINE_SIZE - sizeof(atomic_size_t) - 2 * sizeof(size_t)];
+} mtdp_pipe_sequences;
+
+/* References held on a buffer of a broadcasting pipe by its consumer and by the branches */
+typedef struct {
+    mtdp_buffer     buffer;
+    atomic_uint32_t count;
+} mtdp_pipe_ref;
+
+/* Pipe a buffer merged into another pipe is put back to */
+typedef struct {
+    mtdp_buffer       buffer;
+    struct mtdp_pipe* pipe;
+} mtdp_pipe_origin;
+
+/* State of a pipe merging inputs (or configured to), allocated along with its first input or its policy */
+typedef struct {
+    /* Pipes the buffers of the pipe and of its inputs are put back to, sorted by buffer */
+    mtdp_pipe_origin*      origins;
+    size_t                 n_origins;
+    mtdp_pipe_merge_policy policy;
+    mtdp_pipe_sequence_fn  sequence;
+    /* Next input served in round-robin */
+    size_t cursor;
+    /*
+        Sequence: the oldest full buffer of every side (the pipe itself, then each input) not pulled yet,
+        and the one with the smallest sequence number, to be pulled next.
+    */
+    mtdp_buffer* heads;
+    mtdp_buffer  next;
+} mtdp_pipe_merger;
+
+/*
+    State of a pipe joining its buffers (side 0) with those of its single input (side 1), allocated while
+    a join mode is set: the buffers waiting for a match, oldest first, and the pair to be pulled next.
+*/
+typedef struct {
+    mtdp_pipe_join_mode mode;
+    mtdp_stage_key_fn   key;
+    size_t              tolerance, window;
+    mtdp_buffer*        pending[2];
+    size_t              size[2], capacity[2];
+    mtdp_buffer         next[2];
+} mtdp_pipe_joiner;
+
 struct mtdp_pipe {
     mtx_t pool_mutex;
     mtx_t fifo_mutex;
 
-    size_t           total_buffers;
-    mtdp_buffer_pool pool;
-    mtdp_buffer_fifo fifo;
+    mtdp_pipe_transport transport;
+    size_t              total_buffers;
+    mtdp_buffer_pool    pool;
+    mtdp_buffer_fifo    fifo;
+    mtdp_buffer_ring    ring;
+    /* Empty buffers handed back by the consumer, only used by lock-free transports */
+    mtdp_buffer_ring returns;
+    /* Only used by the ring transport, whose slots are the pool buffers */
+    mtdp_pipe_sequences seq;
+    /* Only used by the MPMC transport: full buffers and, while enabled, the whole empty pool */
+    mtdp_buffer_mpmc queue;
+    mtdp_buffer_mpmc empties;
+
+    /* Sequence number of the next full buffer to be pulled */
+    size_t pulls;
+    /* Full buffers pushed out of order by the replicas of an ordered stage */
+    mtdp_buffer_reorder reorder;
+    /* Number of threads pushing into and pulling from the pipe */
+    size_t n_producers, n_consumers;
+    /* Set when both ends are run by the same worker, as fused stages are: neither locks nor wakeups are used */
+    bool local;
+    /*
+        End of stream: producers that will push nothing more, and sides (the pipe itself, then each input)
+        whose producers all ended. Once all sides have, every consumer gets a token with no buffer behind it.
+    */
+    atomic_size_t n_ended, ended_sides;
+    /* Buffers pushed to and pulled from the transport so far, for the flushes */
+    atomic_size_t n_pushed, n_pulled;
+
+    /*
+        Broadcast: every buffer pushed is also pushed on the first pipe of each branch, and it goes back
+        to the pool once put back by all of them and by the consumer. References are sorted by buffer.
+    */
+    struct mtdp_pipe** branches;
+    size_t             n_branches;
+    mtdp_pipe_ref*     refs;
+    size_t             n_refs;
+    /* Only set on the pipes owning no buffers (branches, partitions): the pipe they are put back to */
+    struct mtdp_pipe* upstream;
+
+    /*
+        Merge: the consumer also pulls the full buffers of the last pipe of other pipelines (inputs).
+        The state of the merge, and of the join if any, is only allocated for the pipes configured so.
+    */
+    struct mtdp_pipe** inputs;
+    size_t             n_inputs;
+    mtdp_pipe_merger*  merger;
+    mtdp_pipe_joiner*  joiner;
+    /* Only set on the last pipe of an input: the pipe merging it, whose semaphore counts its full buffers */
+    struct mtdp_pipe* merge;
+
+    /*
+        Partitions: every buffer pushed is routed by a hash of its key to one of the private pipes
+        pulled by the replicas of a stage, and it is put back here.
+    */
+    struct mtdp_pipe* partitions;
+    size_t            n_partitions;
+    mtdp_stage_key_fn partition_key;
 
     mtdp_semaphore semaphore;
+    /* Signaled when a buffer is put back, for the producers waiting on an empty pool */
+    mtdp_event pool_event;
+    /* Signaled when a consumer lets go of a buffer pulled from the pipe, for the flushes */
+    mtdp_event flush_event;
 };
 
+/* Whether the consumer of the pipe pulls the buffers of its sides by sequence number */
+#define mtdp_pipe_sequenced(pipe) ((pipe)->n_inputs && (pipe)->merger->policy == MTDP_PIPE_MERGE_SEQUENCE)
+
+/* Semaphore released for every full buffer pushed, shared with the pipe merging it, if any */
+#define mtdp_pipe_full_semaphore(pipe) ((pipe)->merge ? &(pipe)->merge->semaphore : &(pipe)->semaphore)
+
+/* Signals n full buffers pushed to the pipe, unless it is partitioned: routing a buffer signals its partition */
+static inline void
+mtdp_pipe_signal_full(struct mtdp_pipe* pipe, uint32_t n)
+{
+    if(!pipe->n_partitions) {
+        mtdp_semaphore_release(mtdp_pipe_full_semaphore(pipe), n);
+    }
+}
+
+/*
+    Consumers count their cycles for the flushes: the count is odd from the moment they claim a full buffer
+    until they let go of it, once put back and its outputs pushed. Letting go wakes the flushes waiting on
+    the pipe pulled: by then the count of buffers pulled from it has moved too.
+*/
+static inline void
+mtdp_pipe_hold(atomic_uint32_t* cycles)
+{
+    atomic_store(cycles, atomic_load_explicit(cycles, memory_order_relaxed) + 1);
+}
+
+static inline void
+mtdp_pipe_let_go(struct mtdp_pipe* pipe, atomic_uint32_t* cycles)
+{
+    uint32_t cycle = atomic_load_explicit(cycles, memory_order_relaxed);
+
+    if(cycle & 1) {
+        atomic_store_explicit(cycles, cycle + 1, memory_order_release);
+        mtdp_event_notify(&pipe->flush_event);
+    }
+}
+
 bool mtdp_pipe_init(mtdp_pipe*);
 void mtdp_pipe_destroy(mtdp_pipe*);
 void mtdp_pipe_clear(mtdp_pipe*);
+/* Resets the broadcast references and the merge origins, before any pipe of the linked pipelines is handed over */
+bool mtdp_pipe_prepare(mtdp_pipe*);
+/* Hands the empty pool over to the transport, once prepared */
+void mtdp_pipe_hand_over(mtdp_pipe*);
+
+/* Broadcasts the buffers of the pipe to the first pipe of a branch as well, while not enabled */
+bool mtdp_pipe_add_branch(mtdp_pipe*, mtdp_pipe* branch);
+void mtdp_pipe_remove_branch(mtdp_pipe*, mtdp_pipe* branch);
+
+/* Merges the full buffers of the last pipe of another pipeline into the pipe, while not enabled */
+bool mtdp_pipe_add_input(mtdp_pipe*, mtdp_pipe* input);
+void mtdp_pipe_remove_input(mtdp_pipe*, mtdp_pipe* input);
+
+/* Routes the full buffers of the pipe to n private partitions by the key read from them, while not enabled */
+bool mtdp_pipe_partition(mtdp_pipe*, size_t n, mtdp_stage_key_fn key);
+void mtdp_pipe_unpartition(mtdp_pipe*);
 
 mtdp_buffer mtdp_pipe_get_empty_buffer(mtdp_pipe*);
 bool        mtdp_pipe_push_buffer(mtdp_pipe*, mtdp_buffer);
 mtdp_buffer mtdp_pipe_get_full_buffer(mtdp_pipe*);
 bool        mtdp_pipe_put_back(mtdp_pipe*, mtdp_buffer);
+/* Gives back an empty buffer taken by the producer and not pushed, from the producer side */
+bool mtdp_pipe_unclaim(mtdp_pipe*, mtdp_buffer);
+
+/* Whether no full buffer is left to be pulled, only meaningful while neither end of the pipe moves */
+bool mtdp_pipe_drained(mtdp_pipe*);
+
+/* Signals that a producer of the pipe will push nothing more, to be called once by each of them */
+void mtdp_pipe_end(mtdp_pipe*);
+/* Whether every producer of the pipe and of its inputs ended and no full buffer is left to be pulled */
+bool mtdp_pipe_ended(mtdp_pipe*);
+
+/* Takes the buffer joined with the one just pulled from a joining pipe, NULL for other pipes */
+mtdp_buffer mtdp_pipe_take_joined(mtdp_pipe*);
+
+/* As mtdp_pipe_get_full_buffer, also returning the sequence number of the buffer */
+mtdp_buffer mtdp_pipe_get_full_buffer_seq(mtdp_pipe*, size_t* seq);
+/*
+    Pushes the buffer with sequence number seq (or skips seq if the buffer is NULL),
+    making available the buffers following in sequence. Locked transport only.
+*/
+bool mtdp_pipe_push_buffer_ordered(mtdp_pipe*, mtdp_buffer, size_t seq, size_t* n_pushed);
+
+/* Waits according to the policy for a full buffer to be available, claiming it on success. 0 us and local pipes poll once. */
+bool mtdp_pipe_wait_full(mtdp_pipe*, mtdp_wait_policy, uint64_t microseconds);
+/* Waits according to the policy for an empty buffer to be put back, NULL on timeout. 0 us and local pipes poll once. */
+mtdp_buffer mtdp_pipe_wait_empty_buffer(mtdp_pipe*, mtdp_wait_policy, uint64_t microseconds);
 
 #if MTDP_PIPE_VECTOR_STATIC_SIZE
 typedef mtdp_pipe mtdp_pipe_vector[MTDP_PIPE_VECTOR_STATIC_SIZE];
@@ -18,6 +18,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include "atomic.h"
 #include "impl/errno.h"
+#include "impl/executor.h"
 #include "impl/pipe.h"
 #include "impl/sink.h"
 #include "impl/source.h"
@@ -37,6 +38,39 @@ struct mtdp_pipeline {
     mtdp_stage_vector stages;
     mtdp_pipe_vector  pipes;
 
+    /* Replicas past the first one of every stage, only allocated while enabled */
+    mtdp_stage_impl_vector replica_impls;
+    size_t                 n_replica_impls;
+
+    /* Executor running the tasks while enabled instead of a thread per stage, NULL otherwise */
+    mtdp_executor* executor;
+    mtdp_task_set  tasks;
+    /* Shared executor from the parameters, or own one with executor_threads threads */
+    mtdp_executor* shared_executor;
+    mtdp_executor  own_executor;
+    size_t         executor_threads;
+
+    /* Linked pipelines, run along with this one: those its pipes broadcast to, and those merged into them */
+    struct mtdp_pipeline** branches;
+    size_t                 n_branches;
+    struct mtdp_pipeline** inputs;
+    size_t                 n_inputs;
+    /* The pipeline broadcasting to the first pipe, and the one the last pipe is merged into, if any */
+    struct mtdp_pipeline* trunk;
+    struct mtdp_pipeline* merge;
+    /* Pipelines run in place of some of the stages, and the one this pipeline runs a stage of, if any */
+    struct mtdp_pipeline** nested;
+    size_t                 n_nested;
+    struct mtdp_pipeline*  outer;
+    size_t                 outer_stage;
+    /* The pipeline pulling from the last pipe, and the one whose last pipe the first stage pulls from, if any */
+    struct mtdp_pipeline* next;
+    struct mtdp_pipeline* previous;
+    /* Last walk through the linked pipelines having visited this one */
+    atomic_uint32_t visit;
+    /* Last flush having gone through this pipeline */
+    uint32_t flush;
+
     size_t          n_stages;
     bool            enabled, active;
     atomic_uint32_t destroying;
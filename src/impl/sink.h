@@ -30,6 +30,8 @@ typedef struct {
     mtdp_pipe*        input_pipe;
     mtdp_futex        done;
     bool              initialized;
+    /* Odd while the sink holds an input buffer, see mtdp_pipe_hold */
+    atomic_uint32_t cycles;
 } mtdp_sink_impl;
 
 void mtdp_sink_create_thread(mtdp_sink_impl*);
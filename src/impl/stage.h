@@ -23,7 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include <stdbool.h>
 
-typedef struct {
+typedef struct mtdp_stage_impl {
     mtdp_stage_context context;
     mtdp_worker        worker;
     mtdp_stage*        user_data;
@@ -31,11 +31,37 @@ typedef struct {
     mtdp_pipe*         output_pipe;
     mtdp_futex         done;
     bool               initialized;
+    /* Set once the input pipe ended and the stage ended its output pipe in turn */
+    bool ended;
+    /* Odd while the stage holds an input buffer, see mtdp_pipe_hold */
+    atomic_uint32_t cycles;
+
+    /* Callback run by this stage (or replica), replaced between two input buffers while a swap is pending */
+    mtdp_stage_callback process;
+    mtdp_stage_callback swap_process;
+    mtdp_stage_data     swap_self;
+    mtdp_futex          swapping;
+
+    /* Reassembly of the replicated stages: sequence numbers of the buffers held */
+    bool   ordered, output_tagged;
+    size_t input_seq, output_seq;
+
+    /* Fusion: first stage of the group running this one on its worker, and next stage of the group */
+    struct mtdp_stage_impl* fused_into;
+    struct mtdp_stage_impl* fused_next;
 } mtdp_stage_impl;
 
 void mtdp_stage_create_thread(mtdp_stage_impl*);
 void mtdp_stage_destroy(mtdp_stage_impl*);
 void mtdp_stage_configure(mtdp_stage_impl*, mtdp_pipe* input_pipe, mtdp_pipe* output_pipe, mtdp_stage* user_data);
+void mtdp_stage_replicate(mtdp_stage_impl*, const mtdp_stage_impl* primary);
+/* Asks the running stage to switch to another callback and user data before pulling its next input */
+void mtdp_stage_request_swap(mtdp_stage_impl*, mtdp_stage_callback process, mtdp_stage_data self);
+/* Waits for the stage to acknowledge the swap requested */
+void mtdp_stage_wait_swap(mtdp_stage_impl*);
+/* Appends the stage to the group of head, bypassing its input pipe */
+void mtdp_stage_fuse(mtdp_stage_impl*, mtdp_stage_impl* head);
+void mtdp_stage_unfuse(mtdp_stage_impl*);
 
 #if MTDP_STAGE_VECTOR_STATIC_SIZE
 typedef mtdp_stage mtdp_stage_vector[MTDP_STAGE_VECTOR_STATIC_SIZE];
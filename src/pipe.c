@@ -14,6 +14,8 @@ You should have received a copy of the GNU Lesser General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 
 // clang-format off
 #include "mtdp.h"
@@ -24,6 +26,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "api.h"
 #include "memory.h"
 #include "thread.h"
+#include "wait.h"
 
 inline static void
 mtdp_lock2(mtx_t* __restrict m1, mtx_t* __restrict m2)
@@ -43,12 +46,249 @@ mtdp_lock2(mtx_t* __restrict m1, mtx_t* __restrict m2)
     }
 }
 
+/* Locks of the locked transport, skipped on local pipes */
+inline static void
+mtdp_pipe_lock(mtdp_pipe* pipe, mtx_t* m)
+{
+    if(!pipe->local) {
+        mtx_lock(m);
+    }
+}
+
+inline static void
+mtdp_pipe_unlock(mtdp_pipe* pipe, mtx_t* m)
+{
+    if(!pipe->local) {
+        mtx_unlock(m);
+    }
+}
+
+/* Counts a buffer through one end of the transport: that end is only shared, without a lock, by the MPMC one */
+inline static void
+mtdp_pipe_count(const mtdp_pipe* pipe, atomic_size_t* counter)
+{
+    if(pipe->transport == MTDP_PIPE_TRANSPORT_MPMC) {
+        atomic_fetch_add_size(counter, 1);
+    }
+    else {
+        atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_release);
+    }
+}
+
 MTDP_API_INTERNAL mtdp_pipe*
 mtdp_pipe_next(mtdp_pipe* pipe)
 {
     return pipe + 1;
 }
 
+/*
+    With a lock-free transport the pool is private to the producer:
+    the consumer hands the empty buffers back through the returns ring.
+    Only to be called by the producer, or while the pipeline is not enabled.
+*/
+inline static void
+mtdp_pipe_reclaim_returns(mtdp_pipe* pipe)
+{
+    mtdp_buffer tmp;
+
+    while(mtdp_buffer_ring_pop(&pipe->returns, &tmp)) {
+        /* The pool capacity always covers the total number of buffers. */
+        mtdp_buffer_pool_push_back(&pipe->pool, tmp);
+    }
+}
+
+/*
+    With the MPMC transport the empty buffers are moved to a queue shared by the producers
+    when the pipeline is enabled. Not thread-safe.
+*/
+inline static void
+mtdp_pipe_reclaim_empties(mtdp_pipe* pipe)
+{
+    mtdp_buffer tmp;
+
+    while(mtdp_buffer_mpmc_pop(&pipe->empties, &tmp)) {
+        mtdp_buffer_pool_push_back(&pipe->pool, tmp);
+    }
+}
+
+static int
+mtdp_pipe_ref_compare(const void* lhs, const void* rhs)
+{
+    /* Also used to compare a buffer with a reference, the buffer being its first field. */
+    uintptr_t l = (uintptr_t) * (const mtdp_buffer*)lhs, r = (uintptr_t) * (const mtdp_buffer*)rhs;
+    return (l > r) - (l < r);
+}
+
+inline static mtdp_pipe_ref*
+mtdp_pipe_find_ref(mtdp_pipe* pipe, mtdp_buffer buf)
+{
+    return (mtdp_pipe_ref*)bsearch(&buf, pipe->refs, pipe->n_refs, sizeof(mtdp_pipe_ref), mtdp_pipe_ref_compare);
+}
+
+/* Takes a reference for the consumer and one for each branch, before the buffer is pushed */
+inline static void
+mtdp_pipe_ref_all(mtdp_pipe* pipe, mtdp_buffer buf)
+{
+    mtdp_pipe_ref* ref = mtdp_pipe_find_ref(pipe, buf);
+
+    assert(ref);
+    atomic_store_explicit(&ref->count, (uint32_t)pipe->n_branches + 1, memory_order_release);
+}
+
+/* Pushes a buffer on the first pipe of every branch, once pushed for the consumer */
+static void
+mtdp_pipe_broadcast(mtdp_pipe* pipe, mtdp_buffer buf)
+{
+    for(size_t i = 0; i != pipe->n_branches; ++i) {
+        if(mtdp_pipe_push_buffer(pipe->branches[i], buf)) {
+            mtdp_pipe_signal_full(pipe->branches[i], 1);
+        }
+        else {
+            /* Skipped by this branch only. */
+            mtdp_pipe_put_back(pipe, buf);
+        }
+    }
+}
+
+/*
+    Drops a reference to a broadcast buffer, true if it was the last one. Empty buffers
+    put back by a producer without being pushed have none: nobody else may hold them.
+*/
+inline static bool
+mtdp_pipe_unref(mtdp_pipe* pipe, mtdp_buffer buf)
+{
+    mtdp_pipe_ref* ref = mtdp_pipe_find_ref(pipe, buf);
+    return !ref || atomic_load_explicit(&ref->count, memory_order_acquire) == 0 || atomic_fetch_sub(&ref->count, 1) == 1;
+}
+
+/* Pipe the buffer comes from, NULL for buffers of its own */
+inline static mtdp_pipe*
+mtdp_pipe_find_origin(mtdp_pipe* pipe, mtdp_buffer buf)
+{
+    mtdp_pipe_merger* merger = pipe->merger;
+    mtdp_pipe_origin* origin
+        = (mtdp_pipe_origin*)bsearch(&buf, merger->origins, merger->n_origins, sizeof(mtdp_pipe_origin), mtdp_pipe_ref_compare);
+    return origin && origin->pipe != pipe ? origin->pipe : NULL;
+}
+
+/*
+    Pushes a buffer on the partition chosen by its key, signaling it. The key is hashed
+    (Fibonacci hashing) so that keys only differing in their high bits are spread as well.
+*/
+static bool
+mtdp_pipe_route(mtdp_pipe* pipe, mtdp_buffer buf)
+{
+    uint64_t   hash      = (uint64_t)pipe->partition_key(buf) * UINT64_C(0x9E3779B97F4A7C15);
+    mtdp_pipe* partition = &pipe->partitions[(size_t)(hash >> 32) % pipe->n_partitions];
+
+    if(!mtdp_pipe_push_buffer(partition, buf)) {
+        return false;
+    }
+    mtdp_semaphore_release(&partition->semaphore, 1);
+    return true;
+}
+
+/* Reserves the memory required by a transport to hold n_buffers */
+inline static bool
+mtdp_pipe_resize_transport(mtdp_pipe* pipe, mtdp_pipe_transport transport, size_t n_buffers)
+{
+    switch(transport) {
+    case MTDP_PIPE_TRANSPORT_SPSC:
+        return mtdp_buffer_ring_resize(&pipe->ring, n_buffers) && mtdp_buffer_ring_resize(&pipe->returns, n_buffers);
+    case MTDP_PIPE_TRANSPORT_MPMC:
+        return mtdp_buffer_mpmc_resize(&pipe->queue, n_buffers) && mtdp_buffer_mpmc_resize(&pipe->empties, n_buffers);
+    default: return true;
+    }
+}
+
+inline static void
+mtdp_pipe_reverse_slots(mtdp_buffer* first, mtdp_buffer* last)
+{
+    mtdp_buffer tmp;
+
+    while(first < last && first < --last) {
+        tmp      = *first;
+        *first++ = *last;
+        *last    = tmp;
+    }
+}
+
+/*
+    Ring transport only, not thread-safe: rotates the slots so that the oldest
+    unreleased one comes first, and rebases the sequences on it.
+*/
+static void
+mtdp_pipe_linearize_slots(mtdp_pipe* pipe)
+{
+    mtdp_buffer* slots    = pipe->pool.buffers;
+    size_t       n        = mtdp_buffer_pool_size(&pipe->pool);
+    size_t       released = atomic_load_explicit(&pipe->seq.released, memory_order_relaxed);
+    size_t       first    = n ? released % n : 0;
+    size_t       published;
+
+    mtdp_pipe_reverse_slots(slots, slots + first);
+    mtdp_pipe_reverse_slots(slots + first, slots + n);
+    mtdp_pipe_reverse_slots(slots, slots + n);
+
+    published = atomic_load_explicit(&pipe->seq.published, memory_order_relaxed) - released;
+    atomic_store_explicit(&pipe->seq.published, published, memory_order_relaxed);
+    atomic_store_explicit(&pipe->seq.released, 0, memory_order_relaxed);
+    pipe->seq.claimed -= released;
+    pipe->seq.acquired -= released;
+    pipe->seq.cached_released  = 0;
+    pipe->seq.cached_published = published;
+}
+
+inline static void
+mtdp_pipe_reset_sequences(mtdp_pipe* pipe)
+{
+    atomic_store_explicit(&pipe->seq.published, 0, memory_order_relaxed);
+    atomic_store_explicit(&pipe->seq.released, 0, memory_order_relaxed);
+    pipe->seq.claimed = pipe->seq.acquired = pipe->seq.cached_released = pipe->seq.cached_published = 0;
+}
+
+/* Ring transport only, not thread-safe */
+static bool
+mtdp_pipe_resize_slots(mtdp_pipe* pipe, size_t n_buffers)
+{
+    mtdp_buffer* slots;
+    size_t       n, published, drop;
+
+    mtdp_pipe_linearize_slots(pipe);
+    slots     = pipe->pool.buffers;
+    n         = mtdp_buffer_pool_size(&pipe->pool);
+    published = atomic_load_explicit(&pipe->seq.published, memory_order_relaxed);
+    if(n_buffers < pipe->seq.claimed) {
+        /* Empty slots are removed first, then the oldest full ones not yet acquired by the consumer. */
+        drop = pipe->seq.claimed - n_buffers;
+        if(drop > published - pipe->seq.acquired) {
+            drop = published - pipe->seq.acquired;
+        }
+        memmove(slots + pipe->seq.acquired, slots + pipe->seq.acquired + drop, (n - pipe->seq.acquired - drop) * sizeof(mtdp_buffer));
+        published -= drop;
+        atomic_store_explicit(&pipe->seq.published, published, memory_order_relaxed);
+        pipe->seq.claimed -= drop;
+        pipe->seq.cached_published = published;
+        /* Buffers held by the stages are never dropped. */
+        if(n_buffers < pipe->seq.claimed) {
+            n_buffers = pipe->seq.claimed;
+        }
+    }
+    return mtdp_buffer_pool_resize(&pipe->pool, n_buffers);
+}
+
+inline static size_t
+mtdp_pipe_full_buffers(const mtdp_pipe* pipe)
+{
+    switch(pipe->transport) {
+    case MTDP_PIPE_TRANSPORT_SPSC: return mtdp_buffer_ring_size(&pipe->ring);
+    case MTDP_PIPE_TRANSPORT_MPMC: return mtdp_buffer_mpmc_size(&pipe->queue);
+    case MTDP_PIPE_TRANSPORT_RING:
+        return atomic_load_explicit(&pipe->seq.published, memory_order_acquire) - pipe->seq.acquired;
+    default: return mtdp_buffer_fifo_size(&pipe->fifo);
+    }
+}
+
 /* Always called in an assertion: effectively removed in release builds */
 inline static bool
 mtdp_pipe_check_invariants(mtdp_pipe* pipe)
@@ -56,13 +296,21 @@ mtdp_pipe_check_invariants(mtdp_pipe* pipe)
     bool   out;
     size_t total;
 
+    if(pipe->transport != MTDP_PIPE_TRANSPORT_LOCKED) {
+        /* Lock-free transports cannot be sampled consistently from the outside. */
+        return true;
+    }
+    if(pipe->n_branches || pipe->upstream || pipe->n_inputs || pipe->merge || pipe->n_partitions) {
+        /* Broadcast, merged and partitioned buffers may be held by other pipes. */
+        return true;
+    }
     mtdp_lock2(&pipe->pool_mutex, &pipe->fifo_mutex);
-    total = pipe->fifo.size + pipe->pool.size;
+    total = pipe->fifo.size + pipe->pool.size + mtdp_buffer_reorder_size(&pipe->reorder);
     /* 
         The following expression also accounts for input/output stages
-        holding memory during the pipe operations.
+        holding memory during the pipe operations, one buffer per thread.
     */
-    out = pipe->total_buffers == total || pipe->total_buffers == total + 1 || pipe->total_buffers == total + 2;
+    out = pipe->total_buffers >= total && pipe->total_buffers - total <= pipe->n_producers + pipe->n_consumers;
     mtx_unlock(&pipe->pool_mutex);
     mtx_unlock(&pipe->fifo_mutex);
 
@@ -79,12 +327,31 @@ mtdp_pipe_resize(mtdp_pipe* self, size_t n_buffers)
     *mtdp_errno_ptr_mutable() = self ? MTDP_OK : MTDP_BAD_PTR;
     if(self) {
         mtdp_lock2(&self->pool_mutex, &self->fifo_mutex);
+        if(self->transport == MTDP_PIPE_TRANSPORT_RING) {
+            if(mtdp_pipe_resize_slots(self, n_buffers)) {
+                ret = self->pool.buffers;
+            }
+            else {
+                *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+                ret                       = NULL;
+            }
+            self->total_buffers = mtdp_buffer_pool_size(&self->pool);
+            mtx_unlock(&self->pool_mutex);
+            mtx_unlock(&self->fifo_mutex);
+            return ret;
+        }
+        mtdp_pipe_reclaim_returns(self);
+        mtdp_pipe_reclaim_empties(self);
         empty = mtdp_buffer_pool_size(&self->pool);
-        nonempty += mtdp_buffer_fifo_size(&self->fifo);
+        nonempty += mtdp_pipe_full_buffers(self);
         total = nonempty + empty;
         delta = (ptrdiff_t)((ptrdiff_t)n_buffers - (ptrdiff_t)total);
         if(delta > 0) {
-            if(!mtdp_buffer_pool_resize(&self->pool, empty + delta)) {
+            if(!mtdp_pipe_resize_transport(self, self->transport, n_buffers)) {
+                *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+                ret                       = NULL;
+            }
+            else if(!mtdp_buffer_pool_resize(&self->pool, empty + delta)) {
                 *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
                 ret                       = NULL;
             }
@@ -105,7 +372,15 @@ mtdp_pipe_resize(mtdp_pipe* self, size_t n_buffers)
                     /* Removing oldest entries from the ready deque. */
                     for(size_t i = total + delta; i--;) {
                         /* We are shrinking here so no check is required. */
-                        mtdp_buffer_fifo_pop_front(&self->fifo, NULL);
+                        if(self->transport == MTDP_PIPE_TRANSPORT_SPSC) {
+                            mtdp_buffer_ring_pop(&self->ring, NULL);
+                        }
+                        else if(self->transport == MTDP_PIPE_TRANSPORT_MPMC) {
+                            mtdp_buffer_mpmc_pop(&self->queue, NULL);
+                        }
+                        else {
+                            mtdp_buffer_fifo_pop_front(&self->fifo, NULL);
+                        }
                     }
                 }
             }
@@ -126,114 +401,1194 @@ mtdp_pipe_buffers(mtdp_pipe* self)
     return self ? self->pool.buffers : NULL;
 }
 
-void
-mtdp_pipe_clear(mtdp_pipe* self)
+/* Whether the pool of the pipe is only accessed under its lock, by stages of this pipe alone */
+#define mtdp_pipe_elastic(pipe)                                                                                                  \
+  ((pipe)->transport == MTDP_PIPE_TRANSPORT_LOCKED && !(pipe)->local && !(pipe)->n_branches && !(pipe)->upstream               \
+   && !(pipe)->merge)
+
+MTDP_API_INTERNAL bool
+mtdp_pipe_add_buffers(mtdp_pipe* self, const mtdp_buffer* buffers, size_t n)
 {
-    mtdp_buffer tmp;
+    size_t size;
+    bool   out;
 
-    if(self) {
-        assert(mtdp_pipe_check_invariants(self));
+    if(!self || (n && !buffers)) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(!mtdp_pipe_elastic(self)) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    /* Both locks, as the invariants check samples the total along with the pool and the fifo. */
+    mtdp_lock2(&self->pool_mutex, &self->fifo_mutex);
+    size = mtdp_buffer_pool_size(&self->pool);
+    if((out = mtdp_buffer_pool_resize(&self->pool, size + n))) {
+        memcpy(self->pool.buffers + size, buffers, n * sizeof(mtdp_buffer));
+        self->total_buffers += n;
+    }
+    mtx_unlock(&self->pool_mutex);
+    mtx_unlock(&self->fifo_mutex);
+    if(out) {
+        mtdp_event_notify(&self->pool_event);
+    }
+    *mtdp_errno_ptr_mutable() = out ? MTDP_OK : MTDP_NO_MEM;
+    return out;
+}
 
-        mtdp_lock2(&self->pool_mutex, &self->fifo_mutex);
-        for(size_t i = mtdp_buffer_fifo_size(&self->fifo); i--;) {
-            mtdp_buffer_fifo_pop_front(&self->fifo, &tmp);
-            mtdp_buffer_pool_push_back(&self->pool, tmp);
-        }
-        mtx_unlock(&self->pool_mutex);
-        mtx_unlock(&self->fifo_mutex);
-        assert(mtdp_pipe_check_invariants(self));
+MTDP_API_INTERNAL size_t
+mtdp_pipe_remove_buffers(mtdp_pipe* self, mtdp_buffer* buffers, size_t n)
+{
+    size_t out = 0;
+
+    if(!self || (n && !buffers)) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return 0;
     }
+    if(!mtdp_pipe_elastic(self)) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return 0;
+    }
+    mtdp_lock2(&self->pool_mutex, &self->fifo_mutex);
+    /* Every producer and consumer may hold a buffer: with fewer of them, the pipe could be left stuck. */
+    while(out != n && self->total_buffers - out > self->n_producers + self->n_consumers
+          && (buffers[out] = mtdp_buffer_pool_pop_back(&self->pool))) {
+        ++out;
+    }
+    self->total_buffers -= out;
+    mtx_unlock(&self->pool_mutex);
+    mtx_unlock(&self->fifo_mutex);
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return out;
 }
 
-bool
-mtdp_pipe_init(mtdp_pipe* pipe)
+MTDP_API_INTERNAL bool
+mtdp_pipe_set_transport(mtdp_pipe* self, mtdp_pipe_transport transport)
 {
-    mtdp_buffer_pool_init(&pipe->pool);
-    if(mtx_init(&pipe->pool_mutex, mtx_plain) != thrd_success) {
+    mtdp_buffer tmp;
+
+    if(!self) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
         return false;
     }
-    if(mtx_init(&pipe->fifo_mutex, mtx_plain) != thrd_success) {
-        mtx_destroy(&pipe->pool_mutex);
+    if(!mtdp_pipe_resize_transport(self, transport, self->total_buffers)) {
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
         return false;
     }
-    if(!mtdp_buffer_fifo_init(&pipe->fifo)) {
-        mtx_destroy(&pipe->pool_mutex);
-        mtx_destroy(&pipe->fifo_mutex);
-        return false;
+    if((self->transport == MTDP_PIPE_TRANSPORT_RING) != (transport == MTDP_PIPE_TRANSPORT_RING)) {
+        /* The ring transport keeps the full buffers among the empty ones. */
+        mtdp_pipe_clear(self);
     }
-    bool ret = mtdp_semaphore_init(&pipe->semaphore);
-    if(!ret) {
-        mtx_destroy(&pipe->pool_mutex);
-        mtx_destroy(&pipe->fifo_mutex);
-        mtdp_buffer_fifo_destroy(&pipe->fifo);
-        return false;
+    else if(self->transport != transport) {
+        mtdp_pipe_reclaim_returns(self);
+        mtdp_pipe_reclaim_empties(self);
+        /* Full buffers left over by a resize are moved to the new transport through the fifo, oldest first. */
+        while(mtdp_buffer_ring_pop(&self->ring, &tmp) || mtdp_buffer_mpmc_pop(&self->queue, &tmp)) {
+            mtdp_buffer_fifo_push_back(&self->fifo, tmp);
+        }
+        if(transport == MTDP_PIPE_TRANSPORT_SPSC) {
+            while(mtdp_buffer_fifo_pop_front(&self->fifo, &tmp)) {
+                mtdp_buffer_ring_push(&self->ring, tmp);
+            }
+        }
+        else if(transport == MTDP_PIPE_TRANSPORT_MPMC) {
+            while(mtdp_buffer_fifo_pop_front(&self->fifo, &tmp)) {
+                mtdp_buffer_mpmc_push(&self->queue, tmp);
+            }
+        }
     }
+    self->transport           = transport;
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
     return true;
 }
 
-void
-mtdp_pipe_destroy(mtdp_pipe* pipe)
+/* Allocates the state of the merge of the pipe, with a round-robin policy, unless it has it already */
+static bool
+mtdp_pipe_make_merger(mtdp_pipe* self)
 {
-    mtx_destroy(&pipe->pool_mutex);
-    mtx_destroy(&pipe->fifo_mutex);
-    mtdp_buffer_pool_destroy(&pipe->pool);
-    mtdp_buffer_fifo_destroy(&pipe->fifo);
-    mtdp_semaphore_destroy(&pipe->semaphore);
+    if(!self->merger && (self->merger = (mtdp_pipe_merger*)calloc(1, sizeof(mtdp_pipe_merger)))) {
+        self->merger->policy = MTDP_PIPE_MERGE_ROUND_ROBIN;
+    }
+    return self->merger;
 }
 
-mtdp_buffer
-mtdp_pipe_get_empty_buffer(mtdp_pipe* self)
+static void
+mtdp_pipe_free_merger(mtdp_pipe* self)
 {
-    mtdp_buffer out;
+    if(self->merger) {
+        free(self->merger->origins);
+        free(self->merger->heads);
+        free(self->merger);
+        self->merger = NULL;
+    }
+}
 
-    assert(mtdp_pipe_check_invariants(self));
-    mtx_lock(&self->pool_mutex);
-    out = mtdp_buffer_pool_pop_back(&self->pool);
-    mtx_unlock(&self->pool_mutex);
+static void
+mtdp_pipe_free_joiner(mtdp_pipe* self)
+{
+    if(self->joiner) {
+        free(self->joiner->pending[0]);
+        free(self->joiner->pending[1]);
+        free(self->joiner);
+        self->joiner = NULL;
+    }
+}
 
-    assert(mtdp_pipe_check_invariants(self));
-    return out;
+/* Puts the merged buffers waiting for their turn back where they come from */
+static void
+mtdp_pipe_clear_merger(mtdp_pipe* self)
+{
+    mtdp_pipe_merger* merger = self->merger;
+
+    if(merger->next) {
+        mtdp_pipe_put_back(self, merger->next);
+        merger->next = NULL;
+    }
+    for(size_t i = 0; merger->heads && i != self->n_inputs + 1; ++i) {
+        if(merger->heads[i]) {
+            mtdp_pipe_put_back(self, merger->heads[i]);
+            merger->heads[i] = NULL;
+        }
+    }
+    merger->cursor = 0;
 }
 
-bool
-mtdp_pipe_push_buffer(mtdp_pipe* self, mtdp_buffer buf)
+/* Puts the buffers waiting for a match, and the pair not pulled yet, back where they come from */
+static void
+mtdp_pipe_clear_joiner(mtdp_pipe* self)
 {
-    bool out;
-    assert(mtdp_pipe_check_invariants(self));
+    mtdp_pipe_joiner* joiner = self->joiner;
 
-    mtx_lock(&self->fifo_mutex);
-    out = mtdp_buffer_fifo_push_back(&self->fifo, buf);
-    mtx_unlock(&self->fifo_mutex);
+    for(size_t side = 0; side != 2; ++side) {
+        if(joiner->next[side]) {
+            mtdp_pipe_put_back(self, joiner->next[side]);
+            joiner->next[side] = NULL;
+        }
+        while(joiner->size[side]) {
+            mtdp_pipe_put_back(self, joiner->pending[side][--joiner->size[side]]);
+        }
+    }
+}
 
-    assert(mtdp_pipe_check_invariants(self));
-    return out;
+/* Looks up the origins of the buffers of the pipe and of its inputs, and makes room for the heads of a sequence */
+static bool
+mtdp_pipe_prepare_merger(mtdp_pipe* self)
+{
+    mtdp_pipe_merger* merger    = self->merger;
+    size_t            n         = mtdp_buffer_pool_size(&self->pool);
+    size_t            n_origins = n;
+
+    free(merger->origins);
+    merger->origins   = NULL;
+    merger->n_origins = 0;
+    free(merger->heads);
+    merger->heads = NULL;
+    if(!self->n_inputs) {
+        return true;
+    }
+    /* The inputs are not handed over yet: the buffers of all of them are in their pools. */
+    for(size_t i = 0; i != self->n_inputs; ++i) {
+        n_origins += mtdp_buffer_pool_size(&self->inputs[i]->pool);
+    }
+    if(!(merger->origins = (mtdp_pipe_origin*)malloc(n_origins * sizeof(mtdp_pipe_origin)))) {
+        return false;
+    }
+    for(size_t i = 0; i != n; ++i) {
+        merger->origins[merger->n_origins].buffer = self->pool.buffers[i];
+        merger->origins[merger->n_origins++].pipe = self;
+    }
+    for(size_t i = 0; i != self->n_inputs; ++i) {
+        for(size_t j = 0; j != mtdp_buffer_pool_size(&self->inputs[i]->pool); ++j) {
+            merger->origins[merger->n_origins].buffer = self->inputs[i]->pool.buffers[j];
+            merger->origins[merger->n_origins++].pipe = self->inputs[i];
+        }
+    }
+    qsort(merger->origins, merger->n_origins, sizeof(mtdp_pipe_origin), mtdp_pipe_ref_compare);
+    if(merger->policy == MTDP_PIPE_MERGE_SEQUENCE) {
+        if(!(merger->heads = (mtdp_buffer*)calloc(self->n_inputs + 1, sizeof(mtdp_buffer)))) {
+            return false;
+        }
+    }
+    return true;
 }
 
-mtdp_buffer
-mtdp_pipe_get_full_buffer(mtdp_pipe* self)
+/* Sizes the windows of the join after the streams of both sides */
+static bool
+mtdp_pipe_prepare_joiner(mtdp_pipe* self)
 {
-    mtdp_buffer out = NULL;
-    assert(mtdp_pipe_check_invariants(self));
+    mtdp_pipe_joiner* joiner = self->joiner;
+    size_t            n_stream;
 
-    mtx_lock(&self->fifo_mutex);
-    mtdp_buffer_fifo_pop_front(&self->fifo, &out);
-    mtx_unlock(&self->fifo_mutex);
+    for(size_t side = 0; side != 2; ++side) {
+        free(joiner->pending[side]);
+        joiner->pending[side] = NULL;
+    }
+    if(!self->n_inputs) {
+        return true;
+    }
+    /*
+        A window never holds all the buffers of its stream: the producer always has one left to push.
+        A stream of a single buffer has no window at all, its unmatched buffer going back at once.
+    */
+    for(size_t side = 0; side != 2; ++side) {
+        n_stream               = mtdp_buffer_pool_size(side ? &self->inputs[0]->pool : &self->pool);
+        joiner->capacity[side] = n_stream && n_stream - 1 < joiner->window ? n_stream - 1 : joiner->window;
+        if(!(joiner->pending[side] = (mtdp_buffer*)malloc((joiner->capacity[side] + 1) * sizeof(mtdp_buffer)))) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    assert(mtdp_pipe_check_invariants(self));
-    return out;
+MTDP_API_INTERNAL bool
+mtdp_pipe_set_merge_policy(mtdp_pipe* self, mtdp_pipe_merge_policy policy, mtdp_pipe_sequence_fn sequence)
+{
+    if(!self) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(policy == MTDP_PIPE_MERGE_SEQUENCE && !sequence) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    if(!mtdp_pipe_make_merger(self)) {
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+        return false;
+    }
+    self->merger->policy      = policy;
+    self->merger->sequence    = sequence;
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
 }
 
-bool
-mtdp_pipe_put_back(mtdp_pipe* self, mtdp_buffer buf)
+MTDP_API_INTERNAL bool
+mtdp_pipe_set_join(mtdp_pipe* self, mtdp_pipe_join_mode mode, mtdp_stage_key_fn key, size_t tolerance, size_t window)
 {
-    bool out;
-    assert(mtdp_pipe_check_invariants(self));
+    if(!self) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(mode != MTDP_PIPE_JOIN_NONE && (!key || !window)) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    if(mode == MTDP_PIPE_JOIN_NONE) {
+        mtdp_pipe_free_joiner(self);
+    }
+    else {
+        if(!self->joiner && !(self->joiner = (mtdp_pipe_joiner*)calloc(1, sizeof(mtdp_pipe_joiner)))) {
+            *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+            return false;
+        }
+        self->joiner->mode      = mode;
+        self->joiner->key       = key;
+        self->joiner->tolerance = tolerance;
+        self->joiner->window    = window;
+    }
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
 
-    mtx_lock(&self->pool_mutex);
-    out = mtdp_buffer_pool_push_back(&self->pool, buf);
-    mtx_unlock(&self->pool_mutex);
+void
+mtdp_pipe_clear(mtdp_pipe* self)
+{
+    mtdp_buffer tmp;
 
-    assert(mtdp_pipe_check_invariants(self));
+    if(self) {
+        assert(mtdp_pipe_check_invariants(self));
+
+        for(size_t i = 0; i != self->n_partitions; ++i) {
+            mtdp_pipe_clear(&self->partitions[i]);
+        }
+        if(self->upstream) {
+            /* The buffers not pulled yet belong to the broadcasting (or partitioned) pipe. */
+            while((tmp = mtdp_pipe_get_full_buffer(self))) {
+                mtdp_pipe_put_back(self->upstream, tmp);
+            }
+            self->pulls = 0;
+            return;
+        }
+        /* Merged buffers waiting for their turn go back to their inputs. */
+        if(self->merger) {
+            mtdp_pipe_clear_merger(self);
+        }
+        if(self->joiner) {
+            mtdp_pipe_clear_joiner(self);
+        }
+        mtdp_lock2(&self->pool_mutex, &self->fifo_mutex);
+        for(size_t i = mtdp_buffer_fifo_size(&self->fifo); i--;) {
+            mtdp_buffer_fifo_pop_front(&self->fifo, &tmp);
+            mtdp_buffer_pool_push_back(&self->pool, tmp);
+        }
+        while(mtdp_buffer_ring_pop(&self->ring, &tmp) || mtdp_buffer_mpmc_pop(&self->queue, &tmp)) {
+            mtdp_buffer_pool_push_back(&self->pool, tmp);
+        }
+        while(mtdp_buffer_reorder_take_any(&self->reorder, &tmp)) {
+            mtdp_buffer_pool_push_back(&self->pool, tmp);
+        }
+        mtdp_buffer_reorder_reset(&self->reorder);
+        mtdp_pipe_reclaim_returns(self);
+        mtdp_pipe_reclaim_empties(self);
+        mtdp_pipe_reset_sequences(self);
+        self->pulls = 0;
+        mtx_unlock(&self->pool_mutex);
+        mtx_unlock(&self->fifo_mutex);
+        assert(mtdp_pipe_check_invariants(self));
+    }
+}
+
+bool
+mtdp_pipe_prepare(mtdp_pipe* self)
+{
+    size_t n = mtdp_buffer_pool_size(&self->pool);
+
+    /* A new stream begins: tokens left by the last one, whose buffers were cleared or end never pulled, would wake nobody. */
+    mtdp_semaphore_init(&self->semaphore);
+    atomic_store(&self->n_ended, 0);
+    atomic_store(&self->ended_sides, 0);
+    atomic_store(&self->n_pushed, 0);
+    atomic_store(&self->n_pulled, 0);
+    if(self->merger && !mtdp_pipe_prepare_merger(self)) {
+        return false;
+    }
+    if(self->joiner && !mtdp_pipe_prepare_joiner(self)) {
+        return false;
+    }
+    free(self->refs);
+    self->refs   = NULL;
+    self->n_refs = 0;
+    if(self->n_branches) {
+        /* The whole pool is empty: every buffer gets a reference count, looked up by address. */
+        if(!(self->refs = (mtdp_pipe_ref*)malloc(n * sizeof(mtdp_pipe_ref)))) {
+            return false;
+        }
+        for(size_t i = 0; i != n; ++i) {
+            self->refs[i].buffer = self->pool.buffers[i];
+        }
+        qsort(self->refs, n, sizeof(mtdp_pipe_ref), mtdp_pipe_ref_compare);
+        for(size_t i = 0; i != n; ++i) {
+            atomic_store(&self->refs[i].count, 0);
+        }
+        self->n_refs = n;
+        for(size_t i = 0; i != self->n_branches; ++i) {
+            if(!mtdp_pipe_resize_transport(self->branches[i], self->branches[i]->transport, self->total_buffers)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void
+mtdp_pipe_hand_over(mtdp_pipe* self)
+{
+    mtdp_buffer tmp;
+
+    if(self->transport == MTDP_PIPE_TRANSPORT_MPMC) {
+        /* The queue capacity always covers the total number of buffers. */
+        while((tmp = mtdp_buffer_pool_pop_back(&self->pool))) {
+            mtdp_buffer_mpmc_push(&self->empties, tmp);
+        }
+    }
+}
+
+bool
+mtdp_pipe_add_branch(mtdp_pipe* self, mtdp_pipe* branch)
+{
+    mtdp_pipe** branches = (mtdp_pipe**)realloc(self->branches, (self->n_branches + 1) * sizeof(mtdp_pipe*));
+
+    if(!branches) {
+        return false;
+    }
+    branches[self->n_branches++] = branch;
+    self->branches               = branches;
+    branch->upstream             = self;
+    return true;
+}
+
+void
+mtdp_pipe_remove_branch(mtdp_pipe* self, mtdp_pipe* branch)
+{
+    for(size_t i = 0; i != self->n_branches; ++i) {
+        if(self->branches[i] == branch) {
+            self->branches[i] = self->branches[--self->n_branches];
+            branch->upstream  = NULL;
+            break;
+        }
+    }
+}
+
+bool
+mtdp_pipe_add_input(mtdp_pipe* self, mtdp_pipe* input)
+{
+    mtdp_pipe** inputs;
+
+    if(!mtdp_pipe_make_merger(self)) {
+        return false;
+    }
+    if(!(inputs = (mtdp_pipe**)realloc(self->inputs, (self->n_inputs + 1) * sizeof(mtdp_pipe*)))) {
+        return false;
+    }
+    inputs[self->n_inputs++] = input;
+    self->inputs             = inputs;
+    input->merge             = self;
+    return true;
+}
+
+void
+mtdp_pipe_remove_input(mtdp_pipe* self, mtdp_pipe* input)
+{
+    /* The order of the inputs is kept, as it is the priority of the merge. */
+    for(size_t i = 0; i != self->n_inputs; ++i) {
+        if(self->inputs[i] == input) {
+            memmove(self->inputs + i, self->inputs + i + 1, (--self->n_inputs - i) * sizeof(mtdp_pipe*));
+            input->merge = NULL;
+            break;
+        }
+    }
+}
+
+bool
+mtdp_pipe_partition(mtdp_pipe* self, size_t n, mtdp_stage_key_fn key)
+{
+    if(!(self->partitions = (mtdp_pipe*)malloc(n * sizeof(mtdp_pipe)))) {
+        return false;
+    }
+    for(size_t i = 0; i != n; ++i) {
+        if(!mtdp_pipe_init(&self->partitions[i])) {
+            while(i--) {
+                mtdp_pipe_destroy(&self->partitions[i]);
+            }
+            free(self->partitions);
+            self->partitions = NULL;
+            return false;
+        }
+        /* Each partition has a single producer and a single consumer, but the lock is never contended. */
+        self->partitions[i].upstream = self;
+    }
+    self->n_partitions  = n;
+    self->partition_key = key;
+    return true;
+}
+
+void
+mtdp_pipe_unpartition(mtdp_pipe* self)
+{
+    for(size_t i = 0; i != self->n_partitions; ++i) {
+        mtdp_pipe_destroy(&self->partitions[i]);
+    }
+    free(self->partitions);
+    self->partitions    = NULL;
+    self->n_partitions  = 0;
+    self->partition_key = NULL;
+}
+
+bool
+mtdp_pipe_init(mtdp_pipe* pipe)
+{
+    pipe->transport     = MTDP_PIPE_TRANSPORT_LOCKED;
+    pipe->total_buffers = 0;
+    mtdp_buffer_pool_init(&pipe->pool);
+    mtdp_buffer_ring_init(&pipe->ring);
+    mtdp_buffer_ring_init(&pipe->returns);
+    mtdp_buffer_mpmc_init(&pipe->queue);
+    mtdp_buffer_mpmc_init(&pipe->empties);
+    mtdp_pipe_reset_sequences(pipe);
+    atomic_store(&pipe->n_ended, 0);
+    atomic_store(&pipe->ended_sides, 0);
+    atomic_store(&pipe->n_pushed, 0);
+    atomic_store(&pipe->n_pulled, 0);
+    mtdp_event_init(&pipe->pool_event);
+    mtdp_event_init(&pipe->flush_event);
+    mtdp_buffer_reorder_init(&pipe->reorder);
+    pipe->pulls       = 0;
+    pipe->n_producers = 1;
+    pipe->n_consumers = 1;
+    pipe->local       = false;
+    pipe->branches    = NULL;
+    pipe->n_branches  = 0;
+    pipe->refs        = NULL;
+    pipe->n_refs      = 0;
+    pipe->upstream    = NULL;
+    pipe->inputs        = NULL;
+    pipe->n_inputs      = 0;
+    pipe->merger        = NULL;
+    pipe->joiner        = NULL;
+    pipe->merge         = NULL;
+    pipe->partitions    = NULL;
+    pipe->n_partitions  = 0;
+    pipe->partition_key = NULL;
+    if(mtx_init(&pipe->pool_mutex, mtx_plain) != thrd_success) {
+        return false;
+    }
+    if(mtx_init(&pipe->fifo_mutex, mtx_plain) != thrd_success) {
+        mtx_destroy(&pipe->pool_mutex);
+        return false;
+    }
+    if(!mtdp_buffer_fifo_init(&pipe->fifo)) {
+        mtx_destroy(&pipe->pool_mutex);
+        mtx_destroy(&pipe->fifo_mutex);
+        return false;
+    }
+    bool ret = mtdp_semaphore_init(&pipe->semaphore);
+    if(!ret) {
+        mtx_destroy(&pipe->pool_mutex);
+        mtx_destroy(&pipe->fifo_mutex);
+        mtdp_buffer_fifo_destroy(&pipe->fifo);
+        return false;
+    }
+    return true;
+}
+
+void
+mtdp_pipe_destroy(mtdp_pipe* pipe)
+{
+    mtx_destroy(&pipe->pool_mutex);
+    mtx_destroy(&pipe->fifo_mutex);
+    mtdp_buffer_pool_destroy(&pipe->pool);
+    mtdp_buffer_fifo_destroy(&pipe->fifo);
+    mtdp_buffer_ring_destroy(&pipe->ring);
+    mtdp_buffer_ring_destroy(&pipe->returns);
+    mtdp_buffer_mpmc_destroy(&pipe->queue);
+    mtdp_buffer_mpmc_destroy(&pipe->empties);
+    mtdp_buffer_reorder_destroy(&pipe->reorder);
+    mtdp_semaphore_destroy(&pipe->semaphore);
+    free(pipe->branches);
+    free(pipe->refs);
+    free(pipe->inputs);
+    mtdp_pipe_free_merger(pipe);
+    mtdp_pipe_free_joiner(pipe);
+    mtdp_pipe_unpartition(pipe);
+}
+
+mtdp_buffer
+mtdp_pipe_get_empty_buffer(mtdp_pipe* self)
+{
+    mtdp_buffer out;
+    size_t      n;
+
+    assert(mtdp_pipe_check_invariants(self));
+    switch(self->transport) {
+    case MTDP_PIPE_TRANSPORT_SPSC:
+        /* Most recently returned buffers are reused first, as in the locked pool. */
+        if(!(out = mtdp_buffer_pool_pop_back(&self->pool))) {
+            mtdp_pipe_reclaim_returns(self);
+            out = mtdp_buffer_pool_pop_back(&self->pool);
+        }
+        break;
+    case MTDP_PIPE_TRANSPORT_RING:
+        n = mtdp_buffer_pool_size(&self->pool);
+        if(self->seq.claimed - self->seq.cached_released == n) {
+            self->seq.cached_released = atomic_load_explicit(&self->seq.released, memory_order_acquire);
+            if(self->seq.claimed - self->seq.cached_released == n) {
+                return NULL;
+            }
+        }
+        out = self->pool.buffers[self->seq.claimed++ % n];
+        break;
+    case MTDP_PIPE_TRANSPORT_MPMC:
+        if(!mtdp_buffer_mpmc_pop(&self->empties, &out)) {
+            out = NULL;
+        }
+        break;
+    default:
+        mtdp_pipe_lock(self, &self->pool_mutex);
+        out = mtdp_buffer_pool_pop_back(&self->pool);
+        mtdp_pipe_unlock(self, &self->pool_mutex);
+    }
+
+    assert(mtdp_pipe_check_invariants(self));
+    return out;
+}
+
+bool
+mtdp_pipe_push_buffer(mtdp_pipe* self, mtdp_buffer buf)
+{
+    bool   out;
+    size_t published;
+    assert(mtdp_pipe_check_invariants(self));
+
+    if(self->n_branches) {
+        mtdp_pipe_ref_all(self, buf);
+    }
+    if(self->n_partitions) {
+        /* The transport of the pipe is bypassed: the buffer only goes through its partition. */
+        out = mtdp_pipe_route(self, buf);
+    }
+    else {
+        switch(self->transport) {
+        case MTDP_PIPE_TRANSPORT_SPSC: out = mtdp_buffer_ring_push(&self->ring, buf); break;
+        case MTDP_PIPE_TRANSPORT_RING:
+            /* The buffer is already in its slot: publishing it is enough. */
+            published = atomic_load_explicit(&self->seq.published, memory_order_relaxed);
+            assert(buf == self->pool.buffers[published % mtdp_buffer_pool_size(&self->pool)]);
+            atomic_store_explicit(&self->seq.published, published + 1, memory_order_release);
+            out = true;
+            break;
+        case MTDP_PIPE_TRANSPORT_MPMC: out = mtdp_buffer_mpmc_push(&self->queue, buf); break;
+        default:
+            mtdp_pipe_lock(self, &self->fifo_mutex);
+            if((out = mtdp_buffer_fifo_push_back(&self->fifo, buf))) {
+                mtdp_pipe_count(self, &self->n_pushed);
+            }
+            mtdp_pipe_unlock(self, &self->fifo_mutex);
+        }
+        if(out && self->transport != MTDP_PIPE_TRANSPORT_LOCKED) {
+            mtdp_pipe_count(self, &self->n_pushed);
+        }
+    }
+    if(out && self->n_branches) {
+        mtdp_pipe_broadcast(self, buf);
+    }
+
+    assert(mtdp_pipe_check_invariants(self));
+    return out;
+}
+
+/* Pulls a full buffer from the transport of the pipe alone */
+static mtdp_buffer
+mtdp_pipe_pull(mtdp_pipe* self, size_t* seq)
+{
+    mtdp_buffer out = NULL;
+    assert(mtdp_pipe_check_invariants(self));
+
+    switch(self->transport) {
+    case MTDP_PIPE_TRANSPORT_SPSC:
+        if(mtdp_buffer_ring_pop(&self->ring, &out)) {
+            *seq = self->pulls++;
+        }
+        break;
+    case MTDP_PIPE_TRANSPORT_RING:
+        if(self->seq.acquired == self->seq.cached_published) {
+            self->seq.cached_published = atomic_load_explicit(&self->seq.published, memory_order_acquire);
+            if(self->seq.acquired == self->seq.cached_published) {
+                return NULL;
+            }
+        }
+        *seq = self->seq.acquired;
+        out  = self->pool.buffers[self->seq.acquired++ % mtdp_buffer_pool_size(&self->pool)];
+        break;
+    case MTDP_PIPE_TRANSPORT_MPMC:
+        /* Concurrent consumers cannot be sequenced: ordered stages do not pull from MPMC pipes. */
+        *seq = 0;
+        mtdp_buffer_mpmc_pop(&self->queue, &out);
+        break;
+    default:
+        mtdp_pipe_lock(self, &self->fifo_mutex);
+        if(mtdp_buffer_fifo_pop_front(&self->fifo, &out)) {
+            *seq = self->pulls++;
+            mtdp_pipe_count(self, &self->n_pulled);
+        }
+        mtdp_pipe_unlock(self, &self->fifo_mutex);
+    }
+    if(out && self->transport != MTDP_PIPE_TRANSPORT_LOCKED) {
+        mtdp_pipe_count(self, &self->n_pulled);
+    }
+
+    assert(mtdp_pipe_check_invariants(self));
+    return out;
+}
+
+/*
+    Pulls a full buffer from the pipe or one of its inputs, the first one found starting from
+    the input at index first (0 being the pipe itself). With a lock-free transport a buffer
+    may be missed while it is being pushed, in which case NULL is returned.
+*/
+static mtdp_buffer
+mtdp_pipe_pull_merged(mtdp_pipe* self, size_t first)
+{
+    mtdp_buffer out;
+    size_t      seq, n = self->n_inputs + 1, input;
+
+    for(size_t i = 0; i != n; ++i) {
+        input = (first + i) % n;
+        out   = mtdp_pipe_pull(input ? self->inputs[input - 1] : self, &seq);
+        if(out) {
+            self->merger->cursor = input + 1;
+            return out;
+        }
+    }
+    return NULL;
+}
+
+mtdp_buffer
+mtdp_pipe_get_full_buffer_seq(mtdp_pipe* self, size_t* seq)
+{
+    mtdp_buffer out;
+
+    if(!self->n_inputs) {
+        return mtdp_pipe_pull(self, seq);
+    }
+    if(self->joiner) {
+        out                   = self->joiner->next[0];
+        self->joiner->next[0] = NULL;
+        *seq                  = self->pulls++;
+        return out;
+    }
+    switch(self->merger->policy) {
+    case MTDP_PIPE_MERGE_SEQUENCE:
+        out                = self->merger->next;
+        self->merger->next = NULL;
+        break;
+    case MTDP_PIPE_MERGE_FIRST_AVAILABLE: out = mtdp_pipe_pull_merged(self, 0); break;
+    default: out = mtdp_pipe_pull_merged(self, self->merger->cursor);
+    }
+    /* The consumer of a merging pipe is never replicated: sequence numbers are only counted. */
+    *seq = self->pulls++;
+    return out;
+}
+
+bool
+mtdp_pipe_drained(mtdp_pipe* self)
+{
+    bool out;
+
+    mtx_lock(&self->fifo_mutex);
+    out = !mtdp_pipe_full_buffers(self) && !mtdp_buffer_reorder_size(&self->reorder);
+    mtx_unlock(&self->fifo_mutex);
+    /* The heads of a sequence are pulled from their sides, but not by the consumer yet. */
+    if(out && self->merger) {
+        out = !self->merger->next;
+        for(size_t i = 0; out && self->merger->heads && i != self->n_inputs + 1; ++i) {
+            out = !self->merger->heads[i];
+        }
+    }
+    return out;
+}
+
+/* Counts a side of a pipe (itself or one of its inputs) as ended, waking up its consumers once all of them are */
+static void
+mtdp_pipe_end_side(mtdp_pipe* self)
+{
+    bool sequence = mtdp_pipe_sequenced(self);
+
+    if(sequence) {
+        /* The consumer may be waiting for the head of the side: a token has it look at the sides again. */
+        mtdp_semaphore_release(&self->semaphore, 1);
+    }
+    if(atomic_fetch_add_size(&self->ended_sides, 1) != self->n_inputs) {
+        return;
+    }
+    if(self->n_partitions) {
+        for(size_t i = 0; i != self->n_partitions; ++i) {
+            mtdp_pipe_end(&self->partitions[i]);
+        }
+    }
+    else if(!self->local && !self->joiner && !sequence) {
+        /*
+            Joins wait for a buffer behind every token: their consumer only finds out on its next
+            timeout, as does the one polling a local pipe, which gets no wakeup anyway.
+        */
+        mtdp_semaphore_release(&self->semaphore, (uint32_t)self->n_consumers);
+    }
+}
+
+void
+mtdp_pipe_end(mtdp_pipe* self)
+{
+    if(atomic_fetch_add_size(&self->n_ended, 1) + 1 != self->n_producers) {
+        return;
+    }
+    for(size_t i = 0; i != self->n_branches; ++i) {
+        mtdp_pipe_end(self->branches[i]);
+    }
+    mtdp_pipe_end_side(self->merge ? self->merge : self);
+}
+
+bool
+mtdp_pipe_ended(mtdp_pipe* self)
+{
+    /* Nothing is pushed once all sides ended: the pipes are sampled after all the pushes. */
+    if(atomic_load(&self->ended_sides) <= self->n_inputs || !mtdp_pipe_drained(self)) {
+        return false;
+    }
+    for(size_t i = 0; i != self->n_inputs; ++i) {
+        if(!mtdp_pipe_drained(self->inputs[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+mtdp_buffer
+mtdp_pipe_take_joined(mtdp_pipe* self)
+{
+    mtdp_buffer out;
+
+    if(!self->joiner) {
+        return NULL;
+    }
+    out                   = self->joiner->next[1];
+    self->joiner->next[1] = NULL;
+    return out;
+}
+
+mtdp_buffer
+mtdp_pipe_get_full_buffer(mtdp_pipe* self)
+{
+    size_t seq;
+    return mtdp_pipe_get_full_buffer_seq(self, &seq);
+}
+
+bool
+mtdp_pipe_push_buffer_ordered(mtdp_pipe* self, mtdp_buffer buf, size_t seq, size_t* n_pushed)
+{
+    bool out;
+    assert(self->transport == MTDP_PIPE_TRANSPORT_LOCKED);
+
+    *n_pushed = 0;
+    mtx_lock(&self->fifo_mutex);
+    out = buf ? mtdp_buffer_reorder_put(&self->reorder, seq, buf) : mtdp_buffer_reorder_skip(&self->reorder, seq);
+    while(out && mtdp_buffer_reorder_pop(&self->reorder, &buf)) {
+        if(self->n_branches) {
+            mtdp_pipe_ref_all(self, buf);
+        }
+        if(!(self->n_partitions ? mtdp_pipe_route(self, buf) : mtdp_buffer_fifo_push_back(&self->fifo, buf))) {
+            /* Back in the window, to be flushed by the next push. */
+            --self->reorder.next;
+            mtdp_buffer_reorder_put(&self->reorder, self->reorder.next, buf);
+            break;
+        }
+        if(!self->n_partitions) {
+            mtdp_pipe_count(self, &self->n_pushed);
+        }
+        if(self->n_branches) {
+            mtdp_pipe_broadcast(self, buf);
+        }
+        ++*n_pushed;
+    }
+    mtx_unlock(&self->fifo_mutex);
+
+    return out;
+}
+
+bool
+mtdp_pipe_put_back(mtdp_pipe* self, mtdp_buffer buf)
+{
+    bool       out;
+    size_t     released;
+    mtdp_pipe* origin;
+    assert(mtdp_pipe_check_invariants(self));
+
+    if(self->upstream) {
+        return mtdp_pipe_put_back(self->upstream, buf);
+    }
+    if(self->n_inputs && (origin = mtdp_pipe_find_origin(self, buf))) {
+        return mtdp_pipe_put_back(origin, buf);
+    }
+    if(self->n_branches && !mtdp_pipe_unref(self, buf)) {
+        /* Still held by a branch, or by the consumer. */
+        return true;
+    }
+    switch(self->transport) {
+    case MTDP_PIPE_TRANSPORT_SPSC: out = mtdp_buffer_ring_push(&self->returns, buf); break;
+    case MTDP_PIPE_TRANSPORT_RING:
+        /* Slots are released by the consumer in the same order they were acquired: anything else would corrupt the ring. */
+        released = atomic_load_explicit(&self->seq.released, memory_order_relaxed);
+        out      = released != self->seq.acquired && buf == self->pool.buffers[released % mtdp_buffer_pool_size(&self->pool)];
+        assert(out && "ring slots are released in the order they were acquired");
+        if(out) {
+            atomic_store_explicit(&self->seq.released, released + 1, memory_order_release);
+        }
+        break;
+    case MTDP_PIPE_TRANSPORT_MPMC: out = mtdp_buffer_mpmc_push(&self->empties, buf); break;
+    default:
+        mtdp_pipe_lock(self, &self->pool_mutex);
+        out = mtdp_buffer_pool_push_back(&self->pool, buf);
+        mtdp_pipe_unlock(self, &self->pool_mutex);
+    }
+
+    if(!self->local) {
+        mtdp_event_notify(&self->pool_event);
+    }
+
+    assert(mtdp_pipe_check_invariants(self));
+    return out;
+}
+
+bool
+mtdp_pipe_unclaim(mtdp_pipe* self, mtdp_buffer buf)
+{
+    size_t n, published;
+    bool   out;
+
+    switch(self->transport) {
+    case MTDP_PIPE_TRANSPORT_SPSC:
+        /* The pool is private to the producer, while the return path only has room for the consumer. */
+        out = mtdp_buffer_pool_push_back(&self->pool, buf);
+        break;
+    case MTDP_PIPE_TRANSPORT_RING:
+        /* Only the slot claimed last may be given back, as long as it is not published. */
+        n         = mtdp_buffer_pool_size(&self->pool);
+        published = atomic_load_explicit(&self->seq.published, memory_order_relaxed);
+        out       = n && self->seq.claimed != published && buf == self->pool.buffers[(self->seq.claimed - 1) % n];
+        assert(out && "only the ring slot claimed last can be given back");
+        if(out) {
+            --self->seq.claimed;
+        }
+        break;
+    default: out = mtdp_pipe_put_back(self, buf);
+    }
+    return out;
+}
+
+/* Takes a full buffer token from the semaphore of the pipe */
+static bool
+mtdp_pipe_acquire_full(mtdp_pipe* self, mtdp_wait_policy policy, uint64_t microseconds)
+{
+    uint64_t deadline;
+
+    if(self->local) {
+        /* Nothing may be pushed while the consumer waits: the semaphore is not even used. */
+        return mtdp_buffer_fifo_size(&self->fifo) != 0;
+    }
+    if(!microseconds) {
+        return mtdp_semaphore_try_acquire(&self->semaphore);
+    }
+    switch(policy) {
+    case MTDP_WAIT_BLOCK: return mtdp_semaphore_try_acquire_for(&self->semaphore, microseconds);
+    case MTDP_WAIT_SPIN_THEN_PARK:
+        for(uint32_t i = MTDP_WAIT_SPIN_COUNT; i--; mtdp_cpu_relax()) {
+            if(mtdp_semaphore_try_acquire(&self->semaphore)) {
+                return true;
+            }
+        }
+        return mtdp_semaphore_try_acquire_for(&self->semaphore, microseconds);
+    default:
+        deadline = mtdp_semaphore_now_us() + microseconds;
+        do {
+            for(uint32_t i = MTDP_WAIT_POLLS_PER_CLOCK_READ; i--; mtdp_wait_relax(policy)) {
+                if(mtdp_semaphore_try_acquire(&self->semaphore)) {
+                    return true;
+                }
+            }
+        } while(mtdp_semaphore_now_us() < deadline);
+        return false;
+    }
+}
+
+/* Pulls the head of every side missing one, telling whether only the sides ended and drained are left without */
+static bool
+mtdp_pipe_pull_heads(mtdp_pipe* self)
+{
+    mtdp_buffer* heads = self->merger->heads;
+    mtdp_pipe*   side;
+    size_t       seq;
+    bool         out = true, ended;
+
+    for(size_t i = 0; i != self->n_inputs + 1; ++i) {
+        if(!heads[i]) {
+            side = i ? self->inputs[i - 1] : self;
+            /* Sampled before pulling: a side pushes all its buffers before it ends. */
+            ended    = atomic_load(&side->n_ended) == side->n_producers;
+            heads[i] = mtdp_pipe_pull(side, &seq);
+            out &= heads[i] || ended;
+        }
+    }
+    return out;
+}
+
+/* Takes the head with the smallest sequence number as the next buffer, false if none is left */
+static bool
+mtdp_pipe_take_head(mtdp_pipe* self)
+{
+    mtdp_pipe_merger* merger = self->merger;
+    mtdp_buffer*      heads  = merger->heads;
+    size_t            next   = 0;
+
+    for(size_t i = 1; i != self->n_inputs + 1; ++i) {
+        if(heads[i] && (!heads[next] || merger->sequence(heads[i]) < merger->sequence(heads[next]))) {
+            next = i;
+        }
+    }
+    if(!(merger->next = heads[next])) {
+        return false;
+    }
+    heads[next] = NULL;
+    /* The token of the buffer, unless still being released: left behind, it only has the next wait look again. */
+    mtdp_semaphore_try_acquire(&self->semaphore);
+    return true;
+}
+
+/* Waits for the count of the semaphore of the pipe to move from value, as it does on any push, end or park */
+static void
+mtdp_pipe_wait_released(mtdp_pipe* self, uint32_t value, mtdp_wait_policy policy, uint64_t microseconds)
+{
+    uint64_t deadline;
+
+    switch(policy) {
+    case MTDP_WAIT_SPIN_THEN_PARK:
+        for(uint32_t i = MTDP_WAIT_SPIN_COUNT; i--; mtdp_cpu_relax()) {
+            if(atomic_load(&self->semaphore.value) != value) {
+                return;
+            }
+        }
+        /* fall through */
+    case MTDP_WAIT_BLOCK: mtdp_semaphore_wait_released(&self->semaphore, value, microseconds); break;
+    default:
+        deadline = mtdp_semaphore_now_us() + microseconds;
+        do {
+            for(uint32_t i = MTDP_WAIT_POLLS_PER_CLOCK_READ; i--; mtdp_wait_relax(policy)) {
+                if(atomic_load(&self->semaphore.value) != value) {
+                    return;
+                }
+            }
+        } while(mtdp_semaphore_now_us() < deadline);
+    }
+}
+
+/*
+    Waits for the buffer with the smallest sequence number among the heads of all the sides, once every side
+    not ended has one: each side pushes its buffers in order, so none pushes a smaller one later. The semaphore
+    counts the buffers of all the sides, which it cannot tell apart: it is only used to wake the consumer up.
+*/
+static bool
+mtdp_pipe_wait_sequence(mtdp_pipe* self, mtdp_wait_policy policy, uint64_t microseconds)
+{
+    uint32_t value = atomic_load(&self->semaphore.value);
+
+    if(self->merger->next) {
+        return true;
+    }
+    if(!mtdp_pipe_pull_heads(self)) {
+        if(!microseconds) {
+            return false;
+        }
+        /* Still missing a head after a wakeup (maybe a park, or a push on a side with one): back to the consumer. */
+        mtdp_pipe_wait_released(self, value, policy, microseconds);
+        if(!mtdp_pipe_pull_heads(self)) {
+            return false;
+        }
+    }
+    return mtdp_pipe_take_head(self);
+}
+
+/* Drops the unmatched buffer at index i of a side of the join, putting it back in its pool */
+static void
+mtdp_pipe_join_expire(mtdp_pipe* self, size_t side, size_t i)
+{
+    mtdp_buffer* pending = self->joiner->pending[side];
+
+    mtdp_pipe_put_back(self, pending[i]);
+    memmove(pending + i, pending + i + 1, (--self->joiner->size[side] - i) * sizeof(mtdp_buffer));
+}
+
+/* Pairs a buffer just pulled from a side with the oldest buffer of the other side it matches, or holds it */
+static void
+mtdp_pipe_join(mtdp_pipe* self, mtdp_buffer buf, size_t side)
+{
+    mtdp_pipe_joiner* joiner  = self->joiner;
+    size_t            other   = !side, key = joiner->key(buf), other_key;
+    mtdp_buffer*      pending = joiner->pending[other];
+
+    for(size_t i = 0; i != joiner->size[other];) {
+        other_key = joiner->key(pending[i]);
+        if(joiner->mode == MTDP_PIPE_JOIN_TIMESTAMP && other_key + joiner->tolerance < key) {
+            /* Timestamps do not decrease: nothing this side pushes from now on matches it. */
+            mtdp_pipe_join_expire(self, other, i);
+            continue;
+        }
+        if(joiner->mode == MTDP_PIPE_JOIN_KEY ? key == other_key
+                                              : key <= other_key + joiner->tolerance && other_key <= key + joiner->tolerance) {
+            joiner->next[side]  = buf;
+            joiner->next[other] = pending[i];
+            memmove(pending + i, pending + i + 1, (--joiner->size[other] - i) * sizeof(mtdp_buffer));
+            return;
+        }
+        ++i;
+    }
+    joiner->pending[side][joiner->size[side]++] = buf;
+    if(joiner->size[side] > joiner->capacity[side]) {
+        mtdp_pipe_join_expire(self, side, 0);
+    }
+}
+
+/* Waits for a matched pair, pulling the full buffers of both sides in turn meanwhile */
+static bool
+mtdp_pipe_wait_join(mtdp_pipe* self, mtdp_wait_policy policy, uint64_t microseconds)
+{
+    mtdp_buffer buf;
+
+    while(!self->joiner->next[0]) {
+        if(!mtdp_pipe_acquire_full(self, policy, microseconds)) {
+            return false;
+        }
+        /* The semaphore counts the buffers of both sides: one of them is being pushed. */
+        while(!(buf = mtdp_pipe_pull_merged(self, self->merger->cursor))) {
+            thrd_yield();
+        }
+        mtdp_pipe_join(self, buf, mtdp_pipe_find_origin(self, buf) != NULL);
+    }
+    return true;
+}
+
+bool
+mtdp_pipe_wait_full(mtdp_pipe* self, mtdp_wait_policy policy, uint64_t microseconds)
+{
+    if(self->n_inputs) {
+        if(self->joiner) {
+            return mtdp_pipe_wait_join(self, policy, microseconds);
+        }
+        if(self->merger->policy == MTDP_PIPE_MERGE_SEQUENCE) {
+            return mtdp_pipe_wait_sequence(self, policy, microseconds);
+        }
+    }
+    return mtdp_pipe_acquire_full(self, policy, microseconds);
+}
+
+/* Parks the producer until a buffer is put back in the pool, or the timeout expires */
+static mtdp_buffer
+mtdp_pipe_park_for_empty_buffer(mtdp_pipe* self, uint64_t microseconds)
+{
+    mtdp_buffer out;
+    uint64_t    now, deadline = mtdp_semaphore_now_us() + microseconds;
+    uint32_t    key;
+
+    do {
+        key = mtdp_event_prepare(&self->pool_event);
+        if((out = mtdp_pipe_get_empty_buffer(self))) {
+            mtdp_event_cancel(&self->pool_event);
+            break;
+        }
+        if((now = mtdp_semaphore_now_us()) >= deadline) {
+            mtdp_event_cancel(&self->pool_event);
+            break;
+        }
+        mtdp_event_wait_for(&self->pool_event, key, deadline - now);
+    } while(!(out = mtdp_pipe_get_empty_buffer(self)));
+    return out;
+}
+
+mtdp_buffer
+mtdp_pipe_wait_empty_buffer(mtdp_pipe* self, mtdp_wait_policy policy, uint64_t microseconds)
+{
+    mtdp_buffer out = mtdp_pipe_get_empty_buffer(self);
+    uint64_t    deadline;
+
+    if(!out && microseconds && !self->local) {
+        switch(policy) {
+        case MTDP_WAIT_SPIN_THEN_PARK:
+            for(uint32_t i = MTDP_WAIT_SPIN_COUNT; !out && i--;) {
+                mtdp_cpu_relax();
+                out = mtdp_pipe_get_empty_buffer(self);
+            }
+            if(out) {
+                break;
+            }
+            /* fall through */
+        case MTDP_WAIT_BLOCK: out = mtdp_pipe_park_for_empty_buffer(self, microseconds); break;
+        default:
+            deadline = mtdp_semaphore_now_us() + microseconds;
+            do {
+                for(uint32_t i = MTDP_WAIT_POLLS_PER_CLOCK_READ; i--;) {
+                    mtdp_wait_relax(policy);
+                    if((out = mtdp_pipe_get_empty_buffer(self))) {
+                        return out;
+                    }
+                }
+            } while(mtdp_semaphore_now_us() < deadline);
+        }
+    }
     return out;
 }
 
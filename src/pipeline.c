@@ -23,6 +23,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "bell.h"
 #include "futex.h"
 #include "memory.h"
+#include "wait.h"
 
 #if MTDP_PIPELINE_STATIC_INSTANCES
 #  if MTDP_PIPELINE_STATIC_INSTANCES > 0
@@ -42,47 +43,821 @@ mtdp_pipeline_configure(mtdp_pipeline* pipeline)
         mtdp_stage_configure(&pipeline->stage_impls[i], &pipeline->pipes[i], &pipeline->pipes[i + 1], &pipeline->stages[i]);
     }
     mtdp_sink_configure(&pipeline->sink_impl, &pipeline->pipes[pipeline->n_stages]);
-    pipeline->enabled    = false;
-    pipeline->active     = false;
-    pipeline->destroying = 0;
+    pipeline->n_replica_impls = 0;
+    pipeline->branches        = NULL;
+    pipeline->n_branches      = 0;
+    pipeline->inputs          = NULL;
+    pipeline->n_inputs        = 0;
+    pipeline->trunk           = NULL;
+    pipeline->merge           = NULL;
+    pipeline->nested          = NULL;
+    pipeline->n_nested        = 0;
+    pipeline->outer           = NULL;
+    pipeline->outer_stage     = 0;
+    pipeline->next            = NULL;
+    pipeline->previous        = NULL;
+    pipeline->visit           = 0;
+    pipeline->flush           = 0;
+    pipeline->enabled         = false;
+    pipeline->active          = false;
+    pipeline->destroying      = 0;
+}
+
+/* Stage impls are indexed past n_stages to reach the replicas */
+static inline size_t
+mtdp_pipeline_n_stage_impls(const mtdp_pipeline* pipeline)
+{
+    return pipeline->n_stages + pipeline->n_replica_impls;
+}
+
+static inline mtdp_stage_impl*
+mtdp_pipeline_stage_impl(mtdp_pipeline* pipeline, size_t i)
+{
+    return i < pipeline->n_stages ? &pipeline->stage_impls[i] : &pipeline->replica_impls[i - pipeline->n_stages];
+}
+
+static inline size_t
+mtdp_pipeline_stage_replicas(const mtdp_pipeline* pipeline, size_t i)
+{
+    return pipeline->stages[i].replicas ? pipeline->stages[i].replicas : 1;
+}
+
+/* Reassembly needs the locked transport, while unordered replicas may also share MPMC pipes */
+static inline bool
+mtdp_pipeline_pipe_accepts_replicas(const mtdp_pipe* pipe, bool ordered)
+{
+    return pipe->transport == MTDP_PIPE_TRANSPORT_LOCKED || (!ordered && pipe->transport == MTDP_PIPE_TRANSPORT_MPMC);
+}
+
+static void
+mtdp_pipeline_unreplicate_stages(mtdp_pipeline* pipeline)
+{
+    if(pipeline->n_replica_impls) {
+        mtdp_stage_impl_vector_destroy(&pipeline->replica_impls);
+        pipeline->n_replica_impls = 0;
+    }
+    for(size_t i = 0; i != pipeline->n_stages; ++i) {
+        pipeline->stage_impls[i].ordered    = false;
+        pipeline->stage_impls[i].input_pipe = &pipeline->pipes[i];
+        pipeline->pipes[i].n_consumers      = 1;
+        pipeline->pipes[i + 1].n_producers  = 1;
+        mtdp_pipe_unpartition(&pipeline->pipes[i]);
+    }
+}
+
+/* Partitioned replicas pull from private pipes, whose buffers are put back to the shared one */
+static inline bool
+mtdp_pipeline_stage_partitioned(const mtdp_pipeline* pipeline, size_t i)
+{
+    return pipeline->stages[i].key && mtdp_pipeline_stage_replicas(pipeline, i) > 1;
+}
+
+static bool
+mtdp_pipeline_replicate_stages(mtdp_pipeline* pipeline)
+{
+    size_t           n_replica_impls = 0, replicas;
+    bool             ordered;
+    mtdp_stage_impl* replica;
+
+    for(size_t i = 0; i != pipeline->n_stages; ++i) {
+        replicas = mtdp_pipeline_stage_replicas(pipeline, i);
+        ordered  = !pipeline->stages[i].unordered && !pipeline->stages[i].key;
+        if(replicas > 1
+           && (!mtdp_pipeline_pipe_accepts_replicas(&pipeline->pipes[i], ordered)
+               || !mtdp_pipeline_pipe_accepts_replicas(&pipeline->pipes[i + 1], ordered))) {
+            *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+            return false;
+        }
+        n_replica_impls += replicas - 1;
+    }
+    if(n_replica_impls && !mtdp_stage_impl_vector_resize(&pipeline->replica_impls, n_replica_impls)) {
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+        return false;
+    }
+    pipeline->n_replica_impls = n_replica_impls;
+    n_replica_impls           = 0;
+    for(size_t i = 0; i != pipeline->n_stages; ++i) {
+        replicas                           = mtdp_pipeline_stage_replicas(pipeline, i);
+        pipeline->stage_impls[i].ordered   = replicas > 1 && !pipeline->stages[i].unordered && !pipeline->stages[i].key;
+        pipeline->pipes[i].n_consumers     = replicas;
+        pipeline->pipes[i + 1].n_producers = replicas;
+        if(mtdp_pipeline_stage_partitioned(pipeline, i)
+           && !mtdp_pipe_partition(&pipeline->pipes[i], replicas, pipeline->stages[i].key)) {
+            mtdp_pipeline_unreplicate_stages(pipeline);
+            *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+            return false;
+        }
+        if(pipeline->pipes[i].n_partitions) {
+            pipeline->stage_impls[i].input_pipe = &pipeline->pipes[i].partitions[0];
+        }
+        for(size_t j = 1; j != replicas; ++j) {
+            replica = &pipeline->replica_impls[n_replica_impls++];
+            mtdp_stage_replicate(replica, &pipeline->stage_impls[i]);
+            if(pipeline->pipes[i].n_partitions) {
+                replica->input_pipe = &pipeline->pipes[i].partitions[j];
+            }
+        }
+    }
+    return true;
+}
+
+/* Fused stages are run by the first stage of their group, their input pipe being bypassed */
+static bool
+mtdp_pipeline_fuse_stages(mtdp_pipeline* pipeline)
+{
+    mtdp_stage_impl* head = NULL;
+
+    for(size_t i = 1; i < pipeline->n_stages; ++i) {
+        if(pipeline->stages[i].fused
+           && (mtdp_pipeline_stage_replicas(pipeline, i) > 1 || mtdp_pipeline_stage_replicas(pipeline, i - 1) > 1
+               || pipeline->pipes[i].transport != MTDP_PIPE_TRANSPORT_LOCKED)) {
+            *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+            return false;
+        }
+    }
+    for(size_t i = 0; i != pipeline->n_stages; ++i) {
+        if(i && pipeline->stages[i].fused) {
+            mtdp_stage_fuse(&pipeline->stage_impls[i], head);
+        }
+        else {
+            head = &pipeline->stage_impls[i];
+        }
+    }
+    return true;
+}
+
+static void
+mtdp_pipeline_unfuse_stages(mtdp_pipeline* pipeline)
+{
+    for(size_t i = 0; i != pipeline->n_stages; ++i) {
+        mtdp_stage_unfuse(&pipeline->stage_impls[i]);
+    }
+}
+
+/*
+    Splicing: the steps of the pipeline are numbered from the source (0) to the sink (n_stages + 1), step k
+    pushing to pipes[k]. A stage spliced out has no thread, and the next step still in the pipeline pulls from
+    the pipe of the previous one: pipes are never reallocated, and buffers never change pools.
+*/
+typedef struct {
+    mtdp_worker* worker;
+    /* Only set for the consumers: the pipe pulled and the input buffer held */
+    mtdp_pipe**  input_pipe;
+    mtdp_buffer* input;
+} mtdp_pipeline_step;
+
+static mtdp_pipeline_step
+mtdp_pipeline_step_at(mtdp_pipeline* pipeline, size_t k)
+{
+    mtdp_pipeline_step step = {&pipeline->source_impl.worker, NULL, NULL};
+
+    if(k == pipeline->n_stages + 1) {
+        step.worker     = &pipeline->sink_impl.worker;
+        step.input_pipe = &pipeline->sink_impl.input_pipe;
+        step.input      = &pipeline->sink_impl.context.input;
+    }
+    else if(k) {
+        step.worker     = &pipeline->stage_impls[k - 1].worker;
+        step.input_pipe = &pipeline->stage_impls[k - 1].input_pipe;
+        step.input      = &pipeline->stage_impls[k - 1].context.input;
+    }
+    return step;
+}
+
+/* Step still in the pipeline pushing to the input pipe of the stage */
+static size_t
+mtdp_pipeline_producer(const mtdp_pipeline* pipeline, size_t stage)
+{
+    size_t k = stage;
+
+    while(k && pipeline->stages[k - 1].spliced_out) {
+        --k;
+    }
+    return k;
+}
+
+/* Step still in the pipeline pulling from the output pipe of the stage, or from its input pipe if spliced out */
+static size_t
+mtdp_pipeline_consumer(const mtdp_pipeline* pipeline, size_t stage)
+{
+    size_t k = stage + 2;
+
+    while(k <= pipeline->n_stages && pipeline->stages[k - 1].spliced_out) {
+        ++k;
+    }
+    return k;
+}
+
+/* Pipeline run in place of the stage, NULL if none */
+static mtdp_pipeline*
+mtdp_pipeline_nested_at(const mtdp_pipeline* pipeline, size_t stage)
+{
+    for(size_t i = 0; i != pipeline->n_nested; ++i) {
+        if(pipeline->nested[i]->outer_stage == stage) {
+            return pipeline->nested[i];
+        }
+    }
+    return NULL;
+}
+
+/* Whether the steps around the stage may be paused and moved to another pipe, one at a time */
+static bool
+mtdp_pipeline_spliceable(const mtdp_pipeline* pipeline, size_t stage)
+{
+    size_t           producer = mtdp_pipeline_producer(pipeline, stage);
+    size_t           consumer = mtdp_pipeline_consumer(pipeline, stage);
+    const mtdp_pipe* pipe;
+    bool             ok = !(pipeline->shared_executor || pipeline->executor_threads);
+
+    ok &= mtdp_pipeline_stage_replicas(pipeline, stage) == 1 && !pipeline->stages[stage].fused;
+    ok &= stage + 1 == pipeline->n_stages || !pipeline->stages[stage + 1].fused;
+    ok &= producer ? mtdp_pipeline_stage_replicas(pipeline, producer - 1) == 1 && !pipeline->stages[producer - 1].fused
+                   : !pipeline->trunk && !pipeline->outer && !pipeline->previous;
+    ok &= consumer <= pipeline->n_stages
+          ? mtdp_pipeline_stage_replicas(pipeline, consumer - 1) == 1 && !pipeline->stages[consumer - 1].fused
+          : !pipeline->merge && !pipeline->outer && !pipeline->next;
+    /* The stages of a nested pipeline have threads of their own, out of reach. */
+    ok &= !mtdp_pipeline_nested_at(pipeline, stage) && !(producer && mtdp_pipeline_nested_at(pipeline, producer - 1))
+          && !(consumer <= pipeline->n_stages && mtdp_pipeline_nested_at(pipeline, consumer - 1));
+    for(size_t k = producer; ok && k != consumer; ++k) {
+        pipe = &pipeline->pipes[k];
+        ok &= !pipe->n_branches && !pipe->upstream && !pipe->n_inputs && !pipe->merge
+              && !pipe->joiner;
+    }
+    return ok;
+}
+
+/* Leaves the stages spliced out without a thread, the steps following them pulling from the pipe before */
+static void
+mtdp_pipeline_splice_stages(mtdp_pipeline* pipeline)
+{
+    size_t producer = 0;
+
+    for(size_t i = 0; i != pipeline->n_stages; ++i) {
+        if(pipeline->stages[i].spliced_out) {
+            pipeline->stage_impls[i].worker.pooled = true;
+            continue;
+        }
+        if(producer != i) {
+            pipeline->stage_impls[i].input_pipe = &pipeline->pipes[producer];
+        }
+        producer = i + 1;
+    }
+    pipeline->sink_impl.input_pipe = &pipeline->pipes[producer];
+}
+
+static void
+mtdp_pipeline_unsplice_stages(mtdp_pipeline* pipeline)
+{
+    for(size_t i = 0; i != pipeline->n_stages; ++i) {
+        if(pipeline->stages[i].spliced_out) {
+            pipeline->stage_impls[i].worker.pooled = false;
+        }
+    }
+    pipeline->sink_impl.input_pipe = &pipeline->pipes[pipeline->n_stages];
+}
+
+/* Pauses a step once its iteration is over, waking it up if it waits for a full buffer */
+static void
+mtdp_pipeline_park(const mtdp_pipeline_step* step)
+{
+    mtdp_worker_disable(step->worker);
+    if(step->input_pipe) {
+        /* A token with no buffer behind it: a waiting consumer finds nothing to pull, gives it back and returns. */
+        mtdp_semaphore_release(&(*step->input_pipe)->semaphore, 1);
+    }
+    mtdp_worker_wait_parked(step->worker);
+    if(step->input_pipe) {
+        mtdp_semaphore_try_acquire(&(*step->input_pipe)->semaphore);
+    }
+}
+
+/* Runs a consumer until its input pipe is drained and it holds none of its buffers (nor, if set, a push pending) */
+static void
+mtdp_pipeline_drain(const mtdp_pipeline_step* step, const bool* pushing)
+{
+    mtdp_pipeline_park(step);
+    while(!mtdp_pipe_drained(*step->input_pipe) || *step->input || (pushing && *pushing)) {
+        mtdp_worker_enable(step->worker);
+        thrd_yield();
+        mtdp_pipeline_park(step);
+    }
+}
+
+/* Releases the executor once the workers of the tasks, if attached, have been destroyed */
+static void
+mtdp_pipeline_detach_executor(mtdp_pipeline* pipeline)
+{
+    if(pipeline->tasks.levels) {
+        mtdp_executor_detach(pipeline->executor, &pipeline->tasks);
+    }
+    mtdp_task_set_destroy(&pipeline->tasks);
+    if(pipeline->executor == &pipeline->own_executor) {
+        mtdp_executor_deinit(&pipeline->own_executor);
+    }
+    pipeline->executor = NULL;
+}
+
+static bool
+mtdp_pipeline_attach_executor(mtdp_pipeline* pipeline)
+{
+    mtdp_task_set* tasks     = &pipeline->tasks;
+    size_t         n_tasks   = mtdp_pipeline_n_stage_impls(pipeline) + 2;
+    size_t         n_replica = 0, level = 0;
+
+    if(pipeline->shared_executor) {
+        pipeline->executor = pipeline->shared_executor;
+    }
+    else if(mtdp_executor_init(&pipeline->own_executor, pipeline->executor_threads, n_tasks)) {
+        pipeline->executor = &pipeline->own_executor;
+    }
+    else {
+        return false;
+    }
+    if(!mtdp_task_set_init(tasks, n_tasks)) {
+        mtdp_pipeline_detach_executor(pipeline);
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+        return false;
+    }
+    /* One level per step of the pipeline, replicas included, fused stages being run by their group. */
+    mtdp_task_set_add(tasks, &pipeline->source_impl.worker, level);
+    for(size_t i = 0; i != pipeline->n_stages; ++i) {
+        if(pipeline->stage_impls[i].fused_into) {
+            continue;
+        }
+        mtdp_task_set_add(tasks, &pipeline->stage_impls[i].worker, ++level);
+        for(size_t replicas = mtdp_pipeline_stage_replicas(pipeline, i); --replicas;) {
+            mtdp_task_set_add(tasks, &pipeline->replica_impls[n_replica++].worker, level);
+        }
+    }
+    mtdp_task_set_add(tasks, &pipeline->sink_impl.worker, ++level);
+    if(!mtdp_executor_attach(pipeline->executor, tasks)) {
+        mtdp_pipeline_detach_executor(pipeline);
+        return false;
+    }
+    return true;
 }
 
 static void
 mtdp_pipeline_join(mtdp_pipeline* pipeline)
 {
     mtdp_worker_join(&pipeline->source_impl.worker);
-    for(size_t n_stages = 0; n_stages != pipeline->n_stages; ++n_stages) {
-        mtdp_worker_join(&pipeline->stage_impls[n_stages].worker);
+    for(size_t i = 0; i != mtdp_pipeline_n_stage_impls(pipeline); ++i) {
+        mtdp_worker_join(&mtdp_pipeline_stage_impl(pipeline, i)->worker);
     }
     mtdp_worker_join(&pipeline->sink_impl.worker);
 }
 
+/* Puts back the buffers held by the steps of the pipeline */
 static void
-mtdp_pipeline_clear(mtdp_pipeline* self)
+mtdp_pipeline_release_buffers(mtdp_pipeline* self)
 {
-    for(size_t i = self->n_stages + 1; i--;) {
-        mtdp_pipe_clear(&self->pipes[i]);
-    }
     if(self->sink_impl.context.input) {
-        mtdp_pipe_put_back(&self->pipes[self->n_stages], self->sink_impl.context.input);
+        mtdp_pipe_put_back(self->sink_impl.input_pipe, self->sink_impl.context.input);
         self->sink_impl.context.input = NULL;
     }
-    for(size_t i = self->n_stages; i--;) {
-        if(self->stage_impls[i].context.input) {
-            mtdp_pipe_put_back(&self->pipes[i], self->stage_impls[i].context.input);
-            self->stage_impls[i].context.input = NULL;
+    for(size_t i = mtdp_pipeline_n_stage_impls(self); i--;) {
+        mtdp_stage_impl* stage_impl = mtdp_pipeline_stage_impl(self, i);
+        if(stage_impl->context.input) {
+            mtdp_pipe_put_back(stage_impl->input_pipe, stage_impl->context.input);
+            stage_impl->context.input = NULL;
         }
-        if(self->stage_impls[i].context.output) {
-            mtdp_pipe_put_back(&self->pipes[i + 1], self->stage_impls[i].context.output);
-            self->stage_impls[i].context.output = NULL;
+        if(stage_impl->context.joined) {
+            mtdp_pipe_put_back(stage_impl->input_pipe, stage_impl->context.joined);
+            stage_impl->context.joined = NULL;
+        }
+        if(stage_impl->context.output) {
+            mtdp_pipe_unclaim(stage_impl->output_pipe, stage_impl->context.output);
+            stage_impl->context.output = NULL;
         }
     }
     if(self->source_impl.context.output) {
-        mtdp_pipe_put_back(&self->pipes[0], self->source_impl.context.output);
+        mtdp_pipe_unclaim(&self->pipes[0], self->source_impl.context.output);
         self->source_impl.context.output = NULL;
     }
 }
 
+static void
+mtdp_pipeline_clear(mtdp_pipeline* self)
+{
+    mtdp_pipeline_release_buffers(self);
+    /* Buffers given back above may still sit in the return path of lock-free pipes. */
+    for(size_t i = self->n_stages + 1; i--;) {
+        mtdp_pipe_clear(&self->pipes[i]);
+    }
+}
+
+/*
+    Pipelines linked by branches and inputs are run as a single one: the calls enabling, starting,
+    stopping, waiting for and disabling any of them apply to all of them. The first stage of a branch
+    pulls the buffers broadcast by a pipe of its trunk instead of those of its own source, and the
+    last pipe of an input is drained by the consumer of the pipe it is merged into instead of its sink.
+    A nested pipeline runs in place of a stage of its outer one: its first stage pulls from the input
+    pipe of that stage and its last stage pushes to the output one, neither its source nor its sink
+    nor the stage replaced running. Two pipelines bridged run as a longer one, the first stage of the
+    next one pulling from the last pipe of the previous one in place of its sink and its source.
+*/
+typedef bool (*mtdp_pipeline_visitor)(mtdp_pipeline*, void* context);
+
+static bool
+mtdp_pipeline_visit(mtdp_pipeline* pipeline, uint32_t visit, mtdp_pipeline_visitor visitor, void* context)
+{
+    /* Only concurrent waits may walk the same pipelines at once: they might visit some of them twice. */
+    if(atomic_exchange(&pipeline->visit, visit) == visit) {
+        return true;
+    }
+    if(!visitor(pipeline, context)) {
+        return false;
+    }
+    for(size_t i = 0; i != pipeline->n_branches; ++i) {
+        if(!mtdp_pipeline_visit(pipeline->branches[i], visit, visitor, context)) {
+            return false;
+        }
+    }
+    for(size_t i = 0; i != pipeline->n_inputs; ++i) {
+        if(!mtdp_pipeline_visit(pipeline->inputs[i], visit, visitor, context)) {
+            return false;
+        }
+    }
+    for(size_t i = 0; i != pipeline->n_nested; ++i) {
+        if(!mtdp_pipeline_visit(pipeline->nested[i], visit, visitor, context)) {
+            return false;
+        }
+    }
+    return (!pipeline->trunk || mtdp_pipeline_visit(pipeline->trunk, visit, visitor, context))
+           && (!pipeline->merge || mtdp_pipeline_visit(pipeline->merge, visit, visitor, context))
+           && (!pipeline->outer || mtdp_pipeline_visit(pipeline->outer, visit, visitor, context))
+           && (!pipeline->next || mtdp_pipeline_visit(pipeline->next, visit, visitor, context))
+           && (!pipeline->previous || mtdp_pipeline_visit(pipeline->previous, visit, visitor, context));
+}
+
+/* Calls the visitor on the pipeline and on every pipeline linked to it, until it returns false */
+static bool
+mtdp_pipeline_for_each_link(mtdp_pipeline* pipeline, mtdp_pipeline_visitor visitor, void* context)
+{
+    static atomic_uint32_t visits;
+    return mtdp_pipeline_visit(pipeline, atomic_fetch_add(&visits, 1) + 1, visitor, context);
+}
+
+#define mtdp_pipeline_linked(pipeline)                                                                                          \
+  ((pipeline)->trunk || (pipeline)->merge || (pipeline)->outer || (pipeline)->next || (pipeline)->previous                 \
+   || (pipeline)->n_branches || (pipeline)->n_inputs || (pipeline)->n_nested)
+
+static bool
+mtdp_pipeline_check_links(mtdp_pipeline* pipeline, void* context)
+{
+    const mtdp_pipe* pipe;
+    size_t           stage;
+    bool             ok = true;
+
+    (void)context;
+    /* Executor tasks are only scheduled again by the tasks of their own pipeline. */
+    ok &= !mtdp_pipeline_linked(pipeline) || !(pipeline->shared_executor || pipeline->executor_threads);
+    ok &= !pipeline->trunk || pipeline->pipes[0].transport != MTDP_PIPE_TRANSPORT_RING;
+    ok &= !pipeline->merge || pipeline->pipes[pipeline->n_stages].transport != MTDP_PIPE_TRANSPORT_RING;
+    for(size_t i = 0; ok && i != pipeline->n_stages + 1; ++i) {
+        pipe = &pipeline->pipes[i];
+        /* The last reference to a broadcast buffer may be dropped by any branch, and the consumer shall lock the pool. */
+        if(pipe->n_branches) {
+            ok &= pipe->transport == MTDP_PIPE_TRANSPORT_LOCKED || pipe->transport == MTDP_PIPE_TRANSPORT_MPMC;
+            ok &= i == pipeline->n_stages || !pipeline->stages[i].fused;
+        }
+        /* A joining pipe pairs its own buffers with those of a single input, for a stage. */
+        if(pipe->joiner) {
+            ok &= pipe->n_inputs == 1 && i != pipeline->n_stages;
+        }
+        /* Merged buffers are released out of order, by a single consumer keeping track of the inputs. */
+        if(pipe->n_inputs) {
+            ok &= pipe->transport != MTDP_PIPE_TRANSPORT_RING;
+            ok &= i == pipeline->n_stages || (!pipeline->stages[i].fused && mtdp_pipeline_stage_replicas(pipeline, i) == 1);
+        }
+    }
+    for(size_t i = 0; ok && i != pipeline->n_stages; ++i) {
+        ok &= !pipeline->stages[i].spliced_out || mtdp_pipeline_spliceable(pipeline, i);
+    }
+    /* The stages at both ends of a nested pipeline stand for a single one, between the pipes of the outer pipeline. */
+    if(pipeline->outer) {
+        ok &= mtdp_pipeline_stage_replicas(pipeline, 0) == 1 && !pipeline->stages[0].spliced_out;
+        ok &= mtdp_pipeline_stage_replicas(pipeline, pipeline->n_stages - 1) == 1
+              && !pipeline->stages[pipeline->n_stages - 1].spliced_out;
+    }
+    /* Only a single stage pulls from the last pipe of the previous pipeline. */
+    if(pipeline->previous && pipeline->n_stages) {
+        ok &= mtdp_pipeline_stage_replicas(pipeline, 0) == 1 && !pipeline->stages[0].spliced_out;
+    }
+    for(size_t i = 0; ok && i != pipeline->n_nested; ++i) {
+        stage = pipeline->nested[i]->outer_stage;
+        ok &= mtdp_pipeline_stage_replicas(pipeline, stage) == 1 && !pipeline->stages[stage].fused
+              && !pipeline->stages[stage].spliced_out;
+        ok &= stage + 1 == pipeline->n_stages || !pipeline->stages[stage + 1].fused;
+    }
+    if(!ok) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+    }
+    return ok;
+}
+
+/* Prepares the pipeline to run, without creating its threads yet */
+static bool
+mtdp_pipeline_setup(mtdp_pipeline* pipeline, void* context)
+{
+    (void)context;
+    if(!mtdp_pipeline_fuse_stages(pipeline)) {
+        mtdp_pipeline_unfuse_stages(pipeline);
+        return false;
+    }
+    if(!mtdp_pipeline_replicate_stages(pipeline)) {
+        mtdp_pipeline_unfuse_stages(pipeline);
+        return false;
+    }
+    mtdp_pipeline_splice_stages(pipeline);
+    if((pipeline->shared_executor || pipeline->executor_threads) && !mtdp_pipeline_attach_executor(pipeline)) {
+        mtdp_pipeline_unsplice_stages(pipeline);
+        mtdp_pipeline_unreplicate_stages(pipeline);
+        mtdp_pipeline_unfuse_stages(pipeline);
+        return false;
+    }
+    for(size_t i = 0; i != pipeline->n_stages + 1; ++i) {
+        if(!mtdp_pipe_prepare(&pipeline->pipes[i])) {
+            if(pipeline->executor) {
+                mtdp_pipeline_detach_executor(pipeline);
+            }
+            mtdp_pipeline_unsplice_stages(pipeline);
+            mtdp_pipeline_unreplicate_stages(pipeline);
+            mtdp_pipeline_unfuse_stages(pipeline);
+            *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+            return false;
+        }
+    }
+    pipeline->enabled = true;
+    pipeline->active  = false;
+    return true;
+}
+
+/* Reverts the setup, once the threads have been joined and the buffers put back */
+static bool
+mtdp_pipeline_teardown(mtdp_pipeline* pipeline, void* context)
+{
+    (void)context;
+    if(!pipeline->enabled) {
+        return true;
+    }
+    if(pipeline->executor) {
+        mtdp_pipeline_detach_executor(pipeline);
+    }
+    mtdp_pipeline_clear(pipeline);
+    for(size_t i = 0; i != mtdp_pipeline_n_stage_impls(pipeline); ++i) {
+        mtdp_set_done(&mtdp_pipeline_stage_impl(pipeline, i)->done);
+    }
+    mtdp_pipeline_unsplice_stages(pipeline);
+    mtdp_pipeline_unreplicate_stages(pipeline);
+    mtdp_pipeline_unfuse_stages(pipeline);
+    if(pipeline->trunk) {
+        pipeline->source_impl.worker.pooled = false;
+    }
+    if(pipeline->merge) {
+        pipeline->sink_impl.worker.pooled = false;
+    }
+    if(pipeline->outer) {
+        pipeline->stage_impls[pipeline->n_stages - 1].output_pipe = &pipeline->pipes[pipeline->n_stages];
+        pipeline->source_impl.worker.pooled = pipeline->sink_impl.worker.pooled = false;
+    }
+    if(pipeline->next) {
+        pipeline->sink_impl.worker.pooled = false;
+    }
+    if(pipeline->previous) {
+        pipeline->source_impl.worker.pooled = false;
+    }
+    for(size_t i = 0; i != pipeline->n_nested; ++i) {
+        pipeline->stage_impls[pipeline->nested[i]->outer_stage].worker.pooled = false;
+    }
+    pipeline->active  = false;
+    pipeline->enabled = false;
+    mtdp_unset_done(&pipeline->destroying);
+    return true;
+}
+
+static bool
+mtdp_pipeline_launch(mtdp_pipeline* pipeline, void* context)
+{
+    (void)context;
+    for(size_t i = 0; i != pipeline->n_stages + 1; ++i) {
+        mtdp_pipe_hand_over(&pipeline->pipes[i]);
+    }
+    /* Every pipeline is set up by now: those nested take the pipes around their stage, as rewired by the outer one. */
+    if(pipeline->outer) {
+        mtdp_stage_impl* outer = &pipeline->outer->stage_impls[pipeline->outer_stage];
+
+        pipeline->stage_impls[0].input_pipe                       = outer->input_pipe;
+        pipeline->stage_impls[pipeline->n_stages - 1].output_pipe = outer->output_pipe;
+    }
+    if(pipeline->previous) {
+        if(pipeline->n_stages) {
+            pipeline->stage_impls[0].input_pipe = &pipeline->previous->pipes[pipeline->previous->n_stages];
+        }
+        else {
+            pipeline->sink_impl.input_pipe = &pipeline->previous->pipes[pipeline->previous->n_stages];
+        }
+    }
+    for(size_t i = 0; i != pipeline->n_nested; ++i) {
+        pipeline->stage_impls[pipeline->nested[i]->outer_stage].worker.pooled = true;
+    }
+    /* The source of a branch and the sink of an input never run, nor those replaced by other pipelines: they get no thread. */
+    pipeline->sink_impl.worker.pooled = pipeline->merge || pipeline->outer || pipeline->next || pipeline->sink_impl.worker.pooled;
+    mtdp_sink_create_thread(&pipeline->sink_impl);
+    for(size_t i = mtdp_pipeline_n_stage_impls(pipeline); i--;) {
+        mtdp_stage_create_thread(mtdp_pipeline_stage_impl(pipeline, i));
+    }
+    for(size_t i = 0; i != pipeline->n_stages; ++i) {
+        if(pipeline->stages[i].spliced_out) {
+            pipeline->stage_impls[i].done = 1;
+        }
+    }
+    for(size_t i = 0; i != pipeline->n_nested; ++i) {
+        pipeline->stage_impls[pipeline->nested[i]->outer_stage].done = 1;
+    }
+    pipeline->source_impl.worker.pooled
+        = pipeline->trunk || pipeline->outer || pipeline->previous || pipeline->source_impl.worker.pooled;
+    mtdp_source_create_thread(&pipeline->source_impl);
+    if(pipeline->trunk || pipeline->outer || pipeline->previous) {
+        pipeline->source_impl.done = 1;
+    }
+    if(pipeline->merge || pipeline->outer || pipeline->next) {
+        pipeline->sink_impl.done = 1;
+    }
+    return true;
+}
+
+static bool
+mtdp_pipeline_join_workers(mtdp_pipeline* pipeline, void* context)
+{
+    (void)context;
+    mtdp_set_done(&pipeline->destroying);
+    mtdp_source_destroy(&pipeline->source_impl);
+    for(size_t i = 0; i != mtdp_pipeline_n_stage_impls(pipeline); ++i) {
+        mtdp_stage_destroy(mtdp_pipeline_stage_impl(pipeline, i));
+    }
+    mtdp_sink_destroy(&pipeline->sink_impl);
+    if(pipeline->executor) {
+        mtdp_pipeline_detach_executor(pipeline);
+    }
+    mtdp_pipeline_join(pipeline);
+    return true;
+}
+
+static bool
+mtdp_pipeline_release_links(mtdp_pipeline* pipeline, void* context)
+{
+    (void)context;
+    mtdp_pipeline_release_buffers(pipeline);
+    return true;
+}
+
+/* Empties the pipes holding buffers of other pipelines, before these pipelines clear their own */
+static bool
+mtdp_pipeline_clear_links(mtdp_pipeline* pipeline, void* context)
+{
+    (void)context;
+    for(size_t i = 0; i != pipeline->n_stages + 1; ++i) {
+        if(pipeline->pipes[i].upstream || pipeline->pipes[i].n_inputs) {
+            mtdp_pipe_clear(&pipeline->pipes[i]);
+        }
+    }
+    return true;
+}
+
+static bool
+mtdp_pipeline_enable_links(mtdp_pipeline* pipeline)
+{
+    enum mtdp_error error;
+
+    if(!mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_check_links, NULL)) {
+        return false;
+    }
+    /* Merging pipes look up the pools of their inputs: none of them is handed over before all are prepared. */
+    if(!mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_setup, NULL)) {
+        error = *mtdp_errno_ptr_mutable();
+        mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_teardown, NULL);
+        *mtdp_errno_ptr_mutable() = error;
+        return false;
+    }
+    mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_launch, NULL);
+    return true;
+}
+
+static void
+mtdp_pipeline_disable_links(mtdp_pipeline* pipeline)
+{
+    /* Every thread is joined first, so that nothing moves while the buffers go back to their pools. */
+    mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_join_workers, NULL);
+    mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_release_links, NULL);
+    mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_clear_links, NULL);
+    mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_teardown, NULL);
+}
+
+static bool
+mtdp_pipeline_start_link(mtdp_pipeline* pipeline, void* context)
+{
+    (void)context;
+    mtdp_worker_enable(&pipeline->sink_impl.worker);
+    for(size_t i = mtdp_pipeline_n_stage_impls(pipeline); i--;) {
+        mtdp_worker_enable(&mtdp_pipeline_stage_impl(pipeline, i)->worker);
+    }
+    mtdp_worker_enable(&pipeline->source_impl.worker);
+    if(pipeline->executor) {
+        mtdp_executor_schedule_set(pipeline->executor, &pipeline->tasks);
+    }
+    pipeline->active = true;
+    return true;
+}
+
+static bool
+mtdp_pipeline_stop_link(mtdp_pipeline* pipeline, void* context)
+{
+    (void)context;
+    mtdp_worker_disable(&pipeline->source_impl.worker);
+    for(size_t i = 0; i != mtdp_pipeline_n_stage_impls(pipeline); ++i) {
+        mtdp_worker_disable(&mtdp_pipeline_stage_impl(pipeline, i)->worker);
+    }
+    /* Queued executor tasks are dropped by the threads, as their workers are not running. */
+    mtdp_worker_disable(&pipeline->sink_impl.worker);
+    pipeline->active = false;
+    return true;
+}
+
+/* Whether data flows from one pipeline to the other, through branches and inputs */
+static bool
+mtdp_pipeline_reaches(const mtdp_pipeline* from, const mtdp_pipeline* to)
+{
+    if(from == to) {
+        return true;
+    }
+    for(size_t i = 0; i != from->n_branches; ++i) {
+        if(mtdp_pipeline_reaches(from->branches[i], to)) {
+            return true;
+        }
+    }
+    return (from->merge && mtdp_pipeline_reaches(from->merge, to)) || (from->next && mtdp_pipeline_reaches(from->next, to));
+}
+
+/* Removes a pipeline from a list of linked pipelines */
+static void
+mtdp_pipeline_list_remove(mtdp_pipeline** list, size_t* size, const mtdp_pipeline* pipeline)
+{
+    for(size_t i = 0; i != *size; ++i) {
+        if(list[i] == pipeline) {
+            list[i] = list[--*size];
+            break;
+        }
+    }
+}
+
+/* Appends a pipeline to a list of linked pipelines */
+static bool
+mtdp_pipeline_list_add(mtdp_pipeline*** list, size_t* size, mtdp_pipeline* pipeline)
+{
+    mtdp_pipeline** out = (mtdp_pipeline**)realloc(*list, (*size + 1) * sizeof(mtdp_pipeline*));
+
+    if(!out) {
+        return false;
+    }
+    out[(*size)++] = pipeline;
+    *list          = out;
+    return true;
+}
+
+static void
+mtdp_pipeline_unlink_branch(mtdp_pipeline* branch)
+{
+    mtdp_pipe_remove_branch(branch->pipes[0].upstream, &branch->pipes[0]);
+    mtdp_pipeline_list_remove(branch->trunk->branches, &branch->trunk->n_branches, branch);
+    branch->trunk = NULL;
+}
+
+static void
+mtdp_pipeline_unlink_input(mtdp_pipeline* input)
+{
+    mtdp_pipe* pipe = &input->pipes[input->n_stages];
+
+    mtdp_pipe_remove_input(pipe->merge, pipe);
+    mtdp_pipeline_list_remove(input->merge->inputs, &input->merge->n_inputs, input);
+    input->merge = NULL;
+}
+
+static void
+mtdp_pipeline_unlink_nested(mtdp_pipeline* nested)
+{
+    mtdp_pipeline_list_remove(nested->outer->nested, &nested->outer->n_nested, nested);
+    nested->outer = NULL;
+}
+
+static void
+mtdp_pipeline_unlink_bridge(mtdp_pipeline* from)
+{
+    from->next->previous = NULL;
+    from->next           = NULL;
+}
+
 MTDP_API_INTERNAL mtdp_pipeline*
 mtdp_pipeline_create(const mtdp_pipeline_parameters* parameters)
 {
@@ -119,7 +894,10 @@ mtdp_pipeline_create(const mtdp_pipeline_parameters* parameters)
                 return NULL;
             }
         }
-        out->n_stages = parameters->params.internal_stages;
+        out->n_stages         = parameters->params.internal_stages;
+        out->executor_threads = parameters->params.executor_threads;
+        out->shared_executor  = parameters->params.executor;
+        out->executor         = NULL;
         mtdp_pipeline_configure(out);
         *mtdp_errno_ptr_mutable() = MTDP_OK;
     }
@@ -129,11 +907,83 @@ mtdp_pipeline_create(const mtdp_pipeline_parameters* parameters)
     return out;
 }
 
+MTDP_API_INTERNAL bool
+mtdp_pipeline_create_graph(const mtdp_pipeline_parameters* nodes, size_t n_nodes, const mtdp_pipeline_edge* edges,
+                           size_t n_edges, mtdp_pipeline** pipelines)
+{
+    const mtdp_pipeline_edge* edge;
+    enum mtdp_error           error;
+    bool                      ok = true;
+    size_t                    n_created;
+
+    if(!nodes || !pipelines || (n_edges && !edges)) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    for(n_created = 0; ok && n_created != n_nodes; ++n_created) {
+        ok = (pipelines[n_created] = mtdp_pipeline_create(&nodes[n_created])) != NULL;
+    }
+    n_created -= !ok;
+    for(size_t i = 0; ok && i != n_edges; ++i) {
+        edge = &edges[i];
+        if(edge->from >= n_nodes || edge->to >= n_nodes) {
+            *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+            ok                        = false;
+        }
+        else if(edge->kind == MTDP_PIPELINE_EDGE_BRANCH) {
+            ok = mtdp_pipeline_add_branch(pipelines[edge->from], edge->pipe, pipelines[edge->to]);
+        }
+        else {
+            ok = mtdp_pipeline_add_input(pipelines[edge->to], edge->pipe, pipelines[edge->from]);
+        }
+    }
+    if(!ok) {
+        /* Destroying a node unlinks it from the others. */
+        error = *mtdp_errno_ptr_mutable();
+        for(size_t i = 0; i != n_created; ++i) {
+            mtdp_pipeline_destroy(pipelines[i]);
+            pipelines[i] = NULL;
+        }
+        *mtdp_errno_ptr_mutable() = error;
+        return false;
+    }
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
+
 MTDP_API_INTERNAL void
 mtdp_pipeline_destroy(mtdp_pipeline* pipeline)
 {
     if(pipeline) {
+        /* Linked pipelines may hold buffers of this one: all of them are disabled first. */
         mtdp_pipeline_disable(pipeline);
+        if(pipeline->trunk) {
+            mtdp_pipeline_unlink_branch(pipeline);
+        }
+        if(pipeline->merge) {
+            mtdp_pipeline_unlink_input(pipeline);
+        }
+        while(pipeline->n_branches) {
+            mtdp_pipeline_unlink_branch(pipeline->branches[0]);
+        }
+        while(pipeline->n_inputs) {
+            mtdp_pipeline_unlink_input(pipeline->inputs[0]);
+        }
+        if(pipeline->outer) {
+            mtdp_pipeline_unlink_nested(pipeline);
+        }
+        while(pipeline->n_nested) {
+            mtdp_pipeline_unlink_nested(pipeline->nested[0]);
+        }
+        if(pipeline->next) {
+            mtdp_pipeline_unlink_bridge(pipeline);
+        }
+        if(pipeline->previous) {
+            mtdp_pipeline_unlink_bridge(pipeline->previous);
+        }
+        free(pipeline->branches);
+        free(pipeline->inputs);
+        free(pipeline->nested);
         for(size_t i = 0; i < 1 + pipeline->n_stages; ++i) {
             mtdp_pipe_destroy(&pipeline->pipes[i]);
         }
@@ -177,13 +1027,9 @@ mtdp_pipeline_enable(mtdp_pipeline* pipeline)
 {
     if(pipeline) {
         if(!pipeline->enabled) {
-            mtdp_sink_create_thread(&pipeline->sink_impl);
-            for(size_t i = pipeline->n_stages; i--;) {
-                mtdp_stage_create_thread(&pipeline->stage_impls[i]);
+            if(!mtdp_pipeline_enable_links(pipeline)) {
+                return false;
             }
-            mtdp_source_create_thread(&pipeline->source_impl);
-            pipeline->enabled         = true;
-            pipeline->active          = false;
             *mtdp_errno_ptr_mutable() = MTDP_OK;
             return true;
         }
@@ -202,20 +1048,7 @@ mtdp_pipeline_disable(mtdp_pipeline* pipeline)
 {
     if(pipeline) {
         if(pipeline->enabled) {
-            mtdp_set_done(&pipeline->destroying);
-            mtdp_source_destroy(&pipeline->source_impl);
-            for(size_t i = 0; i != pipeline->n_stages; ++i) {
-                mtdp_stage_destroy(&pipeline->stage_impls[i]);
-            }
-            mtdp_sink_destroy(&pipeline->sink_impl);
-            mtdp_pipeline_join(pipeline);
-            mtdp_pipeline_clear(pipeline);
-            for(size_t i = 0; i < pipeline->n_stages; ++i) {
-                mtdp_set_done(&pipeline->stage_impls[i].done);
-            }
-            pipeline->active  = false;
-            pipeline->enabled = false;
-            mtdp_unset_done(&pipeline->destroying);
+            mtdp_pipeline_disable_links(pipeline);
             *mtdp_errno_ptr_mutable() = MTDP_OK;
             return true;
         }
@@ -238,12 +1071,7 @@ mtdp_pipeline_start(mtdp_pipeline* pipeline)
                 *mtdp_errno_ptr_mutable() = MTDP_ACTIVE;
             }
             else {
-                mtdp_worker_enable(&pipeline->sink_impl.worker);
-                for(size_t i = pipeline->n_stages; i--;) {
-                    mtdp_worker_enable(&pipeline->stage_impls[i].worker);
-                }
-                mtdp_worker_enable(&pipeline->source_impl.worker);
-                pipeline->active          = true;
+                mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_start_link, NULL);
                 *mtdp_errno_ptr_mutable() = MTDP_OK;
                 return true;
             }
@@ -267,13 +1095,8 @@ mtdp_pipeline_stop(mtdp_pipeline* pipeline)
                 *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
             }
             else {
-                mtdp_worker_disable(&pipeline->source_impl.worker);
-                for(size_t i = 0; i != pipeline->n_stages; ++i) {
-                    mtdp_worker_disable(&pipeline->stage_impls[i].worker);
-                }
-                mtdp_worker_disable(&pipeline->sink_impl.worker);
+                mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_stop_link, NULL);
                 *mtdp_errno_ptr_mutable() = MTDP_OK;
-                pipeline->active          = false;
                 return true;
             }
         }
@@ -287,29 +1110,69 @@ mtdp_pipeline_stop(mtdp_pipeline* pipeline)
     return false;
 }
 
+/* Whether every step of the pipeline has flagged it ran out of work */
+static bool
+mtdp_pipeline_done(mtdp_pipeline* pipeline)
+{
+    bool done = atomic_load(&pipeline->source_impl.done) == 1;
+    for(size_t i = 0; done && i != mtdp_pipeline_n_stage_impls(pipeline); ++i) {
+        done &= atomic_load(&mtdp_pipeline_stage_impl(pipeline, i)->done) == 1;
+    }
+    return done && atomic_load(&pipeline->sink_impl.done) == 1;
+}
+
+/* Waits for a pipeline to be drained, clearing the flag in context if it was not already */
+static bool
+mtdp_pipeline_wait_link(mtdp_pipeline* pipeline, void* context)
+{
+    uint32_t key;
+
+    if(pipeline->executor) {
+        /*
+            Executor tasks flip their done flags without wakeups, and raise them as soon as an input
+            is momentarily empty: the pipeline is only drained once no task is left to run.
+        */
+        if(mtdp_task_set_idle(&pipeline->tasks) && mtdp_pipeline_done(pipeline)) {
+            return true;
+        }
+        while(true) {
+            key = mtdp_event_prepare(&pipeline->executor->idle_event);
+            if(mtdp_task_set_idle(&pipeline->tasks) && mtdp_pipeline_done(pipeline)) {
+                mtdp_event_cancel(&pipeline->executor->idle_event);
+                break;
+            }
+            mtdp_event_wait_for(&pipeline->executor->idle_event, key, MTDP_PIPELINE_CONSUMER_TIMEOUT_US);
+        }
+    }
+    else {
+        if(mtdp_pipeline_done(pipeline)) {
+            return true;
+        }
+        do {
+            mtdp_futex_wait(&pipeline->source_impl.done, 0);
+            for(size_t i = 0; i != mtdp_pipeline_n_stage_impls(pipeline); ++i) {
+                mtdp_futex_wait(&mtdp_pipeline_stage_impl(pipeline, i)->done, 0);
+            }
+            mtdp_futex_wait(&pipeline->sink_impl.done, 0);
+        } while(!mtdp_pipeline_done(pipeline));
+    }
+    *(bool*)context = false;
+    return true;
+}
+
 MTDP_API_INTERNAL void
 mtdp_pipeline_wait(mtdp_pipeline* pipeline)
 {
-    bool exit;
+    bool drained;
 
     if(pipeline) {
         mtdp_futex_wait(&pipeline->destroying, 1);
         if(pipeline->enabled) {
+            /* Linked pipelines feed one another: they are drained once all of them are at the same time. */
             do {
-                mtdp_futex_wait(&pipeline->source_impl.done, 0);
-                for(size_t i = 0; i != pipeline->n_stages; ++i) {
-                    mtdp_futex_wait(&pipeline->stage_impls[i].done, 0);
-                }
-                mtdp_futex_wait(&pipeline->sink_impl.done, 0);
-                exit = atomic_load(&pipeline->source_impl.done) == 1;
-                for(size_t i = 0; exit && i != pipeline->n_stages; ++i) {
-                    exit &= atomic_load(&pipeline->stage_impls[i].done) == 1;
-                    if(!exit) {
-                        continue;
-                    }
-                }
-                exit &= atomic_load(&pipeline->sink_impl.done) == 1;
-            } while(!exit);
+                drained = true;
+                mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_wait_link, &drained);
+            } while(!drained);
             *mtdp_errno_ptr_mutable() = MTDP_OK;
         }
         else {
@@ -320,3 +1183,503 @@ mtdp_pipeline_wait(mtdp_pipeline* pipeline)
         *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
     }
 }
+
+/* Pulled from the pipe up to pushed buffers or, given its cycles, the consumer found at cycle let go of its buffer */
+static bool
+mtdp_pipeline_flushed(mtdp_pipe* pipe, size_t pushed, atomic_uint32_t* cycles, uint32_t cycle)
+{
+    return cycles ? !(cycle & 1) || atomic_load(cycles) != cycle : atomic_load(&pipe->n_pulled) >= pushed;
+}
+
+/* Spins, then parks on the flush event of the pipe, until its consumers are flushed as above */
+static void
+mtdp_pipeline_flush_wait(mtdp_pipe* pipe, size_t pushed, atomic_uint32_t* cycles, uint32_t cycle)
+{
+    /* The consumer of a merging pipe lets go of the buffers of its inputs as well. */
+    mtdp_event* event = pipe->merge ? &pipe->merge->flush_event : &pipe->flush_event;
+    uint32_t    key;
+
+    for(uint32_t i = MTDP_WAIT_SPIN_COUNT; i--; mtdp_cpu_relax()) {
+        if(mtdp_pipeline_flushed(pipe, pushed, cycles, cycle)) {
+            return;
+        }
+    }
+    while(true) {
+        key = mtdp_event_prepare(event);
+        if(mtdp_pipeline_flushed(pipe, pushed, cycles, cycle)) {
+            mtdp_event_cancel(event);
+            break;
+        }
+        mtdp_event_wait_for(event, key, MTDP_PIPELINE_CONSUMER_TIMEOUT_US);
+    }
+}
+
+/* Waits for the consumers of a pipe to have pulled the buffers pushed to it so far */
+static void
+mtdp_pipeline_flush_pipe(mtdp_pipe* pipe)
+{
+    mtdp_pipeline_flush_wait(pipe, atomic_load(&pipe->n_pushed), NULL, 0);
+}
+
+/* Waits for a consumer of the pipe found holding a buffer to let go of it */
+static void
+mtdp_pipeline_flush_consumer(mtdp_pipe* pipe, atomic_uint32_t* cycles)
+{
+    mtdp_pipeline_flush_wait(pipe, 0, cycles, atomic_load(cycles));
+}
+
+/*
+    Flushes the steps of a pipeline in order, through the pipelines nested in place of its stages.
+    All the buffers pulled by a step are let go of, their outputs pushed, before the pipe of the next
+    step is looked at.
+*/
+static void
+mtdp_pipeline_flush_steps(mtdp_pipeline* pipeline)
+{
+    size_t           replica = 0, replicas;
+    mtdp_pipeline*   nested;
+    mtdp_stage_impl* stage_impl;
+
+    for(size_t i = 0; i != pipeline->n_stages; ++i) {
+        replicas = mtdp_pipeline_stage_replicas(pipeline, i);
+        if((nested = mtdp_pipeline_nested_at(pipeline, i))) {
+            mtdp_pipeline_flush_steps(nested);
+        }
+        else if(!pipeline->stages[i].spliced_out) {
+            /* Every buffer is pulled before any replica is looked at: whoever pulled it holds it by then. */
+            for(size_t j = 0; j != replicas; ++j) {
+                stage_impl = j ? &pipeline->replica_impls[replica + j - 1] : &pipeline->stage_impls[i];
+                mtdp_pipeline_flush_pipe(stage_impl->input_pipe);
+            }
+            for(size_t j = 0; j != replicas; ++j) {
+                stage_impl = j ? &pipeline->replica_impls[replica + j - 1] : &pipeline->stage_impls[i];
+                mtdp_pipeline_flush_consumer(stage_impl->input_pipe, &stage_impl->cycles);
+            }
+        }
+        replica += replicas - 1;
+    }
+    if(!pipeline->merge && !pipeline->outer && !pipeline->next) {
+        mtdp_pipeline_flush_pipe(pipeline->sink_impl.input_pipe);
+        mtdp_pipeline_flush_consumer(pipeline->sink_impl.input_pipe, &pipeline->sink_impl.cycles);
+    }
+}
+
+/*
+    Flushes a pipeline once every pipeline its buffers come from is: the trunk it branches from, the one
+    bridged before it and its inputs, up to the buffers pulled from their last pipe. A nested pipeline
+    is flushed along with its outer one.
+*/
+static void
+mtdp_pipeline_flush_upstream(mtdp_pipeline* pipeline, uint32_t flush)
+{
+    mtdp_pipeline* input;
+
+    if(pipeline->outer) {
+        mtdp_pipeline_flush_upstream(pipeline->outer, flush);
+        return;
+    }
+    if(pipeline->flush == flush) {
+        return;
+    }
+    pipeline->flush = flush;
+    if(pipeline->trunk) {
+        mtdp_pipeline_flush_upstream(pipeline->trunk, flush);
+    }
+    if(pipeline->previous) {
+        mtdp_pipeline_flush_upstream(pipeline->previous, flush);
+    }
+    for(size_t i = 0; i != pipeline->n_inputs; ++i) {
+        input = pipeline->inputs[i];
+        mtdp_pipeline_flush_upstream(input, flush);
+        mtdp_pipeline_flush_pipe(&input->pipes[input->n_stages]);
+    }
+    mtdp_pipeline_flush_steps(pipeline);
+}
+
+static bool
+mtdp_pipeline_flush_linked(mtdp_pipeline* pipeline, void* context)
+{
+    mtdp_pipeline_flush_upstream(pipeline, *(uint32_t*)context);
+    return true;
+}
+
+/* Whether no buffer of the pipeline is held waiting for others, which a flush could wait for forever */
+static bool
+mtdp_pipeline_flushable(mtdp_pipeline* pipeline, void* context)
+{
+    const mtdp_pipe* pipe;
+
+    (void)context;
+    for(size_t i = 0; i != pipeline->n_stages + 1; ++i) {
+        pipe = &pipeline->pipes[i];
+        if(pipe->joiner || mtdp_pipe_sequenced(pipe)) {
+            *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+            return false;
+        }
+    }
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_flush(mtdp_pipeline* pipeline)
+{
+    static uint32_t flushes;
+    uint32_t        flush;
+
+    if(!pipeline) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(!pipeline->enabled) {
+        *mtdp_errno_ptr_mutable() = MTDP_NOT_ENABLED;
+        return false;
+    }
+    if(!pipeline->active) {
+        *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
+        return false;
+    }
+    if(!mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_flushable, NULL)) {
+        return false;
+    }
+    /* Every linked pipeline is flushed, each one after those its buffers come from. */
+    flush = ++flushes;
+    mtdp_pipeline_for_each_link(pipeline, mtdp_pipeline_flush_linked, &flush);
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
+
+/* Checks a stage may be spliced in or out, and whether the pipeline runs (false with the error set otherwise) */
+static bool
+mtdp_pipeline_check_splice(mtdp_pipeline* pipeline, size_t stage, bool spliced_out, bool* running)
+{
+    if(!pipeline) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(stage >= pipeline->n_stages || pipeline->stages[stage].spliced_out != spliced_out
+       || !mtdp_pipeline_spliceable(pipeline, stage)) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    if(pipeline->enabled && !pipeline->active) {
+        *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
+        return false;
+    }
+    *running = pipeline->enabled;
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_splice_out(mtdp_pipeline* pipeline, size_t stage)
+{
+    mtdp_pipeline_step producer, self, consumer;
+    mtdp_stage_impl*   stage_impl;
+    bool               running;
+
+    if(!mtdp_pipeline_check_splice(pipeline, stage, false, &running)) {
+        return false;
+    }
+    if(running) {
+        stage_impl = &pipeline->stage_impls[stage];
+        producer   = mtdp_pipeline_step_at(pipeline, mtdp_pipeline_producer(pipeline, stage));
+        self       = mtdp_pipeline_step_at(pipeline, stage + 1);
+        consumer   = mtdp_pipeline_step_at(pipeline, mtdp_pipeline_consumer(pipeline, stage));
+        /* Nothing enters the input pipe while the stage empties it, and nothing the output pipe while the consumer does. */
+        mtdp_pipeline_park(&producer);
+        mtdp_pipeline_drain(&self, &stage_impl->context.ready_to_push);
+        mtdp_stage_destroy(stage_impl);
+        mtdp_worker_join(&stage_impl->worker);
+        stage_impl->worker.pooled = true;
+        mtdp_pipeline_drain(&consumer, NULL);
+        /* The output claimed and not pushed goes back from the producer side, now that neither side of the pipe runs. */
+        if(stage_impl->context.output) {
+            mtdp_pipe_unclaim(stage_impl->output_pipe, stage_impl->context.output);
+            stage_impl->context.output = NULL;
+        }
+        *consumer.input_pipe = stage_impl->input_pipe;
+        mtdp_worker_enable(consumer.worker);
+        mtdp_worker_enable(producer.worker);
+    }
+    pipeline->stages[stage].spliced_out = true;
+    *mtdp_errno_ptr_mutable()           = MTDP_OK;
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_splice_in(mtdp_pipeline* pipeline, size_t stage)
+{
+    mtdp_pipeline_step producer, consumer;
+    mtdp_stage_impl*   stage_impl;
+    size_t             k;
+    bool               running;
+
+    if(!mtdp_pipeline_check_splice(pipeline, stage, true, &running)) {
+        return false;
+    }
+    if(running) {
+        stage_impl = &pipeline->stage_impls[stage];
+        k          = mtdp_pipeline_producer(pipeline, stage);
+        producer   = mtdp_pipeline_step_at(pipeline, k);
+        consumer   = mtdp_pipeline_step_at(pipeline, mtdp_pipeline_consumer(pipeline, stage));
+        mtdp_pipeline_park(&producer);
+        mtdp_pipeline_drain(&consumer, NULL);
+        *consumer.input_pipe      = stage_impl->output_pipe;
+        stage_impl->input_pipe    = &pipeline->pipes[k];
+        stage_impl->worker.pooled = false;
+        mtdp_stage_create_thread(stage_impl);
+        mtdp_worker_enable(&stage_impl->worker);
+        mtdp_worker_enable(consumer.worker);
+        mtdp_worker_enable(producer.worker);
+    }
+    pipeline->stages[stage].spliced_out = false;
+    *mtdp_errno_ptr_mutable()           = MTDP_OK;
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_swap_stage(mtdp_pipeline* pipeline, size_t stage, mtdp_stage_callback process, mtdp_stage_data self)
+{
+    mtdp_stage_impl* stage_impl;
+    size_t           replica = 0, replicas;
+
+    if(!pipeline || !process) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(stage >= pipeline->n_stages) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    if(pipeline->enabled && !pipeline->active) {
+        *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
+        return false;
+    }
+    /* Read again whenever the stage gets a thread: a stage spliced out or nested has nothing else to switch. */
+    pipeline->stages[stage].process = process;
+    pipeline->stages[stage].self    = self;
+    if(pipeline->enabled && !pipeline->stages[stage].spliced_out && !mtdp_pipeline_nested_at(pipeline, stage)) {
+        for(size_t i = 0; i != stage; ++i) {
+            replica += mtdp_pipeline_stage_replicas(pipeline, i) - 1;
+        }
+        replicas = mtdp_pipeline_stage_replicas(pipeline, stage);
+        for(size_t i = 0; i != replicas; ++i) {
+            stage_impl = i ? &pipeline->replica_impls[replica + i - 1] : &pipeline->stage_impls[stage];
+            mtdp_stage_request_swap(stage_impl, process, self);
+        }
+        /* Idle tasks only run again once scheduled. */
+        if(pipeline->executor) {
+            mtdp_executor_schedule_set(pipeline->executor, &pipeline->tasks);
+        }
+        for(size_t i = 0; i != replicas; ++i) {
+            mtdp_stage_wait_swap(i ? &pipeline->replica_impls[replica + i - 1] : &pipeline->stage_impls[stage]);
+        }
+    }
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_add_branch(mtdp_pipeline* pipeline, size_t pipe, mtdp_pipeline* branch)
+{
+    if(!pipeline || !branch) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(pipeline->enabled || branch->enabled) {
+        *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
+        return false;
+    }
+    /* The first pipe of a branch owns no buffers: it neither broadcasts nor merges them, nor is it merged. */
+    if(pipe > pipeline->n_stages || branch->trunk || branch->pipes[0].n_branches || branch->pipes[0].n_inputs
+       || (branch->merge && !branch->n_stages) || pipeline->pipes[pipe].upstream || pipeline->pipes[pipe].n_inputs
+       || pipeline->outer || branch->outer || branch->previous || (!pipe && pipeline->previous)
+       || mtdp_pipeline_reaches(branch, pipeline)) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    if(!mtdp_pipeline_list_add(&pipeline->branches, &pipeline->n_branches, branch)) {
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+        return false;
+    }
+    if(!mtdp_pipe_add_branch(&pipeline->pipes[pipe], &branch->pipes[0])) {
+        --pipeline->n_branches;
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+        return false;
+    }
+    branch->trunk             = pipeline;
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_remove_branch(mtdp_pipeline* pipeline, mtdp_pipeline* branch)
+{
+    if(!pipeline || !branch) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(branch->trunk != pipeline) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    if(pipeline->enabled) {
+        *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
+        return false;
+    }
+    mtdp_pipeline_unlink_branch(branch);
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_add_input(mtdp_pipeline* pipeline, size_t pipe, mtdp_pipeline* input)
+{
+    mtdp_pipe* last;
+
+    if(!pipeline || !input) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(pipeline->enabled || input->enabled) {
+        *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
+        return false;
+    }
+    /* Only pipes owning their buffers are merged, and the merged ones are not merged again. */
+    last = &input->pipes[input->n_stages];
+    if(pipe > pipeline->n_stages || input->merge || last->n_inputs || last->upstream || pipeline->pipes[pipe].upstream
+       || pipeline->pipes[pipe].n_branches || pipeline->outer || input->outer || input->next || (!pipe && pipeline->previous)
+       || (input->previous && !input->n_stages) || mtdp_pipeline_reaches(pipeline, input)) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    if(!mtdp_pipeline_list_add(&pipeline->inputs, &pipeline->n_inputs, input)) {
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+        return false;
+    }
+    if(!mtdp_pipe_add_input(&pipeline->pipes[pipe], last)) {
+        --pipeline->n_inputs;
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+        return false;
+    }
+    input->merge              = pipeline;
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_remove_input(mtdp_pipeline* pipeline, mtdp_pipeline* input)
+{
+    if(!pipeline || !input) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(input->merge != pipeline) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    if(pipeline->enabled) {
+        *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
+        return false;
+    }
+    mtdp_pipeline_unlink_input(input);
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_add_nested(mtdp_pipeline* pipeline, size_t stage, mtdp_pipeline* nested)
+{
+    const mtdp_pipeline* outer;
+
+    if(!pipeline || !nested) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(pipeline->enabled || nested->enabled) {
+        *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
+        return false;
+    }
+    /* Only the nested pipelines of its own may be linked to a nested pipeline, which shall not contain the outer one. */
+    outer = pipeline;
+    while(outer && outer != nested) {
+        outer = outer->outer;
+    }
+    if(stage >= pipeline->n_stages || !nested->n_stages || outer || mtdp_pipeline_nested_at(pipeline, stage)
+       || nested->trunk || nested->merge || nested->outer || nested->next || nested->previous || nested->n_branches
+       || nested->n_inputs) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    if(!mtdp_pipeline_list_add(&pipeline->nested, &pipeline->n_nested, nested)) {
+        *mtdp_errno_ptr_mutable() = MTDP_NO_MEM;
+        return false;
+    }
+    nested->outer             = pipeline;
+    nested->outer_stage       = stage;
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_remove_nested(mtdp_pipeline* pipeline, mtdp_pipeline* nested)
+{
+    if(!pipeline || !nested) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(nested->outer != pipeline) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    if(pipeline->enabled) {
+        *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
+        return false;
+    }
+    mtdp_pipeline_unlink_nested(nested);
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_bridge(mtdp_pipeline* from, mtdp_pipeline* to)
+{
+    if(!from || !to) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(from->enabled || to->enabled) {
+        *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
+        return false;
+    }
+    /* The last pipe of from is only drained by to, whose first pipe is left unused: it is not the last one too. */
+    if(from->next || from->merge || from->outer || (from->previous && !from->n_stages) || to->previous || to->trunk
+       || to->outer || to->pipes[0].n_branches || to->pipes[0].n_inputs || ((to->next || to->merge) && !to->n_stages)
+       || mtdp_pipeline_reaches(to, from)) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    from->next                = to;
+    to->previous              = from;
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
+
+MTDP_API_INTERNAL bool
+mtdp_pipeline_unbridge(mtdp_pipeline* from, mtdp_pipeline* to)
+{
+    if(!from || !to) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_PTR;
+        return false;
+    }
+    if(from->next != to) {
+        *mtdp_errno_ptr_mutable() = MTDP_BAD_CONFIG;
+        return false;
+    }
+    if(from->enabled) {
+        *mtdp_errno_ptr_mutable() = MTDP_ENABLED;
+        return false;
+    }
+    mtdp_pipeline_unlink_bridge(from);
+    *mtdp_errno_ptr_mutable() = MTDP_OK;
+    return true;
+}
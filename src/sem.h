@@ -13,9 +13,12 @@ GNU Lesser General Public License for more details.
 You should have received a copy of the GNU Lesser General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 
+
 #ifndef MTDP_SEM_H
 #define MTDP_SEM_H
 
+#include "futex.h"
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -23,75 +26,91 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #if defined(_WIN32)
 #  include <windows.h>
 #elif defined(__unix__)
-#  include <semaphore.h>
+#  include <time.h>
 #endif
 
+/*
+    Counting semaphore built on a futex, counting its waiters:
+    as long as nobody is sleeping on it, releasing and acquiring it
+    are plain atomic operations and never enter the kernel.
+*/
+typedef struct {
+    mtdp_futex      value;
+    atomic_uint32_t waiters;
+} mtdp_semaphore;
+
+static inline uint64_t
+mtdp_semaphore_now_us(void)
+{
 #if defined(_WIN32)
-typedef HANDLE mtdp_semaphore;
-#elif defined(__unix__)
-typedef sem_t mtdp_semaphore;
+    return (uint64_t)GetTickCount64() * 1000;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
 #endif
+}
 
-#if defined(__unix__)
-#  define mtdp_semaphore_init(sem)    (sem_init((sem), 0, 0) == 0)
-#  define mtdp_semaphore_destroy(sem) sem_destroy(sem)
-#  define mtdp_semaphore_release(sem, amount)                                                                                    \
-    do {                                                                                                                         \
-      int32_t am = (amount);                                                                                                     \
-      while(am--) {                                                                                                              \
-        sem_post(sem);                                                                                                           \
-      };                                                                                                                         \
-    } while(0)
-#  define mtdp_semaphore_acquire(self) sem_wait(sem)
-#  include <time.h>
-#  if defined(__GNUC__) && !MTDP_STRICT_ISO_C
-/* Since the following is a define, the -Wpedantic ISO C diagnostic ignore shall be added to every usage of the function
-#       if !defined(__clang__)
-#           pragma GCC diagnostic push
-#           pragma GCC diagnostic ignored "-Wpedantic"
-#       else
-#           pragma clang diagnostic push
-#           pragma clang diagnostic ignored "-Wpedantic"
-#       endif
-        */
-#    define mtdp_semaphore_try_acquire_for(sem, us)                                                                              \
-      ({                                                                                                                         \
-struct timespec ts;                                                                                                              \
-long            seconds = (us) / 1000000;                                                                                        \
-clock_gettime(CLOCK_REALTIME, &ts);                                                                                              \
-ts.tv_sec += seconds;                                                                                                            \
-ts.tv_nsec += ((us)-seconds * 1000000) * 1000;                                                                                   \
-ts.tv_sec += ts.tv_nsec / 1000000000;                                                                                            \
-ts.tv_nsec %= 1000000000;                                                                                                        \
-sem_timedwait((sem), &ts) == 0;                                                                                                  \
-      })
-/* Also remember to pop the diagnostic!
-#       if !defined(__clang__)
-#           pragma GCC diagnostic pop
-#       else
-#           pragma clang diagnostic pop
-#       endif
-        */
-#  else
-inline bool
-mtdp_semaphore_try_acquire_for(mtdp_semaphore* self, unsigned microseconds)
+static inline bool
+mtdp_semaphore_init(mtdp_semaphore* self)
 {
-    struct timespec ts;
-    unsigned        seconds = microseconds / 1000000;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    ts.tv_sec += seconds;
-    ts.tv_nsec += (microseconds - seconds * 1000000) * 1000;
-    ts.tv_sec += ts.tv_nsec / 1000000000;
-    ts.tv_nsec %= 1000000000;
-    return sem_timedwait(self, &ts) == 0;
+    atomic_store(&self->value, 0);
+    atomic_store(&self->waiters, 0);
+    return true;
+}
+
+#define mtdp_semaphore_destroy(sem) ((void)(sem))
+
+static inline void
+mtdp_semaphore_release(mtdp_semaphore* self, uint32_t amount)
+{
+    atomic_fetch_add(&self->value, amount);
+    /* Sequentially consistent with the increment of the waiters in mtdp_semaphore_try_acquire_for */
+    if(atomic_load(&self->waiters)) {
+        if(amount == 1) {
+            mtdp_futex_notify_one(&self->value);
+        }
+        else {
+            mtdp_futex_notify_all(&self->value);
+        }
+    }
+}
+
+static inline bool
+mtdp_semaphore_try_acquire(mtdp_semaphore* self)
+{
+    uint32_t value = atomic_load_explicit(&self->value, memory_order_relaxed);
+    while(value && !atomic_compare_exchange_weak_explicit(&self->value, &value, value - 1, memory_order_acquire,
+                                                          memory_order_relaxed)) {
+    }
+    return value != 0;
+}
+
+static inline bool
+mtdp_semaphore_try_acquire_for(mtdp_semaphore* self, uint64_t microseconds)
+{
+    uint64_t now, deadline;
+    bool     out;
+
+    if(mtdp_semaphore_try_acquire(self)) {
+        return true;
+    }
+    deadline = mtdp_semaphore_now_us() + microseconds;
+    atomic_fetch_add(&self->waiters, 1);
+    while(!(out = mtdp_semaphore_try_acquire(self)) && (now = mtdp_semaphore_now_us()) < deadline) {
+        mtdp_futex_wait_for(&self->value, 0, deadline - now);
+    }
+    atomic_fetch_sub(&self->waiters, 1);
+    return out;
+}
+
+/* Waits for the count to move from value, without acquiring anything, for a single consumer polling other conditions */
+static inline void
+mtdp_semaphore_wait_released(mtdp_semaphore* self, uint32_t value, uint64_t microseconds)
+{
+    atomic_fetch_add(&self->waiters, 1);
+    mtdp_futex_wait_for(&self->value, value, microseconds);
+    atomic_fetch_sub(&self->waiters, 1);
 }
-#  endif
-#elif defined(_WIN32)
-#  define mtdp_semaphore_init(p_sem)                (*(p_sem) = CreateSemaphoreA(NULL, 0, INT32_MAX, NULL))
-#  define mtdp_semaphore_destroy(p_sem)             CloseHandle(*(p_sem))
-#  define mtdp_semaphore_release(p_sem, update)     ReleaseSemaphore(*(p_sem), update, NULL)
-#  define mtdp_semaphore_acquire(p_sem)             WaitForSingleObject(*(p_sem), INFINITE)
-#  define mtdp_semaphore_try_acquire_for(p_sem, us) (WaitForSingleObject(*(p_sem), (us) / 1000) == WAIT_OBJECT_0)
-#endif
 
 #endif
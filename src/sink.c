@@ -36,46 +36,40 @@ along with this program.  If not, see  <http://www.gnu.org/licenses/>.  */
 static int
 mtdp_sink_routine(void* data)
 {
-    mtdp_sink_impl* self = (mtdp_sink_impl*)data;
+    mtdp_sink_impl* self     = (mtdp_sink_impl*)data;
+    int             progress = 0;
 
     if(self->context.ready_to_pull) {
         if(self->context.input) {
             if(mtdp_pipe_put_back(self->input_pipe, self->context.input)) {
                 self->context.input = NULL;
+                progress            = 1;
             }
             else {
-                mtdp_set_done(&self->done);
-                thrd_yield();
-                return 0;
+                mtdp_worker_set_done(&self->worker, &self->done);
+                mtdp_worker_yield(&self->worker);
+                return progress;
             }
         }
-#if defined(__GNUC__) && !MTDP_STRICT_ISO_C
-#  if !defined(__clang__)
-#    pragma GCC diagnostic push
-#    pragma GCC diagnostic ignored "-Wpedantic"
-#  else
-#    pragma clang diagnostic push
-#    pragma clang diagnostic ignored "-Wpedantic"
-#  endif
-#endif
-        if(!mtdp_semaphore_try_acquire_for(&self->input_pipe->semaphore, MTDP_PIPELINE_CONSUMER_TIMEOUT_US)) {
-#if defined(__GNUC__) && !MTDP_STRICT_ISO_C
-#  if !defined(__clang__)
-#    pragma GCC diagnostic pop
-#  else
-#    pragma clang diagnostic pop
-#  endif
-#endif
-            mtdp_set_done(&self->done);
-            thrd_yield();
-            return 0;
+        mtdp_pipe_let_go(self->input_pipe, &self->cycles);
+        if(!mtdp_pipe_wait_full(self->input_pipe, self->user_data.wait_policy, mtdp_worker_wait_us(&self->worker))) {
+            mtdp_worker_set_done(&self->worker, &self->done);
+            mtdp_worker_yield(&self->worker);
+            return progress;
         }
-        mtdp_unset_done(&self->done);
+        mtdp_worker_unset_done(&self->worker, &self->done);
+        mtdp_pipe_hold(&self->cycles);
         self->context.input = mtdp_pipe_get_full_buffer(self->input_pipe);
         if(unlikely(!self->context.input)) {
+            mtdp_pipe_let_go(self->input_pipe, &self->cycles);
+            /* The token of the end of stream is kept: waiting again simply times out. */
+            if(mtdp_pipe_ended(self->input_pipe)) {
+                mtdp_worker_set_done(&self->worker, &self->done);
+                return progress;
+            }
             mtdp_semaphore_release(&self->input_pipe->semaphore, 1);
-            thrd_yield();
-            return 0;
+            mtdp_worker_yield(&self->worker);
+            return progress;
         }
         self->context.ready_to_pull = false;
     }
@@ -87,12 +81,14 @@ mtdp_sink_routine(void* data)
             self->initialized = true;
         }
         self->user_data.process(&self->context);
+        progress = 1;
     }
     else {
         self->context.ready_to_pull = true;
-        thrd_yield();
+        progress                    = 1;
+        mtdp_worker_yield(&self->worker);
     }
-    return 0;
+    return progress;
 }
 
 void
@@ -103,6 +99,7 @@ mtdp_sink_create_thread(mtdp_sink_impl* self)
     self->context.ready_to_pull = true;
     self->context.input         = NULL;
     self->done                  = 0;
+    self->cycles                = 0;
     mtdp_worker_create_thread(&self->worker);
 }
 
@@ -118,17 +115,18 @@ mtdp_sink_configure(mtdp_sink_impl* self, mtdp_pipe* input_pipe)
 {
     self->initialized = false;
     mtdp_worker_init(&self->worker);
-    self->user_data.init = NULL;
-    self->user_data.name = NULL;
-    self->user_data.self = NULL;
-    self->worker.cb      = mtdp_sink_routine;
-    self->worker.args    = self;
-    self->input_pipe     = input_pipe;
+    self->user_data.init        = NULL;
+    self->user_data.name        = NULL;
+    self->user_data.self        = NULL;
+    self->user_data.wait_policy = MTDP_WAIT_BLOCK;
+    self->worker.cb             = mtdp_sink_routine;
+    self->worker.args           = self;
+    self->input_pipe            = input_pipe;
 }
 
 MTDP_API_INTERNAL bool
 mtdp_sink_stop_requested(mtdp_sink_context* ctx)
 {
     mtdp_sink_impl* self = (mtdp_sink_impl*)((char*)(ctx) + offsetof(mtdp_sink_impl, context));
-    return self->worker.destroyed || !self->worker.enabled;
+    return !mtdp_worker_running(&self->worker);
 }
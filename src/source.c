@@ -36,22 +36,24 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 static int
 mtdp_source_routine(void* data)
 {
-    mtdp_source_impl* self = (mtdp_source_impl*)data;
+    mtdp_source_impl* self     = (mtdp_source_impl*)data;
+    int               progress = 0;
 
     if(self->context.ready_to_push) {
         if(likely(mtdp_pipe_push_buffer(self->output_pipe, self->context.output))) {
-            mtdp_semaphore_release(&self->output_pipe->semaphore, 1);
+            mtdp_pipe_signal_full(self->output_pipe, 1);
             self->context.output        = NULL;
             self->context.ready_to_push = false;
+            progress                    = 1;
         }
         else {
-            mtdp_set_done(&self->done);
-            thrd_yield();
-            return 0;
+            mtdp_worker_set_done(&self->worker, &self->done);
+            mtdp_worker_yield(&self->worker);
+            return progress;
         }
     }
     if(!self->context.output) {
-        self->context.output = mtdp_pipe_get_empty_buffer(self->output_pipe);
+        self->context.output = mtdp_pipe_wait_empty_buffer(self->output_pipe, self->user_data.wait_policy, mtdp_worker_wait_us(&self->worker));
     }
 
     if(likely(self->context.output)) {
@@ -62,11 +64,9 @@ mtdp_source_routine(void* data)
             self->initialized = true;
         }
         self->user_data.process(&self->context);
+        progress = 1;
     }
-    else {
-        thrd_yield();
-    }
-    return 0;
+    return progress;
 }
 
 void
@@ -91,13 +91,14 @@ void
 mtdp_source_configure(mtdp_source_impl* self, mtdp_pipe* output_pipe)
 {
     mtdp_worker_init(&self->worker);
-    self->initialized    = false;
-    self->user_data.init = NULL;
-    self->user_data.name = NULL;
-    self->user_data.self = NULL;
-    self->worker.cb      = mtdp_source_routine;
-    self->worker.args    = self;
-    self->output_pipe    = output_pipe;
+    self->initialized           = false;
+    self->user_data.init        = NULL;
+    self->user_data.name        = NULL;
+    self->user_data.self        = NULL;
+    self->user_data.wait_policy = MTDP_WAIT_BLOCK;
+    self->worker.cb             = mtdp_source_routine;
+    self->worker.args           = self;
+    self->output_pipe           = output_pipe;
 }
 
 MTDP_API_INTERNAL void
@@ -106,11 +107,13 @@ mtdp_source_finished(mtdp_source_context* ctx)
     mtdp_source_impl* self = (mtdp_source_impl*)((char*)(ctx) + offsetof(mtdp_source_impl, context));
     mtdp_set_done(&self->done);
     mtdp_worker_destroy(&self->worker);
+    /* Nothing is pushed past this point: the end of stream runs down the pipes right behind the last buffer. */
+    mtdp_pipe_end(self->output_pipe);
 }
 
 MTDP_API_INTERNAL bool
 mtdp_source_stop_requested(mtdp_source_context* ctx)
 {
     mtdp_source_impl* self = (mtdp_source_impl*)((char*)(ctx) + offsetof(mtdp_source_impl, context));
-    return self->worker.destroyed || !self->worker.enabled;
+    return !mtdp_worker_running(&self->worker);
 }
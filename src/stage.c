@@ -17,6 +17,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "mtdp.h"
 #include "impl/stage.h"
 #include "impl/pipe.h"
+#include "impl/errno.h"
 // clang-format on
 
 #include "api.h"
@@ -24,6 +25,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "futex.h"
 #include "memory.h"
 
+#include <assert.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -79,57 +81,128 @@ mtdp_stage_impl_vector_destroy(mtdp_stage_impl_vector* vector)
 #endif
 }
 
+/* Fused stages wait and signal as the worker running them */
+#define mtdp_stage_runner(self)  ((self)->fused_into ? &(self)->fused_into->worker : &(self)->worker)
+#define mtdp_stage_wait_us(self) mtdp_worker_wait_us(mtdp_stage_runner(self))
+
+/* Pushes a buffer (or skips its sequence number if NULL, when ordered) on the output pipe */
+inline static bool
+mtdp_stage_push(mtdp_stage_impl* self, mtdp_buffer buf, size_t seq)
+{
+    size_t n_pushed = 1;
+
+    if(self->fused_next) {
+        /* Cleared before the push, so that the group is never seen done with a buffer in between. */
+        mtdp_worker_unset_done(mtdp_stage_runner(self), &self->fused_next->done);
+        return mtdp_pipe_push_buffer(self->output_pipe, buf);
+    }
+    if(self->ordered) {
+        if(!mtdp_pipe_push_buffer_ordered(self->output_pipe, buf, seq, &n_pushed)) {
+            return false;
+        }
+    }
+    else if(!mtdp_pipe_push_buffer(self->output_pipe, buf)) {
+        return false;
+    }
+    if(n_pushed) {
+        mtdp_pipe_signal_full(self->output_pipe, (uint32_t)n_pushed);
+    }
+    return true;
+}
+
+/* Switches to the callback of the pending swap, between two input buffers, and acknowledges it */
+static void
+mtdp_stage_swap(mtdp_stage_impl* self)
+{
+    self->process      = self->swap_process;
+    self->context.self = self->swap_self;
+    mtdp_unset_done(&self->swapping);
+}
+
+/*
+    Flags the stage done for good once its input pipe ended, ending its output pipe the first time.
+    Returns false if it already had: the end token pulled belongs to another replica.
+*/
+static bool
+mtdp_stage_end(mtdp_stage_impl* self)
+{
+    mtdp_worker_set_done(mtdp_stage_runner(self), &self->done);
+    if(self->ended) {
+        return false;
+    }
+    self->ended = true;
+    mtdp_pipe_end(self->output_pipe);
+    return true;
+}
+
 static int
 mtdp_stage_routine(void* data)
 {
-    mtdp_stage_impl* self = (mtdp_stage_impl*)data;
+    mtdp_stage_impl* self     = (mtdp_stage_impl*)data;
+    int              progress = 0;
 
     if(self->context.ready_to_push) {
-        if(likely(mtdp_pipe_push_buffer(self->output_pipe, self->context.output))) {
-            mtdp_semaphore_release(&self->output_pipe->semaphore, 1);
+        if(likely(mtdp_stage_push(self, self->context.output, self->output_seq))) {
             self->context.output        = NULL;
             self->context.ready_to_push = false;
+            progress                    = 1;
+            if(self->fused_next) {
+                /* The group processes the buffer before this stage may wait for its next input. */
+                return progress;
+            }
         }
         else {
-            mtdp_set_done(&self->done);
-            thrd_yield();
-            return 0;
+            mtdp_worker_set_done(mtdp_stage_runner(self), &self->done);
+            mtdp_worker_yield(&self->worker);
+            return progress;
         }
     }
     if(self->context.ready_to_pull) {
-#if defined(__GNUC__) && !MTDP_STRICT_ISO_C
-#  if !defined(__clang__)
-#    pragma GCC diagnostic push
-#    pragma GCC diagnostic ignored "-Wpedantic"
-#  else
-#    pragma clang diagnostic push
-#    pragma clang diagnostic ignored "-Wpedantic"
-#  endif
-#endif
-        if(!mtdp_semaphore_try_acquire_for(&self->input_pipe->semaphore, MTDP_PIPELINE_CONSUMER_TIMEOUT_US)) {
-#if defined(__GNUC__) && !MTDP_STRICT_ISO_C
-#  if !defined(__clang__)
-#    pragma GCC diagnostic pop
-#  else
-#    pragma clang diagnostic pop
-#  endif
-#endif
-            mtdp_set_done(&self->done);
-            thrd_yield();
-            return 0;
+        /* Nothing held anymore, and the outputs of the last input pushed. */
+        mtdp_pipe_let_go(self->input_pipe, &self->cycles);
+        if(unlikely(atomic_load_explicit(&self->swapping, memory_order_acquire))) {
+            mtdp_stage_swap(self);
+        }
+        /* Replicas take their output buffer before the input one, or those running ahead
+           could drain the output pipe while the one holding the oldest input waits. */
+        if(self->ordered && !self->context.output) {
+            self->context.output = mtdp_pipe_wait_empty_buffer(self->output_pipe, self->user_data->wait_policy, mtdp_stage_wait_us(self));
+            if(!self->context.output) {
+                mtdp_worker_set_done(mtdp_stage_runner(self), &self->done);
+                mtdp_worker_yield(&self->worker);
+                return progress;
+            }
+        }
+        if(!mtdp_pipe_wait_full(self->input_pipe, self->user_data->wait_policy, mtdp_stage_wait_us(self))) {
+            if(mtdp_pipe_ended(self->input_pipe)) {
+                mtdp_stage_end(self);
+            }
+            /* A fused stage runs dry after every buffer: it is only done once the whole group is. */
+            else if(!self->fused_into || atomic_load(&self->fused_into->done)) {
+                mtdp_worker_set_done(mtdp_stage_runner(self), &self->done);
+            }
+            mtdp_worker_yield(&self->worker);
+            return progress;
         }
-        mtdp_unset_done(&self->done);
-        self->context.input = mtdp_pipe_get_full_buffer(self->input_pipe);
+        mtdp_worker_unset_done(mtdp_stage_runner(self), &self->done);
+        mtdp_pipe_hold(&self->cycles);
+        self->context.input = mtdp_pipe_get_full_buffer_seq(self->input_pipe, &self->input_seq);
+        self->context.joined = mtdp_pipe_take_joined(self->input_pipe);
         if(unlikely(!self->context.input)) {
+            mtdp_pipe_let_go(self->input_pipe, &self->cycles);
+            /* The token of the end of stream is kept: waiting again simply times out. */
+            if(mtdp_pipe_ended(self->input_pipe) && mtdp_stage_end(self)) {
+                return progress;
+            }
             mtdp_semaphore_release(&self->input_pipe->semaphore, 1);
-            thrd_yield();
-            return 0;
+            mtdp_worker_yield(&self->worker);
+            return progress;
         }
         self->context.ready_to_pull = false;
     }
     if(self->context.input) {
         if(!self->context.output) {
-            self->context.output = mtdp_pipe_get_empty_buffer(self->output_pipe);
+            self->context.output = mtdp_pipe_wait_empty_buffer(self->output_pipe, self->user_data->wait_policy, mtdp_stage_wait_us(self));
         }
         if(likely(self->context.output)) {
             if(unlikely(!self->initialized)) {
@@ -138,20 +211,64 @@ mtdp_stage_routine(void* data)
                 }
                 self->initialized = true;
             }
-            self->user_data->process(&self->context);
+            self->process(&self->context);
+            progress = 1;
+            if(self->ordered && self->context.ready_to_push) {
+                if(unlikely(self->output_tagged)) {
+                    /* A second output would reuse the sequence number of the input, and never get through. */
+                    self->context.ready_to_push = false;
+                    *mtdp_errno_ptr_mutable()   = MTDP_BAD_CONFIG;
+                }
+                else {
+                    self->output_seq    = self->input_seq;
+                    self->output_tagged = true;
+                }
+            }
             if(self->context.ready_to_pull) {
+                if(self->ordered) {
+                    /* No output for this input: let the buffers following it through. */
+                    if(!self->output_tagged) {
+                        mtdp_stage_push(self, NULL, self->input_seq);
+                    }
+                    self->output_tagged = false;
+                }
                 mtdp_pipe_put_back(self->input_pipe, self->context.input);
                 self->context.input = NULL;
+                if(self->context.joined) {
+                    mtdp_pipe_put_back(self->input_pipe, self->context.joined);
+                    self->context.joined = NULL;
+                }
             }
         }
-        else {
-            thrd_yield();
-        }
     }
     else {
         self->context.ready_to_pull = true;
+        progress                    = 1;
     }
-    return 0;
+    return progress;
+}
+
+/*
+    Routine of the first stage of a fusion group. The following stages are run until none
+    of them can proceed, so that no buffer is left in the bypassed pipes while the first one
+    waits for its input.
+*/
+static int
+mtdp_stage_fused_routine(void* data)
+{
+    mtdp_stage_impl* self     = (mtdp_stage_impl*)data;
+    int              progress = mtdp_stage_routine(self), group_progress;
+
+    do {
+        group_progress = 0;
+        for(mtdp_stage_impl* next = self->fused_next; next && mtdp_worker_running(&self->worker); next = next->fused_next) {
+            while(mtdp_worker_running(&next->worker) && mtdp_stage_routine(next)) {
+                group_progress = 1;
+            }
+        }
+        progress |= group_progress;
+    } while(group_progress);
+    return progress;
 }
 
 void
@@ -161,11 +278,32 @@ mtdp_stage_create_thread(mtdp_stage_impl* self)
     self->context.self          = self->user_data->self;
     self->context.ready_to_pull = true;
     self->context.ready_to_push = false;
-    self->context.input = self->context.output = NULL;
+    self->context.input = self->context.output = self->context.joined = NULL;
+    self->output_tagged                        = false;
+    self->ended                                = false;
+    self->cycles                               = 0;
     self->done                                 = 0;
+    self->process                              = self->user_data->process;
+    self->swapping                             = 0;
     mtdp_worker_create_thread(&self->worker);
 }
 
+void
+mtdp_stage_request_swap(mtdp_stage_impl* self, mtdp_stage_callback process, mtdp_stage_data data)
+{
+    self->swap_process = process;
+    self->swap_self    = data;
+    atomic_store_explicit(&self->swapping, 1, memory_order_release);
+}
+
+void
+mtdp_stage_wait_swap(mtdp_stage_impl* self)
+{
+    while(atomic_load_explicit(&self->swapping, memory_order_acquire)) {
+        mtdp_futex_wait(&self->swapping, 1);
+    }
+}
+
 void
 mtdp_stage_destroy(mtdp_stage_impl* self)
 {
@@ -177,20 +315,65 @@ void
 mtdp_stage_configure(mtdp_stage_impl* self, mtdp_pipe* input_pipe, mtdp_pipe* output_pipe, mtdp_stage* user_data)
 {
     mtdp_worker_init(&self->worker);
-    self->initialized     = false;
-    self->user_data       = user_data;
-    self->user_data->init = NULL;
-    self->user_data->name = NULL;
-    self->user_data->self = NULL;
-    self->worker.cb       = mtdp_stage_routine;
-    self->worker.args     = self;
-    self->input_pipe      = input_pipe;
-    self->output_pipe     = output_pipe;
+    self->initialized            = false;
+    self->user_data              = user_data;
+    self->user_data->init        = NULL;
+    self->user_data->name        = NULL;
+    self->user_data->self        = NULL;
+    self->user_data->wait_policy = MTDP_WAIT_BLOCK;
+    self->user_data->replicas    = 1;
+    self->user_data->unordered   = false;
+    self->user_data->fused       = false;
+    self->user_data->spliced_out = false;
+    self->ordered                = false;
+    self->fused_into             = NULL;
+    self->fused_next             = NULL;
+    self->worker.cb              = mtdp_stage_routine;
+    self->worker.args            = self;
+    self->input_pipe             = input_pipe;
+    self->output_pipe            = output_pipe;
+}
+
+void
+mtdp_stage_replicate(mtdp_stage_impl* self, const mtdp_stage_impl* primary)
+{
+    *self = *primary;
+    mtdp_worker_init(&self->worker);
+    self->worker.cb   = mtdp_stage_routine;
+    self->worker.args = self;
+    self->initialized = false;
+}
+
+void
+mtdp_stage_fuse(mtdp_stage_impl* self, mtdp_stage_impl* head)
+{
+    mtdp_stage_impl* tail = head;
+
+    while(tail->fused_next) {
+        tail = tail->fused_next;
+    }
+    tail->fused_next        = self;
+    self->fused_into        = head;
+    self->input_pipe->local = true;
+    /* No thread of its own: the worker is only enabled and disabled along with the pipeline. */
+    self->worker.pooled = true;
+    head->worker.cb     = mtdp_stage_fused_routine;
+}
+
+void
+mtdp_stage_unfuse(mtdp_stage_impl* self)
+{
+    if(self->fused_into) {
+        self->input_pipe->local = false;
+        self->worker.pooled     = false;
+    }
+    self->fused_into = self->fused_next = NULL;
+    self->worker.cb                     = mtdp_stage_routine;
 }
 
 MTDP_API_INTERNAL bool
 mtdp_stage_stop_requested(mtdp_stage_context* ctx)
 {
     mtdp_stage_impl* self = (mtdp_stage_impl*)((char*)(ctx) + offsetof(mtdp_stage_impl, context));
-    return self->worker.destroyed || !self->worker.enabled;
+    return !mtdp_worker_running(&self->worker);
 }
\ No newline at end of file
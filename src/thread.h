@@ -92,8 +92,23 @@ typedef CONDITION_VARIABLE cnd_t;
 
 #elif __unix__
 #  include <threads.h>
+#  include <unistd.h>
 #else
 #  error threads not implemented on this platform
 #endif
 
+/* Number of processors available, at least 1 */
+static inline size_t
+mtdp_thread_hardware_concurrency(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (size_t)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+#endif
+}
+
 #endif
\ No newline at end of file
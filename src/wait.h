@@ -0,0 +1,49 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+mtdp is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+mtdp is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+
+#ifndef MTDP_WAIT_IMPL_H
+#define MTDP_WAIT_IMPL_H
+
+#include "mtdp/wait.h"
+#include "thread.h"
+
+#if defined(_WIN32)
+#  include <windows.h>
+#  define mtdp_cpu_relax() YieldProcessor()
+#elif defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define mtdp_cpu_relax() _mm_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#  define mtdp_cpu_relax() __asm__ __volatile__("yield")
+#else
+#  define mtdp_cpu_relax() ((void)0)
+#endif
+
+/* Number of polls between two reads of the clock when spinning until a deadline */
+#define MTDP_WAIT_POLLS_PER_CLOCK_READ 64
+
+static inline void
+mtdp_wait_relax(mtdp_wait_policy policy)
+{
+    if(policy == MTDP_WAIT_SPIN) {
+        mtdp_cpu_relax();
+    }
+    else {
+        thrd_yield();
+    }
+}
+
+#endif
@@ -41,22 +41,6 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
       return false;                                                                                                              \
     }                                                                                                                            \
   } while(false)
-#define mtx_check(X)                                                                                                             \
-  do {                                                                                                                           \
-    int ret = (X);                                                                                                               \
-    if(ret != thrd_success) {                                                                                                    \
-      *mtdp_errno_ptr_mutable() = (ret == thrd_nomem ? MTDP_NO_MEM : MTDP_MTX_ERROR);                                            \
-      return false;                                                                                                              \
-    }                                                                                                                            \
-  } while(false)
-#define cnd_check(X)                                                                                                             \
-  do {                                                                                                                           \
-    int ret = (X);                                                                                                               \
-    if(ret != thrd_success) {                                                                                                    \
-      *mtdp_errno_ptr_mutable() = (ret == thrd_nomem ? MTDP_NO_MEM : MTDP_CND_ERROR);                                            \
-      return false;                                                                                                              \
-    }                                                                                                                            \
-  } while(false)
 
 #if defined(_WIN32)
 #  define MTDP_WORKER_RETURN DWORD
@@ -83,16 +67,17 @@ mtdp_worker_routine(void* data)
 #endif
     }
 
-    while(!worker->destroyed) {
-        mtx_check(mtx_lock(&worker->mutex));
-        while(!(worker->enabled || worker->destroyed)) {
-            cnd_check(cnd_wait(&worker->cv, &worker->mutex));
+    for(uint32_t state; (state = atomic_load(&worker->state)) != MTDP_WORKER_DESTROYED;) {
+        if(state == MTDP_WORKER_ENABLED) {
+            worker->cb(worker->args);
         }
-        mtx_check(mtx_unlock(&worker->mutex));
-        if(worker->destroyed) {
-            break;
+        else {
+            state = MTDP_WORKER_DISABLED;
+            if(atomic_compare_exchange_strong(&worker->state, &state, MTDP_WORKER_PARKED)) {
+                mtdp_futex_notify_all(&worker->state);
+            }
+            mtdp_futex_wait(&worker->state, MTDP_WORKER_PARKED);
         }
-        worker->cb(worker->args);
     }
     thrd_exit(0);
 }
@@ -100,71 +85,71 @@ mtdp_worker_routine(void* data)
 bool
 mtdp_worker_init(mtdp_worker* worker)
 {
-    int out;
-
-    worker->enabled   = false;
-    worker->destroyed = false;
-    cnd_check(cnd_init(&worker->cv));
-    if((out = mtx_init(&worker->mutex, mtx_plain)) != thrd_success) {
-        /* No macro here, I have to destroy the cv. */
-        cnd_destroy(&worker->cv);
-        *mtdp_errno_ptr_mutable() = (out == thrd_nomem ? MTDP_NO_MEM : MTDP_MTX_ERROR);
-        return false;
-    }
-    worker->name = NULL;
-    worker->cb   = NULL;
-    worker->args = NULL;
+    atomic_store(&worker->state, MTDP_WORKER_DISABLED);
+    worker->pooled = false;
+    worker->name   = NULL;
+    worker->cb     = NULL;
+    worker->args   = NULL;
     return true;
 }
 
 bool
 mtdp_worker_create_thread(mtdp_worker* worker)
 {
-    thrd_check(thrd_create(&worker->thread, mtdp_worker_routine, worker));
+    /* A worker may be recreated after having been destroyed. */
+    atomic_store(&worker->state, MTDP_WORKER_DISABLED);
+    if(!worker->pooled) {
+        thrd_check(thrd_create(&worker->thread, mtdp_worker_routine, worker));
+    }
     return true;
 }
 
 bool
 mtdp_worker_enable(mtdp_worker* worker)
 {
-    mtx_check(mtx_lock(&worker->mutex));
-    worker->enabled = true;
-    /* This is terribly wrong: a deadlock is occurring here.
-        The best we can do right now is to notify the user
-        with an error code but a better error handling strategy
-        shall be provided. */
-    mtx_check(mtx_unlock(&worker->mutex));
-    cnd_check(cnd_signal(&worker->cv));
-    return true;
+    uint32_t expected = MTDP_WORKER_DISABLED;
+    if(atomic_compare_exchange_strong(&worker->state, &expected, MTDP_WORKER_ENABLED) ||
+       (expected == MTDP_WORKER_PARKED && atomic_compare_exchange_strong(&worker->state, &expected, MTDP_WORKER_ENABLED))) {
+        mtdp_futex_notify_all(&worker->state);
+    }
+    return expected != MTDP_WORKER_DESTROYED;
 }
 
 bool
 mtdp_worker_disable(mtdp_worker* worker)
 {
-    mtx_check(mtx_lock(&worker->mutex));
-    worker->enabled = false;
-    /* This is terribly wrong: a deadlock is occurring here.
-        The best we can do right now is to notify the user
-        with an error code but a better error handling strategy
-        shall be provided. */
-    mtx_check(mtx_unlock(&worker->mutex));
-    cnd_check(cnd_signal(&worker->cv));
-    return true;
+    /* The worker only sleeps while disabled: nobody to wake up here. */
+    uint32_t expected = MTDP_WORKER_ENABLED;
+    atomic_compare_exchange_strong(&worker->state, &expected, MTDP_WORKER_DISABLED);
+    return expected != MTDP_WORKER_DESTROYED;
+}
+
+void
+mtdp_worker_wait_parked(mtdp_worker* worker)
+{
+    if(!worker->pooled) {
+        while(atomic_load(&worker->state) == MTDP_WORKER_DISABLED) {
+            mtdp_futex_wait(&worker->state, MTDP_WORKER_DISABLED);
+        }
+    }
 }
 
 bool
 mtdp_worker_destroy(mtdp_worker* worker)
 {
-    mtx_check(mtx_lock(&worker->mutex));
-    worker->destroyed = true;
-    mtx_check(mtx_unlock(&worker->mutex));
-    cnd_check(cnd_signal(&worker->cv));
+    uint32_t state = atomic_exchange(&worker->state, MTDP_WORKER_DESTROYED);
+    if(state == MTDP_WORKER_DISABLED || state == MTDP_WORKER_PARKED) {
+        mtdp_futex_notify_all(&worker->state);
+    }
     return true;
 }
 
 bool
 mtdp_worker_join(mtdp_worker* worker)
 {
+    if(worker->pooled) {
+        return true;
+    }
     thrd_check(thrd_join(worker->thread, NULL));
     return true;
 }
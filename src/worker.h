@@ -17,17 +17,31 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
 #define MTDP_WORKER_H
 
 #include "atomic.h"
+#include "bell.h"
+#include "futex.h"
 #include "thread.h"
 
 #include <stdbool.h>
 
+/*
+    Run-state of a worker. DESTROYED is final: neither enable nor disable may leave it.
+    A disabled thread moves itself to PARKED once its iteration is over and it goes to sleep.
+*/
+enum {
+    MTDP_WORKER_DISABLED,
+    MTDP_WORKER_ENABLED,
+    MTDP_WORKER_DESTROYED,
+    MTDP_WORKER_PARKED
+};
+
 typedef struct {
-    thrd_t thread;
-    cnd_t  cv;
-    mtx_t  mutex;
-    bool   enabled, destroyed;
+    thrd_t     thread;
+    mtdp_futex state;
+    /* A pooled worker has no thread: its callback is run by an executor, and it shall never block. */
+    bool pooled;
 
     const char*  name;
+    /* One iteration of the worker, returning nonzero if it made any progress */
     thrd_start_t cb;
     void*        args;
 } mtdp_worker;
@@ -36,7 +50,43 @@ bool mtdp_worker_init(mtdp_worker* worker);
 bool mtdp_worker_create_thread(mtdp_worker* worker);
 bool mtdp_worker_enable(mtdp_worker* worker);
 bool mtdp_worker_disable(mtdp_worker* worker);
+/* Waits for the thread of a disabled worker to be parked: it runs no iteration until enabled again. */
+void mtdp_worker_wait_parked(mtdp_worker* worker);
 bool mtdp_worker_destroy(mtdp_worker* worker);
 bool mtdp_worker_join(mtdp_worker* worker);
 
+#define mtdp_worker_running(worker) (atomic_load(&(worker)->state) == MTDP_WORKER_ENABLED)
+
+/* How long the callback may wait for buffers, 0 meaning to poll once */
+#define mtdp_worker_wait_us(worker) ((worker)->pooled ? 0 : MTDP_PIPELINE_CONSUMER_TIMEOUT_US)
+
+/* Executor tasks are waited for through their executor: their done flags are flipped without wakeups */
+#define mtdp_worker_set_done(worker, ftx)                                                                                        \
+  do {                                                                                                                           \
+    if((worker)->pooled) {                                                                                                       \
+      atomic_store((ftx), 1);                                                                                                    \
+    }                                                                                                                            \
+    else {                                                                                                                       \
+      mtdp_set_done(ftx);                                                                                                        \
+    }                                                                                                                            \
+  } while(0)
+
+#define mtdp_worker_unset_done(worker, ftx)                                                                                      \
+  do {                                                                                                                           \
+    if((worker)->pooled) {                                                                                                       \
+      atomic_store((ftx), 0);                                                                                                    \
+    }                                                                                                                            \
+    else {                                                                                                                       \
+      mtdp_unset_done(ftx);                                                                                                      \
+    }                                                                                                                            \
+  } while(0)
+
+/* Gives the CPU away after a failed iteration, unless an executor takes care of that */
+#define mtdp_worker_yield(worker)                                                                                                \
+  do {                                                                                                                           \
+    if(!(worker)->pooled) {                                                                                                      \
+      thrd_yield();                                                                                                              \
+    }                                                                                                                            \
+  } while(0)
+
 #endif
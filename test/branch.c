@@ -0,0 +1,168 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define BRANCHES 3
+#define BUFFERS  8
+#define ITEMS    10000
+
+/* Every sink checks it receives the whole stream, in order. */
+typedef struct {
+    size_t produced, consumed, errors;
+} stream;
+
+static stream         streams[BRANCHES + 1];
+static mtdp_pipeline* trunk;
+static mtdp_pipeline* branches[BRANCHES];
+
+static void produce(mtdp_source_context* context)
+{
+    stream* s = (stream*)context->self;
+    if(s->produced == ITEMS) {
+        mtdp_source_finished(context);
+        return;
+    }
+    *(size_t*)context->output = s->produced++;
+    context->ready_to_push    = true;
+}
+
+static void copy(mtdp_stage_context* context)
+{
+    *(size_t*)context->output = *(size_t*)context->input;
+    context->ready_to_pull = context->ready_to_push = true;
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    stream* s = (stream*)context->self;
+    s->errors += *(size_t*)context->input != s->consumed++;
+    context->ready_to_pull = true;
+}
+
+static mtdp_pipeline* create(size_t stages, stream* s, bool fed)
+{
+    mtdp_pipeline* pipeline = fixture_create(stages, produce, copy, consume);
+
+    mtdp_pipeline_get_source(pipeline)->self = s;
+    mtdp_pipeline_get_sink(pipeline)->self   = s;
+    /* The first pipe of a branch has no buffers of its own. */
+    fixture_fill(pipeline, fed, stages, BUFFERS, sizeof(size_t));
+    return pipeline;
+}
+
+void setUp()
+{
+    memset(streams, 0, sizeof(streams));
+    trunk = create(2, &streams[0], false);
+    for(size_t i = 0; i != BRANCHES; ++i) {
+        branches[i] = create(i, &streams[i + 1], true);
+        mtdp_pipeline_add_branch(trunk, 1 + i % 2, branches[i]);
+    }
+}
+
+void tearDown()
+{
+    for(size_t i = 0; i != BRANCHES; ++i) {
+        fixture_destroy(branches[i]);
+    }
+    fixture_destroy(trunk);
+}
+
+void test_branches_see_the_whole_stream()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(trunk));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(trunk));
+    mtdp_pipeline_wait(trunk);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(trunk));
+    for(size_t i = 0; i != BRANCHES + 1; ++i) {
+        TEST_ASSERT_EQUAL(ITEMS, streams[i].consumed);
+        TEST_ASSERT_EQUAL(0, streams[i].errors);
+    }
+}
+
+void test_broadcast_buffers_return_to_the_trunk()
+{
+    mtdp_pipeline_enable(trunk);
+    mtdp_pipeline_start(trunk);
+    mtdp_pipeline_disable(trunk);
+    for(size_t i = 0; i != 3; ++i) {
+        TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&trunk->pipes[i].pool));
+    }
+    TEST_ASSERT_EQUAL(0, mtdp_buffer_pool_size(&branches[0]->pipes[0].pool));
+}
+
+void test_branches_follow_the_trunk()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(branches[0]));
+    TEST_ASSERT_TRUE(trunk->enabled);
+    TEST_ASSERT_TRUE(branches[2]->enabled);
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(branches[1]));
+    TEST_ASSERT_TRUE(trunk->active);
+    TEST_ASSERT_FALSE(mtdp_pipeline_remove_branch(trunk, branches[0]));
+    TEST_ASSERT_EQUAL(MTDP_ENABLED, mtdp_errno);
+    mtdp_pipeline_wait(branches[2]);
+    TEST_ASSERT_EQUAL(ITEMS, streams[0].consumed);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(branches[0]));
+    TEST_ASSERT_FALSE(trunk->enabled);
+    TEST_ASSERT_FALSE(branches[1]->enabled);
+}
+
+void test_add_branch_rejects_cycles()
+{
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_branch(branches[1], 1, trunk));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_branch(branches[2], 2, branches[1]));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_branch(branches[1], 0, branches[2]));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_branch(trunk, 3, branches[2]));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+}
+
+void test_removed_branch_is_standalone()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_remove_branch(trunk, branches[0]));
+    TEST_ASSERT_NULL(branches[0]->trunk);
+    TEST_ASSERT_NULL(branches[0]->pipes[0].upstream);
+    TEST_ASSERT_EQUAL(1, trunk->pipes[1].n_branches);
+    TEST_ASSERT_FALSE(mtdp_pipeline_remove_branch(trunk, branches[0]));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+}
+
+void test_ring_pipes_cannot_be_broadcast()
+{
+    mtdp_pipe_set_transport(&trunk->pipes[1], MTDP_PIPE_TRANSPORT_RING);
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(trunk));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    mtdp_pipe_set_transport(&trunk->pipes[1], MTDP_PIPE_TRANSPORT_MPMC);
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(trunk));
+    mtdp_pipeline_disable(trunk);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_branches_see_the_whole_stream);
+    RUN_TEST(test_broadcast_buffers_return_to_the_trunk);
+    RUN_TEST(test_branches_follow_the_trunk);
+    RUN_TEST(test_add_branch_rejects_cycles);
+    RUN_TEST(test_removed_branch_is_standalone);
+    RUN_TEST(test_ring_pipes_cannot_be_broadcast);
+    UNITY_END();
+}
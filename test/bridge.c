@@ -0,0 +1,174 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define BUFFERS 8
+#define ITEMS   10000
+
+/* Every stage adds one to the item: the sink of the last pipeline checks they all arrive in order, through every stage. */
+static mtdp_pipeline* from;
+static mtdp_pipeline* to;
+
+static void increment(mtdp_stage_context* context)
+{
+    *(size_t*)context->output = *(size_t*)context->input + 1;
+    context->ready_to_pull = context->ready_to_push = true;
+}
+
+/* The first pipe only gets buffers if the pipeline has a source of its own */
+static mtdp_pipeline* create(size_t stages, bool source)
+{
+    mtdp_pipeline* pipeline = fixture_create(stages, fixture_produce, increment, fixture_consume);
+
+    fixture_fill(pipeline, !source, stages, BUFFERS, sizeof(size_t));
+    return pipeline;
+}
+
+static void run(mtdp_pipeline* pipeline)
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(from->enabled && to->enabled);
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(0, fixture_stream.errors);
+    /* The buffers crossing the bridge went back to the pool of the previous pipeline. */
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&from->pipes[from->n_stages].pool));
+    TEST_ASSERT_EQUAL(0, mtdp_buffer_pool_size(&to->pipes[0].pool));
+}
+
+void setUp()
+{
+    fixture_stream_reset(ITEMS);
+    fixture_stream.offset = 3;
+    from                  = create(1, true);
+    to                    = create(2, false);
+}
+
+void tearDown()
+{
+    fixture_destroy(to);
+    fixture_destroy(from);
+}
+
+void test_bridged_pipelines_run_as_one()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_bridge(from, to));
+    run(to);
+}
+
+void test_bridge_to_a_sink()
+{
+    fixture_destroy(to);
+    to                    = create(0, false);
+    fixture_stream.offset = 1;
+    TEST_ASSERT_TRUE(mtdp_pipeline_bridge(from, to));
+    run(from);
+}
+
+void test_bridge_across_lock_free_pipes()
+{
+    mtdp_pipe_set_transport(&from->pipes[1], MTDP_PIPE_TRANSPORT_SPSC);
+    TEST_ASSERT_TRUE(mtdp_pipeline_bridge(from, to));
+    run(from);
+    fixture_stream.consumed = fixture_stream.produced = 0;
+    mtdp_pipe_set_transport(&from->pipes[1], MTDP_PIPE_TRANSPORT_RING);
+    run(to);
+}
+
+void test_chained_bridges()
+{
+    mtdp_pipeline* last = create(1, false);
+
+    fixture_stream.offset = 4;
+    TEST_ASSERT_TRUE(mtdp_pipeline_bridge(from, to));
+    TEST_ASSERT_TRUE(mtdp_pipeline_bridge(to, last));
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(from));
+    TEST_ASSERT_TRUE(last->enabled);
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(last));
+    mtdp_pipeline_wait(to);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(from));
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(0, fixture_stream.errors);
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&to->pipes[2].pool));
+    fixture_destroy(last);
+    TEST_ASSERT_NULL(to->next);
+}
+
+void test_unbridged_pipelines_run_alone()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_bridge(from, to));
+    TEST_ASSERT_TRUE(mtdp_pipeline_unbridge(from, to));
+    fixture_stream.offset = 1;
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(from));
+    TEST_ASSERT_FALSE(to->enabled);
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(from));
+    mtdp_pipeline_wait(from);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(from));
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(0, fixture_stream.errors);
+}
+
+void test_bridge_rejects_bad_links()
+{
+    mtdp_pipeline* empty = create(0, false);
+
+    TEST_ASSERT_FALSE(mtdp_pipeline_bridge(from, NULL));
+    TEST_ASSERT_EQUAL(MTDP_BAD_PTR, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_bridge(from, from));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_TRUE(mtdp_pipeline_bridge(from, empty));
+    /* A pipeline without stages has a single pipe: it cannot be drained by a bridge and a sink at once. */
+    TEST_ASSERT_FALSE(mtdp_pipeline_bridge(empty, to));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_bridge(from, to));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_unbridge(from, to));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    fixture_destroy(empty);
+    TEST_ASSERT_NULL(from->next);
+    TEST_ASSERT_TRUE(mtdp_pipeline_bridge(from, to));
+    TEST_ASSERT_FALSE(mtdp_pipeline_bridge(to, from));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_branch(to, 0, from));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+}
+
+void test_first_stage_of_a_bridged_pipeline_is_not_replicated()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_bridge(from, to));
+    mtdp_pipeline_get_stages(to)[0].replicas = 2;
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(from));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(to->enabled);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_bridged_pipelines_run_as_one);
+    RUN_TEST(test_bridge_to_a_sink);
+    RUN_TEST(test_bridge_across_lock_free_pipes);
+    RUN_TEST(test_chained_bridges);
+    RUN_TEST(test_unbridged_pipelines_run_alone);
+    RUN_TEST(test_bridge_rejects_bad_links);
+    RUN_TEST(test_first_stage_of_a_bridged_pipeline_is_not_replicated);
+    UNITY_END();
+}
@@ -0,0 +1,124 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define BUFFERS 4
+#define EXTRA   12
+#define ITEMS   100000
+#define ROUNDS  50
+
+static mtdp_pipeline* pipeline;
+
+void setUp()
+{
+    fixture_stream_reset(ITEMS);
+    pipeline = fixture_create(1, fixture_produce, fixture_pass, fixture_consume);
+    fixture_fill(pipeline, 0, 1, BUFFERS, sizeof(size_t));
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+void test_pipe_grows_and_shrinks_while_running()
+{
+    mtdp_buffer extra[EXTRA];
+    size_t      retired;
+
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    for(size_t round = 0; round != ROUNDS; ++round) {
+        for(size_t i = 0; i != EXTRA; ++i) {
+            extra[i] = malloc(sizeof(size_t));
+        }
+        TEST_ASSERT_TRUE(mtdp_pipe_add_buffers(&pipeline->pipes[0], extra, EXTRA));
+        thrd_yield();
+        /* Buffers in use are retired later, once they are back in the pool. */
+        for(retired = 0; retired != EXTRA; thrd_yield()) {
+            retired += mtdp_pipe_remove_buffers(&pipeline->pipes[0], extra + retired, EXTRA - retired);
+        }
+        for(size_t i = 0; i != EXTRA; ++i) {
+            free(extra[i]);
+        }
+    }
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(0, fixture_stream.errors);
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&pipeline->pipes[0].pool));
+}
+
+void test_added_buffers_are_used()
+{
+    mtdp_buffer extra[EXTRA];
+
+    for(size_t i = 0; i != EXTRA; ++i) {
+        extra[i] = malloc(sizeof(size_t));
+    }
+    TEST_ASSERT_TRUE(mtdp_pipe_add_buffers(&pipeline->pipes[1], extra, EXTRA));
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(BUFFERS + EXTRA, mtdp_buffer_pool_size(&pipeline->pipes[1].pool));
+}
+
+void test_pipe_keeps_a_buffer_per_thread()
+{
+    mtdp_buffer retired[BUFFERS];
+
+    /* One source pushing to the pipe, and two replicas pulling from it: three buffers are kept. */
+    mtdp_pipeline_get_stages(pipeline)->replicas = 2;
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_EQUAL(1, mtdp_pipe_remove_buffers(&pipeline->pipes[0], retired, BUFFERS));
+    TEST_ASSERT_EQUAL(0, mtdp_pipe_remove_buffers(&pipeline->pipes[0], retired + 1, BUFFERS - 1));
+    free(retired[0]);
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(BUFFERS - 1, mtdp_buffer_pool_size(&pipeline->pipes[0].pool));
+}
+
+void test_only_locked_pipes_are_elastic()
+{
+    mtdp_buffer buffer = NULL;
+
+    TEST_ASSERT_FALSE(mtdp_pipe_add_buffers(NULL, &buffer, 1));
+    TEST_ASSERT_EQUAL(MTDP_BAD_PTR, mtdp_errno);
+    TEST_ASSERT_EQUAL(0, mtdp_pipe_remove_buffers(&pipeline->pipes[0], NULL, 1));
+    TEST_ASSERT_EQUAL(MTDP_BAD_PTR, mtdp_errno);
+    mtdp_pipe_set_transport(&pipeline->pipes[0], MTDP_PIPE_TRANSPORT_MPMC);
+    TEST_ASSERT_FALSE(mtdp_pipe_add_buffers(&pipeline->pipes[0], &buffer, 1));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_EQUAL(0, mtdp_pipe_remove_buffers(&pipeline->pipes[0], &buffer, 1));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_pipe_grows_and_shrinks_while_running);
+    RUN_TEST(test_added_buffers_are_used);
+    RUN_TEST(test_pipe_keeps_a_buffer_per_thread);
+    RUN_TEST(test_only_locked_pipes_are_elastic);
+    UNITY_END();
+}
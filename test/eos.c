@@ -0,0 +1,174 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "fixture.h"
+#include "sem.h"
+
+#define STAGES  3
+#define BUFFERS 8
+#define ITEMS   1000
+
+/*
+    Every stage adds one to the item and the sink checks they all arrive. A finite stream shall be
+    waited for as soon as its last buffer reaches the sink: well before any step could time out.
+*/
+static size_t         consumed, errors, expected, merged, branched;
+static mtdp_pipeline* pipeline;
+
+static void produce_input(mtdp_source_context* context)
+{
+    if(merged == ITEMS) {
+        mtdp_source_finished(context);
+        return;
+    }
+    *(size_t*)context->output = merged++;
+    context->ready_to_push    = true;
+}
+
+static void increment(mtdp_stage_context* context)
+{
+    *(size_t*)context->output = *(size_t*)context->input + 1;
+    context->ready_to_pull = context->ready_to_push = true;
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    errors += *(size_t*)context->input < expected || *(size_t*)context->input >= ITEMS + STAGES;
+    ++consumed;
+    context->ready_to_pull = true;
+}
+
+static void consume_branch(mtdp_sink_context* context)
+{
+    ++branched;
+    context->ready_to_pull = true;
+}
+
+static size_t key(const mtdp_buffer buffer)
+{
+    return *(const size_t*)buffer;
+}
+
+static mtdp_pipeline* create(size_t stages, size_t executor_threads)
+{
+    mtdp_pipeline_parameters parameters = {0};
+    mtdp_pipeline*           out;
+
+    parameters.params.internal_stages  = stages;
+    parameters.params.executor_threads = executor_threads;
+    out                                = fixture_create_with(&parameters, fixture_produce, increment, consume);
+    fixture_fill(out, 0, stages, BUFFERS, sizeof(size_t));
+    return out;
+}
+
+static void run(size_t items)
+{
+    uint64_t start;
+
+    fixture_stream_reset(ITEMS);
+    consumed = errors = merged = branched = 0;
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    start = mtdp_semaphore_now_us();
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_LESS_THAN(MTDP_PIPELINE_CONSUMER_TIMEOUT_US, mtdp_semaphore_now_us() - start);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(items, consumed);
+    TEST_ASSERT_EQUAL(0, errors);
+}
+
+void setUp()
+{
+    pipeline = create(STAGES, 0);
+    expected = STAGES;
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+void test_finite_stream_ends_with_its_last_buffer()
+{
+    run(ITEMS);
+    /* The stream ends again on the next run. */
+    run(ITEMS);
+}
+
+void test_end_reaches_every_replica()
+{
+    mtdp_pipeline_get_stages(pipeline)[1].replicas = 3;
+    run(ITEMS);
+    mtdp_pipeline_get_stages(pipeline)[1].unordered = true;
+    run(ITEMS);
+    mtdp_pipeline_get_stages(pipeline)[1].key = key;
+    run(ITEMS);
+}
+
+void test_end_runs_through_fused_stages()
+{
+    mtdp_pipeline_get_stages(pipeline)[1].fused = true;
+    mtdp_pipeline_get_stages(pipeline)[2].fused = true;
+    run(ITEMS);
+}
+
+void test_end_crosses_lock_free_pipes()
+{
+    mtdp_pipe_set_transport(&pipeline->pipes[0], MTDP_PIPE_TRANSPORT_SPSC);
+    mtdp_pipe_set_transport(&pipeline->pipes[1], MTDP_PIPE_TRANSPORT_RING);
+    mtdp_pipe_set_transport(&pipeline->pipes[2], MTDP_PIPE_TRANSPORT_MPMC);
+    run(ITEMS);
+}
+
+void test_end_on_an_executor()
+{
+    fixture_destroy(pipeline);
+    pipeline = create(STAGES, 2);
+    run(ITEMS);
+}
+
+void test_end_reaches_branches_and_merges()
+{
+    mtdp_pipeline* branch = create(1, 0);
+    mtdp_pipeline* input  = create(0, 0);
+
+    /* The items of the input only go through the last stage. */
+    mtdp_pipeline_get_source(input)->process = produce_input;
+    mtdp_pipeline_get_sink(branch)->process  = consume_branch;
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_branch(pipeline, 1, branch));
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_input(pipeline, 2, input));
+    expected = 1;
+    run(2 * ITEMS);
+    TEST_ASSERT_EQUAL(ITEMS, branched);
+    TEST_ASSERT_TRUE(mtdp_pipeline_remove_input(pipeline, input));
+    TEST_ASSERT_TRUE(mtdp_pipeline_remove_branch(pipeline, branch));
+    fixture_destroy(input);
+    fixture_destroy(branch);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_finite_stream_ends_with_its_last_buffer);
+    RUN_TEST(test_end_reaches_every_replica);
+    RUN_TEST(test_end_runs_through_fused_stages);
+    RUN_TEST(test_end_crosses_lock_free_pipes);
+    RUN_TEST(test_end_on_an_executor);
+    RUN_TEST(test_end_reaches_branches_and_merges);
+    UNITY_END();
+}
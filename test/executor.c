@@ -0,0 +1,135 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <unity.h>
+
+#include "mtdp.h"
+#include "impl/executor.h"
+
+#define THREADS 3
+#define LEVELS  8
+#define TOKENS  10000
+
+/* Every task moves one token from its level to the next one per iteration. */
+static atomic_size_t tokens[LEVELS + 1];
+static size_t        levels[LEVELS];
+static mtdp_worker   workers[LEVELS];
+
+mtdp_executor g_executor;
+mtdp_executor* executor = &g_executor;
+mtdp_task_set  set;
+
+static int move_token(void* arg)
+{
+    size_t* level = (size_t*)arg;
+    size_t  n     = atomic_load(&tokens[*level]);
+    while(n) {
+        if(atomic_compare_exchange_strong_size(&tokens[*level], &n, n - 1)) {
+            atomic_fetch_add(&tokens[*level + 1], 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void wait_idle()
+{
+    while(!mtdp_task_set_idle(&set)) {
+        thrd_yield();
+    }
+}
+
+void setUp()
+{
+    for(size_t i = 0; i != LEVELS + 1; ++i) {
+        atomic_store(&tokens[i], 0);
+    }
+    atomic_store(&tokens[0], TOKENS);
+    mtdp_executor_init(executor, THREADS, LEVELS);
+    mtdp_task_set_init(&set, LEVELS);
+    for(size_t i = 0; i != LEVELS; ++i) {
+        levels[i] = i;
+        mtdp_worker_init(&workers[i]);
+        workers[i].cb   = move_token;
+        workers[i].args = &levels[i];
+        mtdp_task_set_add(&set, &workers[i], i);
+        mtdp_worker_create_thread(&workers[i]);
+        mtdp_worker_enable(&workers[i]);
+    }
+    mtdp_executor_attach(executor, &set);
+}
+
+void tearDown()
+{
+    for(size_t i = 0; i != LEVELS; ++i) {
+        mtdp_worker_destroy(&workers[i]);
+    }
+    mtdp_executor_detach(executor, &set);
+    mtdp_task_set_destroy(&set);
+    mtdp_executor_deinit(executor);
+}
+
+void test_pooled_workers_have_no_thread()
+{
+    for(size_t i = 0; i != LEVELS; ++i) {
+        TEST_ASSERT_TRUE(workers[i].pooled);
+        TEST_ASSERT_TRUE(mtdp_worker_join(&workers[i]));
+    }
+}
+
+void test_tokens_reach_the_last_level()
+{
+    TEST_ASSERT_TRUE(mtdp_task_set_idle(&set));
+    mtdp_executor_schedule_set(executor, &set);
+    wait_idle();
+    for(size_t i = 0; i != LEVELS; ++i) {
+        TEST_ASSERT_EQUAL(0, atomic_load(&tokens[i]));
+    }
+    TEST_ASSERT_EQUAL(TOKENS, atomic_load(&tokens[LEVELS]));
+}
+
+void test_disabled_tasks_are_dropped()
+{
+    mtdp_worker_disable(&workers[0]);
+    mtdp_executor_schedule_set(executor, &set);
+    wait_idle();
+    TEST_ASSERT_EQUAL(TOKENS, atomic_load(&tokens[0]));
+    mtdp_worker_enable(&workers[0]);
+    mtdp_executor_schedule_set(executor, &set);
+    wait_idle();
+    TEST_ASSERT_EQUAL(TOKENS, atomic_load(&tokens[LEVELS]));
+}
+
+void test_attach_fails_past_the_capacity()
+{
+    mtdp_task_set other;
+    mtdp_worker   worker;
+
+    mtdp_task_set_init(&other, 1);
+    mtdp_worker_init(&worker);
+    mtdp_task_set_add(&other, &worker, 0);
+    TEST_ASSERT_FALSE(mtdp_executor_attach(executor, &other));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    mtdp_task_set_destroy(&other);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_pooled_workers_have_no_thread);
+    RUN_TEST(test_tokens_reach_the_last_level);
+    RUN_TEST(test_disabled_tasks_are_dropped);
+    RUN_TEST(test_attach_fails_past_the_capacity);
+    UNITY_END();
+}
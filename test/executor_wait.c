@@ -0,0 +1,106 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define STAGES  3
+#define BUFFERS 8
+#define ITEMS   20000
+
+/*
+    The stages of the pipeline run on a few executor threads of its own. The source numbers a finite
+    stream and the sink checks it receives it in order: mtdp_pipeline_wait shall return once it is over.
+*/
+static mtdp_pipeline* pipeline;
+
+static void create(size_t threads)
+{
+    mtdp_pipeline_parameters parameters = {0};
+
+    parameters.params.internal_stages  = STAGES;
+    parameters.params.executor_threads = threads;
+    pipeline                           = fixture_create_with(&parameters, fixture_produce, fixture_pass, fixture_consume);
+    fixture_fill(pipeline, 0, STAGES, BUFFERS, sizeof(size_t));
+}
+
+static void run()
+{
+    fixture_stream_reset(ITEMS);
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    /* Nothing is left in flight once the wait returns. */
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(0, fixture_stream.errors);
+    for(size_t i = 0; i != STAGES + 1; ++i) {
+        TEST_ASSERT_TRUE(mtdp_pipe_drained(&pipeline->pipes[i]));
+    }
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+}
+
+void setUp()
+{
+    create(2);
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+void test_wait_returns_at_the_end_of_the_stream()
+{
+    run();
+}
+
+void test_wait_returns_on_a_single_thread()
+{
+    fixture_destroy(pipeline);
+    create(1);
+    run();
+}
+
+void test_wait_returns_on_more_threads_than_stages()
+{
+    fixture_destroy(pipeline);
+    create(STAGES + 4);
+    run();
+}
+
+void test_wait_returns_after_every_run()
+{
+    run();
+    run();
+}
+
+void test_wait_returns_with_replicas_and_fused_stages()
+{
+    mtdp_pipeline_get_stages(pipeline)[0].replicas = 3;
+    mtdp_pipeline_get_stages(pipeline)[2].fused    = true;
+    run();
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_wait_returns_at_the_end_of_the_stream);
+    RUN_TEST(test_wait_returns_on_a_single_thread);
+    RUN_TEST(test_wait_returns_on_more_threads_than_stages);
+    RUN_TEST(test_wait_returns_after_every_run);
+    RUN_TEST(test_wait_returns_with_replicas_and_fused_stages);
+    UNITY_END();
+}
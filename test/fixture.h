@@ -0,0 +1,113 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#ifndef MTDP_TEST_FIXTURE_H
+#define MTDP_TEST_FIXTURE_H
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mtdp.h"
+#include "impl/pipeline.h"
+
+/*
+    Pipelines shared by the tests: every step runs the callback given (all the stages the same one),
+    and the buffers handed to the pipes are allocated here, then freed along with the pipeline.
+*/
+
+static inline mtdp_pipeline* fixture_create_with(const mtdp_pipeline_parameters* parameters, mtdp_source_callback produce,
+                                                 mtdp_stage_callback process, mtdp_sink_callback consume)
+{
+    mtdp_pipeline* pipeline = mtdp_pipeline_create(parameters);
+
+    mtdp_pipeline_get_source(pipeline)->process = produce;
+    for(size_t i = 0; i != parameters->params.internal_stages; ++i) {
+        mtdp_pipeline_get_stages(pipeline)[i].process = process;
+    }
+    mtdp_pipeline_get_sink(pipeline)->process = consume;
+    return pipeline;
+}
+
+static inline mtdp_pipeline* fixture_create(size_t stages, mtdp_source_callback produce, mtdp_stage_callback process,
+                                            mtdp_sink_callback consume)
+{
+    mtdp_pipeline_parameters parameters = {0};
+
+    parameters.params.internal_stages = stages;
+    return fixture_create_with(&parameters, produce, process, consume);
+}
+
+/* Gives n_buffers buffers of size bytes to the pipes from first to last, both included */
+static inline void fixture_fill(mtdp_pipeline* pipeline, size_t first, size_t last, size_t n_buffers, size_t size)
+{
+    mtdp_buffer* buffers;
+
+    for(size_t i = first; i <= last; ++i) {
+        buffers = mtdp_pipe_resize(&mtdp_pipeline_get_pipes(pipeline)[i], n_buffers);
+        for(size_t j = 0; j != n_buffers; ++j) {
+            buffers[j] = malloc(size);
+        }
+    }
+}
+
+/*
+    Numbered stream shared by the tests: the source pushes the numbers from 0 to items - 1 in size_t buffers,
+    the stages pass them on and the sink counts those not received in order, each one increased by offset.
+*/
+static struct {
+    size_t items, offset, produced, consumed, errors;
+} fixture_stream;
+
+/* Starts a new stream of items numbers */
+static inline void fixture_stream_reset(size_t items)
+{
+    memset(&fixture_stream, 0, sizeof(fixture_stream));
+    fixture_stream.items = items;
+}
+
+static inline void fixture_produce(mtdp_source_context* context)
+{
+    if(fixture_stream.produced == fixture_stream.items) {
+        mtdp_source_finished(context);
+        return;
+    }
+    *(size_t*)context->output = fixture_stream.produced++;
+    context->ready_to_push    = true;
+}
+
+static inline void fixture_pass(mtdp_stage_context* context)
+{
+    *(size_t*)context->output = *(size_t*)context->input;
+    context->ready_to_pull = context->ready_to_push = true;
+}
+
+static inline void fixture_consume(mtdp_sink_context* context)
+{
+    fixture_stream.errors += *(size_t*)context->input != fixture_stream.consumed++ + fixture_stream.offset;
+    context->ready_to_pull = true;
+}
+
+/* Frees the buffers back in the pools of the pipeline, then the pipeline itself */
+static inline void fixture_destroy(mtdp_pipeline* pipeline)
+{
+    for(size_t i = 0; i <= pipeline->n_stages; ++i) {
+        for(size_t j = 0; j != mtdp_buffer_pool_size(&pipeline->pipes[i].pool); ++j) {
+            free(pipeline->pipes[i].pool.buffers[j]);
+        }
+    }
+    mtdp_pipeline_destroy(pipeline);
+}
+
+#endif
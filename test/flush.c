@@ -0,0 +1,236 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define STAGES  3
+#define BUFFERS 8
+#define FLUSHES 200
+
+/*
+    The source never ends and every stage passes its input on. Once a flush returns, the sink
+    shall have consumed at least as many buffers as the source had pushed when it was called.
+*/
+static size_t         produced, produced_input;
+static atomic_size_t  consumed, consumed_branch;
+static mtdp_pipeline* pipeline;
+
+static void produce(mtdp_source_context* context)
+{
+    *(size_t*)context->output = produced++;
+    context->ready_to_push    = true;
+}
+
+static void produce_input(mtdp_source_context* context)
+{
+    *(size_t*)context->output = produced_input++;
+    context->ready_to_push    = true;
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    atomic_fetch_add(&consumed, 1);
+    context->ready_to_pull = true;
+}
+
+static void consume_branch(mtdp_sink_context* context)
+{
+    atomic_fetch_add(&consumed_branch, 1);
+    context->ready_to_pull = true;
+}
+
+static size_t key(const mtdp_buffer buffer)
+{
+    return *(const size_t*)buffer;
+}
+
+/* The pipes shared with the pipelines linked get no buffers */
+static mtdp_pipeline* create(size_t stages, size_t first_pipe, size_t last_pipe)
+{
+    mtdp_pipeline* out = fixture_create(stages, produce, fixture_pass, consume);
+
+    fixture_fill(out, first_pipe, last_pipe, BUFFERS, sizeof(size_t));
+    return out;
+}
+
+/* Flushes the pipeline while it runs from the source of first */
+static void run(mtdp_pipeline* first)
+{
+    size_t pushed = 0;
+
+    produced = 0;
+    atomic_store(&consumed, 0);
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    for(size_t i = 0; i != FLUSHES; ++i) {
+        /* Let the source get ahead of the sink before every flush. */
+        while(atomic_load(&first->pipes[0].n_pushed) < pushed + BUFFERS) {
+            thrd_yield();
+        }
+        pushed = atomic_load(&first->pipes[0].n_pushed);
+        TEST_ASSERT_TRUE(mtdp_pipeline_flush(first));
+        TEST_ASSERT_GREATER_OR_EQUAL(pushed, atomic_load(&consumed));
+    }
+    TEST_ASSERT_TRUE(mtdp_pipeline_stop(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+}
+
+void setUp()
+{
+    pipeline = create(STAGES, 0, STAGES);
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+void test_flush_waits_for_the_buffers_pushed_before()
+{
+    run(pipeline);
+}
+
+void test_flush_waits_for_every_replica()
+{
+    mtdp_pipeline_get_stages(pipeline)[1].replicas = 3;
+    run(pipeline);
+    mtdp_pipeline_get_stages(pipeline)[1].unordered = true;
+    run(pipeline);
+    mtdp_pipeline_get_stages(pipeline)[1].key = key;
+    run(pipeline);
+}
+
+void test_flush_through_fused_stages_and_lock_free_pipes()
+{
+    mtdp_pipeline_get_stages(pipeline)[2].fused = true;
+    mtdp_pipe_set_transport(&pipeline->pipes[0], MTDP_PIPE_TRANSPORT_SPSC);
+    mtdp_pipe_set_transport(&pipeline->pipes[1], MTDP_PIPE_TRANSPORT_RING);
+    mtdp_pipe_set_transport(&pipeline->pipes[3], MTDP_PIPE_TRANSPORT_MPMC);
+    run(pipeline);
+}
+
+void test_flush_on_an_executor()
+{
+    mtdp_pipeline_parameters parameters = {0};
+
+    fixture_destroy(pipeline);
+    parameters.params.internal_stages  = STAGES;
+    parameters.params.executor_threads = 2;
+    pipeline                           = fixture_create_with(&parameters, produce, fixture_pass, consume);
+    fixture_fill(pipeline, 0, STAGES, BUFFERS, sizeof(size_t));
+    run(pipeline);
+}
+
+void test_flush_through_nested_and_bridged_pipelines()
+{
+    mtdp_pipeline* nested = create(2, 1, 1);
+    mtdp_pipeline* from   = create(1, 0, 1);
+
+    /* from -> pipeline, whose second stage runs the nested one */
+    fixture_destroy(pipeline);
+    pipeline = create(STAGES, 1, STAGES);
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_nested(pipeline, 1, nested));
+    TEST_ASSERT_TRUE(mtdp_pipeline_bridge(from, pipeline));
+    run(from);
+    TEST_ASSERT_TRUE(mtdp_pipeline_unbridge(from, pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_remove_nested(pipeline, nested));
+    fixture_destroy(from);
+    fixture_destroy(nested);
+}
+
+void test_flush_through_branches_and_inputs()
+{
+    mtdp_pipeline* branch = create(2, 1, 2);
+    mtdp_pipeline* input  = create(1, 0, 1);
+    size_t         pushed, pushed_input;
+
+    /* pipeline broadcasts its second pipe to branch, input is merged into its third one */
+    mtdp_pipeline_get_sink(branch)->process   = consume_branch;
+    mtdp_pipeline_get_source(input)->process = produce_input;
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_branch(pipeline, 1, branch));
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_input(pipeline, 2, input));
+    produced = produced_input = 0;
+    atomic_store(&consumed, 0);
+    atomic_store(&consumed_branch, 0);
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    for(size_t i = 0; i != FLUSHES; ++i) {
+        /* Any of the linked pipelines flushes all of them. */
+        pushed       = atomic_load(&pipeline->pipes[0].n_pushed);
+        pushed_input = atomic_load(&input->pipes[0].n_pushed);
+        TEST_ASSERT_TRUE(mtdp_pipeline_flush(i % 2 ? branch : input));
+        TEST_ASSERT_GREATER_OR_EQUAL(pushed + pushed_input, atomic_load(&consumed));
+        TEST_ASSERT_GREATER_OR_EQUAL(pushed, atomic_load(&consumed_branch));
+    }
+    TEST_ASSERT_TRUE(mtdp_pipeline_stop(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_remove_input(pipeline, input));
+    TEST_ASSERT_TRUE(mtdp_pipeline_remove_branch(pipeline, branch));
+    fixture_destroy(input);
+    fixture_destroy(branch);
+}
+
+void test_flush_rejects_buffers_waiting_for_a_match()
+{
+    mtdp_pipeline* input = create(1, 0, 1);
+
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_input(pipeline, 2, input));
+    TEST_ASSERT_TRUE(mtdp_pipe_set_merge_policy(&pipeline->pipes[2], MTDP_PIPE_MERGE_SEQUENCE, key));
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    TEST_ASSERT_FALSE(mtdp_pipeline_flush(pipeline));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_TRUE(mtdp_pipeline_stop(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipe_set_merge_policy(&pipeline->pipes[2], MTDP_PIPE_MERGE_ROUND_ROBIN, NULL));
+    TEST_ASSERT_TRUE(mtdp_pipe_set_join(&pipeline->pipes[2], MTDP_PIPE_JOIN_KEY, key, 0, BUFFERS));
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    TEST_ASSERT_FALSE(mtdp_pipeline_flush(input));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_TRUE(mtdp_pipeline_stop(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_remove_input(pipeline, input));
+    fixture_destroy(input);
+}
+
+void test_flush_needs_a_running_pipeline()
+{
+    TEST_ASSERT_FALSE(mtdp_pipeline_flush(NULL));
+    TEST_ASSERT_EQUAL(MTDP_BAD_PTR, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_flush(pipeline));
+    TEST_ASSERT_EQUAL(MTDP_NOT_ENABLED, mtdp_errno);
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_FALSE(mtdp_pipeline_flush(pipeline));
+    TEST_ASSERT_EQUAL(MTDP_ENABLED, mtdp_errno);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_flush_waits_for_the_buffers_pushed_before);
+    RUN_TEST(test_flush_waits_for_every_replica);
+    RUN_TEST(test_flush_through_fused_stages_and_lock_free_pipes);
+    RUN_TEST(test_flush_on_an_executor);
+    RUN_TEST(test_flush_through_nested_and_bridged_pipelines);
+    RUN_TEST(test_flush_through_branches_and_inputs);
+    RUN_TEST(test_flush_rejects_buffers_waiting_for_a_match);
+    RUN_TEST(test_flush_needs_a_running_pipeline);
+    UNITY_END();
+}
@@ -0,0 +1,154 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define STAGES   4
+#define BUFFERS  8
+#define ITEMS    20000
+#define DROPPED  5
+#define EXPECTED (ITEMS - (ITEMS + DROPPED - 1) / DROPPED)
+
+typedef struct {
+    size_t value, hops;
+} item;
+
+/*
+    The source numbers the items, every stage counts its hop and the first one drops every DROPPED-th item.
+    The sink checks the items it receives are in order and went through every stage.
+*/
+static size_t         produced, consumed, errors, next;
+static mtdp_pipeline* pipeline;
+
+static void produce(mtdp_source_context* context)
+{
+    if(produced == ITEMS) {
+        mtdp_source_finished(context);
+        return;
+    }
+    ((item*)context->output)->value = produced++;
+    ((item*)context->output)->hops  = 0;
+    context->ready_to_push          = true;
+}
+
+static void hop(mtdp_stage_context* context)
+{
+    item* i = (item*)context->input;
+
+    ((item*)context->output)->value = i->value;
+    ((item*)context->output)->hops  = i->hops + 1;
+    context->ready_to_push          = i->hops || i->value % DROPPED;
+    context->ready_to_pull          = true;
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    item* i = (item*)context->input;
+
+    errors += i->value < next || i->hops != STAGES;
+    next = i->value + 1;
+    ++consumed;
+    context->ready_to_pull = true;
+}
+
+/* Runs the stream, checking that no buffer is left in the pipes bypassed once the pipeline is done */
+static void run()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    for(size_t i = 1; i != STAGES; ++i) {
+        if(mtdp_pipeline_get_stages(pipeline)[i].fused) {
+            TEST_ASSERT_TRUE(mtdp_pipe_drained(&pipeline->pipes[i]));
+            TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&pipeline->pipes[i].pool));
+        }
+    }
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(EXPECTED, consumed);
+    TEST_ASSERT_EQUAL(0, errors);
+}
+
+void setUp()
+{
+    produced = consumed = errors = next = 0;
+    pipeline = fixture_create(STAGES, produce, hop, consume);
+    fixture_fill(pipeline, 0, STAGES, BUFFERS, sizeof(item));
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+void test_fused_chain_keeps_the_order()
+{
+    for(size_t i = 1; i != STAGES; ++i) {
+        mtdp_pipeline_get_stages(pipeline)[i].fused = true;
+    }
+    run();
+}
+
+void test_fused_groups_side_by_side()
+{
+    mtdp_pipeline_get_stages(pipeline)[1].fused = true;
+    mtdp_pipeline_get_stages(pipeline)[3].fused = true;
+    run();
+}
+
+void test_fused_group_next_to_replicas()
+{
+    /* The head of the group is not replicated, the stage past the group is. */
+    mtdp_pipeline_get_stages(pipeline)[1].fused    = true;
+    mtdp_pipeline_get_stages(pipeline)[2].fused    = true;
+    mtdp_pipeline_get_stages(pipeline)[3].replicas = 3;
+    run();
+}
+
+void test_fused_group_runs_again()
+{
+    mtdp_pipeline_get_stages(pipeline)[2].fused = true;
+    run();
+    produced = consumed = errors = next = 0;
+    run();
+}
+
+void test_fusion_rejects_replicas_and_lock_free_pipes()
+{
+    mtdp_pipeline_get_stages(pipeline)[2].fused    = true;
+    mtdp_pipeline_get_stages(pipeline)[1].replicas = 2;
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    mtdp_pipeline_get_stages(pipeline)[1].replicas = 1;
+    mtdp_pipeline_get_stages(pipeline)[2].replicas = 2;
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    mtdp_pipeline_get_stages(pipeline)[2].replicas = 1;
+    mtdp_pipe_set_transport(&pipeline->pipes[2], MTDP_PIPE_TRANSPORT_SPSC);
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_fused_chain_keeps_the_order);
+    RUN_TEST(test_fused_groups_side_by_side);
+    RUN_TEST(test_fused_group_next_to_replicas);
+    RUN_TEST(test_fused_group_runs_again);
+    RUN_TEST(test_fusion_rejects_replicas_and_lock_free_pipes);
+    UNITY_END();
+}
@@ -0,0 +1,126 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define NODES   4
+#define BUFFERS 8
+#define ITEMS   10000
+
+/* A diamond: the stream of the first node is split in two branches, joined again by the last node. */
+static const mtdp_pipeline_edge diamond[] = {
+    {MTDP_PIPELINE_EDGE_BRANCH, 0, 1, 0},
+    {MTDP_PIPELINE_EDGE_BRANCH, 0, 2, 0},
+    {MTDP_PIPELINE_EDGE_INPUT, 1, 3, 0},
+    {MTDP_PIPELINE_EDGE_INPUT, 2, 3, 0},
+};
+
+static mtdp_pipeline_parameters nodes[NODES];
+static mtdp_pipeline*           pipelines[NODES];
+static size_t                   consumed[NODES];
+
+static void finish(mtdp_source_context* context)
+{
+    mtdp_source_finished(context);
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    ++*(size_t*)context->self;
+    context->ready_to_pull = true;
+}
+
+static void configure(size_t node, bool buffers)
+{
+    mtdp_pipeline* pipeline = pipelines[node];
+
+    mtdp_pipeline_get_source(pipeline)->process = node ? finish : fixture_produce;
+    for(size_t i = 0; i != nodes[node].params.internal_stages; ++i) {
+        mtdp_pipeline_get_stages(pipeline)[i].process = fixture_pass;
+    }
+    mtdp_pipeline_get_sink(pipeline)->process = consume;
+    mtdp_pipeline_get_sink(pipeline)->self    = &consumed[node];
+    fixture_fill(pipeline, !buffers, nodes[node].params.internal_stages, BUFFERS, sizeof(size_t));
+}
+
+void setUp()
+{
+    memset(nodes, 0, sizeof(nodes));
+    memset(consumed, 0, sizeof(consumed));
+    fixture_stream_reset(ITEMS);
+    nodes[1].params.internal_stages = 1;
+    nodes[2].params.internal_stages = 2;
+}
+
+void tearDown()
+{
+    for(size_t i = 0; i != NODES; ++i) {
+        if(pipelines[i]) {
+            fixture_destroy(pipelines[i]);
+            pipelines[i] = NULL;
+        }
+    }
+}
+
+void test_diamond_joins_both_branches()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_create_graph(nodes, NODES, diamond, 4, pipelines));
+    for(size_t i = 0; i != NODES; ++i) {
+        configure(i, i == 0 || i == 3);
+    }
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipelines[3]));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipelines[0]));
+    mtdp_pipeline_wait(pipelines[1]);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipelines[2]));
+    TEST_ASSERT_EQUAL(ITEMS, consumed[0]);
+    TEST_ASSERT_EQUAL(2 * ITEMS, consumed[3]);
+}
+
+void test_graph_with_a_cycle_is_not_created()
+{
+    mtdp_pipeline_edge cycle[] = {
+        {MTDP_PIPELINE_EDGE_BRANCH, 0, 1, 0},
+        {MTDP_PIPELINE_EDGE_INPUT, 1, 0, 0},
+    };
+    TEST_ASSERT_FALSE(mtdp_pipeline_create_graph(nodes, 2, cycle, 2, pipelines));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_NULL(pipelines[0]);
+    TEST_ASSERT_NULL(pipelines[1]);
+}
+
+void test_graph_edges_are_checked()
+{
+    mtdp_pipeline_edge edge = {MTDP_PIPELINE_EDGE_INPUT, 0, NODES, 0};
+    TEST_ASSERT_FALSE(mtdp_pipeline_create_graph(nodes, NODES, &edge, 1, pipelines));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    edge.to   = 1;
+    edge.pipe = 2;
+    TEST_ASSERT_FALSE(mtdp_pipeline_create_graph(nodes, NODES, &edge, 1, pipelines));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_create_graph(nodes, NODES, NULL, 1, pipelines));
+    TEST_ASSERT_EQUAL(MTDP_BAD_PTR, mtdp_errno);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_diamond_joins_both_branches);
+    RUN_TEST(test_graph_with_a_cycle_is_not_created);
+    RUN_TEST(test_graph_edges_are_checked);
+    UNITY_END();
+}
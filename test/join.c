@@ -0,0 +1,179 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define BUFFERS 8
+#define ITEMS   10000
+
+/* Every source numbers its buffers from a first key with a fixed step: the stage checks each pair it receives. */
+typedef struct {
+    size_t first, step, produced;
+} stream;
+
+static stream         left, right;
+static size_t         pairs, errors, tolerance, input_buffers;
+static mtdp_pipeline* pipeline;
+static mtdp_pipeline* input;
+
+static void produce(mtdp_source_context* context)
+{
+    stream* s = (stream*)context->self;
+    if(s->produced == ITEMS) {
+        mtdp_source_finished(context);
+        return;
+    }
+    *(size_t*)context->output = s->first + s->step * s->produced++;
+    context->ready_to_push    = true;
+}
+
+static void match(mtdp_stage_context* context)
+{
+    size_t l = *(size_t*)context->input, r = *(size_t*)context->joined;
+    errors += (l > r ? l - r : r - l) > tolerance;
+    ++pairs;
+    *(size_t*)context->output = l;
+    context->ready_to_pull = context->ready_to_push = true;
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    context->ready_to_pull = true;
+}
+
+static size_t key(const mtdp_buffer buffer)
+{
+    return *(const size_t*)buffer;
+}
+
+static mtdp_pipeline* create(size_t stages, stream* s, size_t buffers)
+{
+    mtdp_pipeline* out = fixture_create(stages, produce, match, consume);
+
+    mtdp_pipeline_get_source(out)->self = s;
+    fixture_fill(out, 0, stages, buffers, sizeof(size_t));
+    return out;
+}
+
+static void run()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(0, errors);
+    /* Unmatched buffers went back to their pools. */
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&pipeline->pipes[0].pool));
+    TEST_ASSERT_EQUAL(input_buffers, mtdp_buffer_pool_size(&input->pipes[0].pool));
+}
+
+void setUp()
+{
+    memset(&left, 0, sizeof(left));
+    memset(&right, 0, sizeof(right));
+    pairs = errors = tolerance = 0;
+    input_buffers = BUFFERS;
+    pipeline      = create(1, &left, BUFFERS);
+    input         = create(0, &right, BUFFERS);
+    mtdp_pipeline_add_input(pipeline, 0, input);
+}
+
+void tearDown()
+{
+    fixture_destroy(input);
+    fixture_destroy(pipeline);
+}
+
+void test_join_by_key()
+{
+    left.step = right.step = 1;
+    mtdp_pipe_set_join(&pipeline->pipes[0], MTDP_PIPE_JOIN_KEY, key, 0, 64);
+    run();
+    TEST_ASSERT_TRUE(pairs > 0);
+    TEST_ASSERT_TRUE(pairs <= ITEMS);
+}
+
+void test_join_by_timestamp()
+{
+    left.step   = right.step = 10;
+    right.first = 3;
+    tolerance   = 5;
+    mtdp_pipe_set_join(&pipeline->pipes[0], MTDP_PIPE_JOIN_TIMESTAMP, key, tolerance, 4);
+    run();
+    TEST_ASSERT_TRUE(pairs > 0);
+}
+
+void test_unmatched_buffers_expire()
+{
+    left.step   = right.step = 10;
+    right.first = 3;
+    mtdp_pipe_set_join(&pipeline->pipes[0], MTDP_PIPE_JOIN_TIMESTAMP, key, 2, 4);
+    run();
+    TEST_ASSERT_EQUAL(0, pairs);
+    TEST_ASSERT_EQUAL(ITEMS, left.produced);
+    TEST_ASSERT_EQUAL(ITEMS, right.produced);
+}
+
+void test_join_a_stream_of_a_single_buffer()
+{
+    /* The window of the input holds none of its buffers: each one goes back at once unless matched. */
+    mtdp_pipeline_remove_input(pipeline, input);
+    fixture_destroy(input);
+    input_buffers = 1;
+    input         = create(0, &right, input_buffers);
+    mtdp_pipeline_add_input(pipeline, 0, input);
+    left.step = right.step = 1;
+    mtdp_pipe_set_join(&pipeline->pipes[0], MTDP_PIPE_JOIN_KEY, key, 0, 64);
+    run();
+    TEST_ASSERT_EQUAL(ITEMS, left.produced);
+    TEST_ASSERT_EQUAL(ITEMS, right.produced);
+}
+
+void test_join_needs_a_single_input()
+{
+    TEST_ASSERT_FALSE(mtdp_pipe_set_join(&pipeline->pipes[0], MTDP_PIPE_JOIN_KEY, NULL, 0, 4));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    mtdp_pipe_set_join(&pipeline->pipes[1], MTDP_PIPE_JOIN_KEY, key, 0, 4);
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+}
+
+void test_join_state_is_only_held_by_joining_pipes()
+{
+    /* A plain pipe pays for neither the merge nor the join. */
+    TEST_ASSERT_NULL(pipeline->pipes[1].merger);
+    TEST_ASSERT_NULL(pipeline->pipes[1].joiner);
+    TEST_ASSERT_NOT_NULL(pipeline->pipes[0].merger);
+    TEST_ASSERT_NULL(pipeline->pipes[0].joiner);
+    TEST_ASSERT_TRUE(mtdp_pipe_set_join(&pipeline->pipes[0], MTDP_PIPE_JOIN_KEY, key, 0, 4));
+    TEST_ASSERT_NOT_NULL(pipeline->pipes[0].joiner);
+    TEST_ASSERT_TRUE(mtdp_pipe_set_join(&pipeline->pipes[0], MTDP_PIPE_JOIN_NONE, NULL, 0, 0));
+    TEST_ASSERT_NULL(pipeline->pipes[0].joiner);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_join_by_key);
+    RUN_TEST(test_join_by_timestamp);
+    RUN_TEST(test_unmatched_buffers_expire);
+    RUN_TEST(test_join_a_stream_of_a_single_buffer);
+    RUN_TEST(test_join_needs_a_single_input);
+    RUN_TEST(test_join_state_is_only_held_by_joining_pipes);
+    UNITY_END();
+}
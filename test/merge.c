@@ -0,0 +1,237 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define INPUTS  2
+#define BUFFERS 8
+#define ITEMS   10000
+
+/*
+    Every source produces a partition of the stream: by default the items equal to its index modulo
+    the number of sources. The sink of the merging pipeline checks it receives every partition in order.
+*/
+typedef struct {
+    size_t source, value;
+} item;
+
+typedef struct {
+    size_t index, produced, items, step;
+} partition;
+
+static partition      partitions[INPUTS + 1];
+static size_t         consumed[INPUTS + 1], errors, next;
+static mtdp_pipeline* merge;
+static mtdp_pipeline* inputs[INPUTS];
+
+static void produce(mtdp_source_context* context)
+{
+    partition* p = (partition*)context->self;
+    item*      i = (item*)context->output;
+    if(p->produced == p->items) {
+        mtdp_source_finished(context);
+        return;
+    }
+    i->source              = p->index;
+    i->value               = p->index + p->produced++ * p->step;
+    context->ready_to_push = true;
+}
+
+static void copy(mtdp_stage_context* context)
+{
+    *(item*)context->output = *(item*)context->input;
+    context->ready_to_pull = context->ready_to_push = true;
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    item* i = (item*)context->input;
+    errors += i->value != i->source + consumed[i->source]++ * partitions[i->source].step;
+    context->ready_to_pull = true;
+}
+
+static void consume_in_sequence(mtdp_sink_context* context)
+{
+    errors += ((item*)context->input)->value != next++;
+    consume(context);
+}
+
+static void consume_sorted(mtdp_sink_context* context)
+{
+    errors += ((item*)context->input)->value < next;
+    next = ((item*)context->input)->value + 1;
+    consume(context);
+}
+
+static size_t sequence(const mtdp_buffer buffer)
+{
+    return ((const item*)buffer)->value;
+}
+
+static mtdp_pipeline* create(size_t stages, partition* p)
+{
+    mtdp_pipeline* pipeline = fixture_create(stages, produce, copy, consume);
+
+    mtdp_pipeline_get_source(pipeline)->self = p;
+    fixture_fill(pipeline, 0, stages, BUFFERS, sizeof(item));
+    return pipeline;
+}
+
+static void run()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(merge));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(merge));
+    mtdp_pipeline_wait(merge);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(merge));
+    for(size_t i = 0; i != INPUTS + 1; ++i) {
+        TEST_ASSERT_EQUAL(partitions[i].items, consumed[i]);
+    }
+    TEST_ASSERT_EQUAL(0, errors);
+}
+
+void setUp()
+{
+    memset(partitions, 0, sizeof(partitions));
+    memset(consumed, 0, sizeof(consumed));
+    errors = next = 0;
+    for(size_t i = 0; i != INPUTS + 1; ++i) {
+        partitions[i].index = i;
+        partitions[i].items = ITEMS;
+        partitions[i].step  = INPUTS + 1;
+    }
+    merge = create(1, &partitions[0]);
+    for(size_t i = 0; i != INPUTS; ++i) {
+        inputs[i] = create(i, &partitions[i + 1]);
+        mtdp_pipeline_add_input(merge, 0, inputs[i]);
+    }
+}
+
+void tearDown()
+{
+    for(size_t i = 0; i != INPUTS; ++i) {
+        fixture_destroy(inputs[i]);
+    }
+    fixture_destroy(merge);
+}
+
+void test_round_robin_merges_every_input()
+{
+    run();
+}
+
+void test_first_available_merges_every_input()
+{
+    mtdp_pipe_set_merge_policy(&merge->pipes[0], MTDP_PIPE_MERGE_FIRST_AVAILABLE, NULL);
+    run();
+}
+
+void test_sequence_merges_in_order()
+{
+    TEST_ASSERT_FALSE(mtdp_pipe_set_merge_policy(&merge->pipes[0], MTDP_PIPE_MERGE_SEQUENCE, NULL));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_TRUE(mtdp_pipe_set_merge_policy(&merge->pipes[0], MTDP_PIPE_MERGE_SEQUENCE, sequence));
+    mtdp_pipeline_get_sink(merge)->process = consume_in_sequence;
+    run();
+}
+
+void test_sequence_merges_sparse_numbers()
+{
+    /* Timestamps at different rates, one input ending long before the others. */
+    for(size_t i = 0; i != INPUTS + 1; ++i) {
+        partitions[i].step = (i + 2) * 1000;
+    }
+    partitions[1].items = ITEMS / 4;
+    mtdp_pipe_set_merge_policy(&merge->pipes[0], MTDP_PIPE_MERGE_SEQUENCE, sequence);
+    mtdp_pipeline_get_sink(merge)->process = consume_sorted;
+    run();
+    /* Every input ended: the heads were all pulled, and the buffers are back in their pools. */
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&inputs[0]->pipes[0].pool));
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&inputs[1]->pipes[1].pool));
+}
+
+void test_sequence_heads_are_not_drained()
+{
+    mtdp_buffer buffer;
+    size_t      seq;
+
+    mtdp_pipe_set_merge_policy(&merge->pipes[0], MTDP_PIPE_MERGE_SEQUENCE, sequence);
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(merge));
+    TEST_ASSERT_TRUE(mtdp_pipe_drained(&merge->pipes[0]));
+    /* Only the first input pushed: its buffer waits as the head of its side. */
+    buffer                 = mtdp_pipe_get_empty_buffer(&inputs[0]->pipes[0]);
+    ((item*)buffer)->value = 1;
+    TEST_ASSERT_TRUE(mtdp_pipe_push_buffer(&inputs[0]->pipes[0], buffer));
+    TEST_ASSERT_FALSE(mtdp_pipe_wait_full(&merge->pipes[0], MTDP_WAIT_BLOCK, 1000));
+    TEST_ASSERT_FALSE(mtdp_pipe_drained(&merge->pipes[0]));
+    TEST_ASSERT_NULL(mtdp_pipe_get_full_buffer_seq(&merge->pipes[0], &seq));
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(merge));
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&inputs[0]->pipes[0].pool));
+}
+
+void test_merged_buffers_return_to_their_inputs()
+{
+    mtdp_pipe_set_transport(&inputs[1]->pipes[1], MTDP_PIPE_TRANSPORT_MPMC);
+    mtdp_pipeline_enable(inputs[0]);
+    TEST_ASSERT_TRUE(merge->enabled);
+    mtdp_pipeline_start(inputs[1]);
+    mtdp_pipeline_disable(merge);
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&merge->pipes[0].pool));
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&inputs[0]->pipes[0].pool));
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&inputs[1]->pipes[1].pool));
+}
+
+void test_add_input_rejects_bad_links()
+{
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_input(inputs[0], 0, merge));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_input(merge, 1, inputs[0]));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_branch(merge, 0, inputs[0]));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_TRUE(mtdp_pipeline_remove_input(merge, inputs[0]));
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_input(merge, 2, inputs[0]));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_input(merge, 1, inputs[0]));
+    TEST_ASSERT_EQUAL(1, merge->pipes[1].n_inputs);
+}
+
+void test_merging_pipe_consumer_is_not_replicated()
+{
+    mtdp_pipeline_get_stages(merge)[0].replicas = 2;
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(merge));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(inputs[0]->enabled);
+    mtdp_pipeline_get_stages(merge)[0].replicas = 1;
+    mtdp_pipe_set_transport(&merge->pipes[0], MTDP_PIPE_TRANSPORT_RING);
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(merge));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_round_robin_merges_every_input);
+    RUN_TEST(test_first_available_merges_every_input);
+    RUN_TEST(test_sequence_merges_in_order);
+    RUN_TEST(test_sequence_merges_sparse_numbers);
+    RUN_TEST(test_sequence_heads_are_not_drained);
+    RUN_TEST(test_merged_buffers_return_to_their_inputs);
+    RUN_TEST(test_add_input_rejects_bad_links);
+    RUN_TEST(test_merging_pipe_consumer_is_not_replicated);
+    UNITY_END();
+}
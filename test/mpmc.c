@@ -0,0 +1,140 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <unity.h>
+
+#include "mtdp.h"
+#include "impl/buffer.h"
+#include <threads.h>
+
+#define CAPACITY 16
+
+mtdp_buffer_mpmc g_queue;
+mtdp_buffer_mpmc* queue = &g_queue;
+
+void setUp()
+{
+    mtdp_buffer_mpmc_init(queue);
+    mtdp_buffer_mpmc_resize(queue, CAPACITY);
+}
+
+void tearDown()
+{
+    mtdp_buffer_mpmc_destroy(queue);
+}
+
+void test_black_box()
+{
+    const size_t PUSH_ATTEMPTS = CAPACITY + 4, POP_ATTEMPTS = CAPACITY + 8;
+    TEST_ASSERT_EQUAL(mtdp_buffer_mpmc_size(queue), 0);
+
+    mtdp_buffer buf = NULL;
+    for(size_t i = 0; i != PUSH_ATTEMPTS; ++i) {
+        if(mtdp_buffer_mpmc_push(queue, (mtdp_buffer)i)) {
+            TEST_ASSERT_EQUAL(mtdp_buffer_mpmc_size(queue), i + 1);
+        } else {
+            TEST_ASSERT_GREATER_OR_EQUAL(CAPACITY, i);
+        }
+    }
+
+    for(size_t i = 0; i != POP_ATTEMPTS; ++i) {
+        if(mtdp_buffer_mpmc_pop(queue, &buf)) {
+            TEST_ASSERT_EQUAL(mtdp_buffer_mpmc_size(queue), CAPACITY - i - 1);
+            TEST_ASSERT_EQUAL(i, buf);
+        } else {
+            TEST_ASSERT_GREATER_OR_EQUAL(CAPACITY, i);
+        }
+    }
+}
+
+void test_resize_keeps_order()
+{
+    mtdp_buffer buf = NULL;
+
+    /* Move the positions away from the beginning of the storage. */
+    for(size_t i = 0; i != CAPACITY / 2 + 1; ++i) {
+        mtdp_buffer_mpmc_push(queue, (mtdp_buffer)i);
+        mtdp_buffer_mpmc_pop(queue, &buf);
+    }
+    for(size_t i = 0; i != CAPACITY; ++i) {
+        TEST_ASSERT_TRUE(mtdp_buffer_mpmc_push(queue, (mtdp_buffer)i));
+    }
+    TEST_ASSERT_FALSE(mtdp_buffer_mpmc_resize(queue, CAPACITY - 1));
+    TEST_ASSERT_TRUE(mtdp_buffer_mpmc_resize(queue, 2 * CAPACITY));
+    TEST_ASSERT_TRUE(mtdp_buffer_mpmc_push(queue, (mtdp_buffer)CAPACITY));
+    for(size_t i = 0; i != CAPACITY + 1; ++i) {
+        TEST_ASSERT_TRUE(mtdp_buffer_mpmc_pop(queue, &buf));
+        TEST_ASSERT_EQUAL(i, buf);
+    }
+    TEST_ASSERT_FALSE(mtdp_buffer_mpmc_pop(queue, &buf));
+}
+
+#define CONCURRENT_THREADS 4
+#define CONCURRENT_ITEMS   50000
+
+static atomic_size_t popped_sum, popped;
+
+static int producer(void* arg)
+{
+    size_t first = (size_t)arg * CONCURRENT_ITEMS;
+    for(size_t i = first + 1; i <= first + CONCURRENT_ITEMS; ++i) {
+        while(!mtdp_buffer_mpmc_push(queue, (mtdp_buffer)i)) {
+            thrd_yield();
+        }
+    }
+    return 0;
+}
+
+static int consumer(void* arg)
+{
+    mtdp_buffer buf;
+    (void)arg;
+    while(atomic_load(&popped) != CONCURRENT_THREADS * CONCURRENT_ITEMS) {
+        if(mtdp_buffer_mpmc_pop(queue, &buf)) {
+            atomic_fetch_add(&popped_sum, (size_t)buf);
+            atomic_fetch_add(&popped, 1);
+        } else {
+            thrd_yield();
+        }
+    }
+    return 0;
+}
+
+void test_concurrent_no_loss()
+{
+    const size_t N = CONCURRENT_THREADS * CONCURRENT_ITEMS;
+    thrd_t       producers[CONCURRENT_THREADS], consumers[CONCURRENT_THREADS];
+
+    atomic_store(&popped_sum, 0);
+    atomic_store(&popped, 0);
+    for(size_t i = 0; i != CONCURRENT_THREADS; ++i) {
+        thrd_create(&producers[i], producer, (void*)i);
+        thrd_create(&consumers[i], consumer, NULL);
+    }
+    for(size_t i = 0; i != CONCURRENT_THREADS; ++i) {
+        thrd_join(producers[i], NULL);
+        thrd_join(consumers[i], NULL);
+    }
+    TEST_ASSERT_EQUAL(N * (N + 1) / 2, atomic_load(&popped_sum));
+    TEST_ASSERT_EQUAL(mtdp_buffer_mpmc_size(queue), 0);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_black_box);
+    RUN_TEST(test_resize_keeps_order);
+    RUN_TEST(test_concurrent_no_loss);
+    UNITY_END();
+}
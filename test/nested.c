@@ -0,0 +1,187 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define BUFFERS 8
+#define ITEMS   10000
+
+/*
+    Every stage adds its increment to the item: the sink checks the items arrive in order, having
+    been through every stage of the outer pipeline but the one replaced, and every nested one.
+*/
+static size_t         increments[] = {1, 10, 100};
+static mtdp_pipeline* outer;
+static mtdp_pipeline* nested;
+
+static void add(mtdp_stage_context* context)
+{
+    *(size_t*)context->output = *(size_t*)context->input + *(size_t*)context->self;
+    context->ready_to_pull = context->ready_to_push = true;
+}
+
+/* Only the pipes given get buffers */
+static mtdp_pipeline* create(size_t stages, size_t first_pipe, size_t last_pipe)
+{
+    mtdp_pipeline* pipeline = fixture_create(stages, fixture_produce, add, fixture_consume);
+
+    for(size_t i = 0; i != stages; ++i) {
+        mtdp_pipeline_get_stages(pipeline)[i].self = &increments[i % 3];
+    }
+    /* Every pipe gets a different number of buffers, to tell whose pool they go back to. */
+    for(size_t i = first_pipe; i <= last_pipe; ++i) {
+        fixture_fill(pipeline, i, i, BUFFERS + i, sizeof(size_t));
+    }
+    return pipeline;
+}
+
+static void run()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(outer));
+    TEST_ASSERT_TRUE(nested->enabled);
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(nested));
+    mtdp_pipeline_wait(outer);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(outer));
+    TEST_ASSERT_FALSE(nested->enabled);
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(0, fixture_stream.errors);
+    /* Every buffer went back to the pipe owning it. */
+    for(size_t i = 0; i <= outer->n_stages; ++i) {
+        TEST_ASSERT_EQUAL(BUFFERS + i, mtdp_buffer_pool_size(&outer->pipes[i].pool));
+    }
+    for(size_t i = 1; i != nested->n_stages; ++i) {
+        TEST_ASSERT_EQUAL(BUFFERS + i, mtdp_buffer_pool_size(&nested->pipes[i].pool));
+    }
+}
+
+void setUp()
+{
+    fixture_stream_reset(ITEMS);
+    /* source -> +1 -> [+1 -> +10 -> +100] -> +100 -> sink */
+    fixture_stream.offset = 1 + 1 + 10 + 100 + 100;
+    outer                 = create(3, 0, 3);
+    nested                = create(3, 1, 2);
+}
+
+void tearDown()
+{
+    fixture_destroy(nested);
+    fixture_destroy(outer);
+}
+
+void test_nested_pipeline_runs_in_place_of_a_stage()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_nested(outer, 1, nested));
+    run();
+}
+
+void test_nested_pipeline_with_replicated_stage()
+{
+    mtdp_pipeline_get_stages(nested)[1].replicas = 3;
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_nested(outer, 1, nested));
+    run();
+}
+
+void test_nested_pipeline_pulls_from_the_source()
+{
+    fixture_destroy(nested);
+    nested                = create(1, 1, 0);
+    fixture_stream.offset = 1 + 10 + 100;
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_nested(outer, 0, nested));
+    run();
+}
+
+void test_pipelines_nested_twice()
+{
+    mtdp_pipeline* inner = create(1, 1, 0);
+
+    fixture_stream.offset = 1 + 1 + 1 + 100 + 100;
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_nested(nested, 1, inner));
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_nested(outer, 1, nested));
+    run();
+    fixture_destroy(inner);
+    TEST_ASSERT_EQUAL(0, nested->n_nested);
+}
+
+void test_removed_nested_pipeline_runs_alone()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_nested(outer, 1, nested));
+    TEST_ASSERT_TRUE(mtdp_pipeline_remove_nested(outer, nested));
+    TEST_ASSERT_NULL(nested->outer);
+    fixture_stream.offset = 1 + 10 + 100;
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(outer));
+    TEST_ASSERT_FALSE(nested->enabled);
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(outer));
+    mtdp_pipeline_wait(outer);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(outer));
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(0, fixture_stream.errors);
+}
+
+void test_add_nested_rejects_bad_links()
+{
+    mtdp_pipeline* empty = create(0, 1, 0);
+
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_nested(outer, 3, nested));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_nested(outer, 1, outer));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_nested(outer, 1, empty));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_nested(NULL, 1, nested));
+    TEST_ASSERT_EQUAL(MTDP_BAD_PTR, mtdp_errno);
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_nested(outer, 1, nested));
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_nested(outer, 1, empty));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_nested(nested, 0, outer));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_add_branch(outer, 0, nested));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_remove_nested(nested, outer));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    fixture_destroy(empty);
+}
+
+void test_replaced_stage_is_not_replicated()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_add_nested(outer, 1, nested));
+    mtdp_pipeline_get_stages(outer)[1].replicas = 2;
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(outer));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(nested->enabled);
+    mtdp_pipeline_get_stages(outer)[1].replicas = 1;
+    mtdp_pipeline_get_stages(nested)[2].replicas = 2;
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(nested));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    mtdp_pipeline_get_stages(nested)[2].replicas = 1;
+    TEST_ASSERT_FALSE(mtdp_pipeline_splice_out(outer, 2));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_nested_pipeline_runs_in_place_of_a_stage);
+    RUN_TEST(test_nested_pipeline_with_replicated_stage);
+    RUN_TEST(test_nested_pipeline_pulls_from_the_source);
+    RUN_TEST(test_pipelines_nested_twice);
+    RUN_TEST(test_removed_nested_pipeline_runs_alone);
+    RUN_TEST(test_add_nested_rejects_bad_links);
+    RUN_TEST(test_replaced_stage_is_not_replicated);
+    UNITY_END();
+}
@@ -0,0 +1,145 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define REPLICAS 4
+#define KEYS     64
+#define BUFFERS  16
+#define ITEMS    20000
+
+/*
+    The items of every key are numbered in order. Each key shall always be processed by the same
+    thread, which keeps its state without locks: the number of items seen for that key.
+*/
+typedef struct {
+    size_t key, index;
+} item;
+
+static size_t         produced, consumed, errors;
+static size_t         seen[KEYS];
+static thrd_t         owners[KEYS];
+static bool           owned[KEYS];
+static mtdp_pipeline* pipeline;
+
+static void produce(mtdp_source_context* context)
+{
+    item* i = (item*)context->output;
+    if(produced == ITEMS) {
+        mtdp_source_finished(context);
+        return;
+    }
+    i->key                 = produced % KEYS;
+    i->index               = produced++ / KEYS;
+    context->ready_to_push = true;
+}
+
+static void process(mtdp_stage_context* context)
+{
+    item* i = (item*)context->input;
+    if(!owned[i->key]) {
+        owners[i->key] = thrd_current();
+        owned[i->key]  = true;
+    }
+    errors += !thrd_equal(owners[i->key], thrd_current());
+    errors += i->index != seen[i->key]++;
+    *(item*)context->output = *i;
+    context->ready_to_pull = context->ready_to_push = true;
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    ++consumed;
+    context->ready_to_pull = true;
+}
+
+static size_t key(const mtdp_buffer buffer)
+{
+    return ((const item*)buffer)->key;
+}
+
+void setUp()
+{
+    mtdp_stage* stage;
+
+    produced = consumed = errors = 0;
+    memset(seen, 0, sizeof(seen));
+    memset(owned, 0, sizeof(owned));
+    pipeline        = fixture_create(1, produce, process, consume);
+    stage           = mtdp_pipeline_get_stages(pipeline);
+    stage->replicas = REPLICAS;
+    stage->key      = key;
+    fixture_fill(pipeline, 0, 1, BUFFERS, sizeof(item));
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+static void run()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_EQUAL(REPLICAS, pipeline->pipes[0].n_partitions);
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(ITEMS, consumed);
+    TEST_ASSERT_EQUAL(0, errors);
+    TEST_ASSERT_EQUAL(0, pipeline->pipes[0].n_partitions);
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&pipeline->pipes[0].pool));
+}
+
+void test_keys_stick_to_their_replica()
+{
+    run();
+}
+
+void test_keys_stick_to_their_replica_with_mpmc_pipes()
+{
+    mtdp_pipe_set_transport(&pipeline->pipes[0], MTDP_PIPE_TRANSPORT_MPMC);
+    mtdp_pipe_set_transport(&pipeline->pipes[1], MTDP_PIPE_TRANSPORT_MPMC);
+    run();
+}
+
+void test_partitions_are_cleared_on_disable()
+{
+    mtdp_pipeline_enable(pipeline);
+    mtdp_pipeline_start(pipeline);
+    mtdp_pipeline_disable(pipeline);
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&pipeline->pipes[0].pool));
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&pipeline->pipes[1].pool));
+}
+
+void test_partitioned_stage_rejects_spsc_pipes()
+{
+    mtdp_pipe_set_transport(&pipeline->pipes[0], MTDP_PIPE_TRANSPORT_SPSC);
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_keys_stick_to_their_replica);
+    RUN_TEST(test_keys_stick_to_their_replica_with_mpmc_pipes);
+    RUN_TEST(test_partitions_are_cleared_on_disable);
+    RUN_TEST(test_partitioned_stage_rejects_spsc_pipes);
+    UNITY_END();
+}
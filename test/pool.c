@@ -0,0 +1,148 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <threads.h>
+#include <unity.h>
+
+#include "fixture.h"
+#include "sem.h"
+
+#define ITEMS   500
+#define TIMEOUT 10000000 /* microseconds: a wake-up never takes that long */
+
+/*
+    The first pipe holds a single buffer. A thread standing for the producer waits for it
+    while the test holds it, so that the producer parks on the empty pool until it is put back.
+*/
+static mtdp_wait_policy policy;
+static mtdp_buffer      got;
+static mtdp_pipeline*   pipeline;
+
+static int wait_empty(void* arg)
+{
+    got = mtdp_pipe_wait_empty_buffer((mtdp_pipe*)arg, policy, TIMEOUT);
+    return 0;
+}
+
+/* Slower than the source, which keeps running out of buffers */
+static void consume(mtdp_sink_context* context)
+{
+    fixture_consume(context);
+    thrd_sleep(&(struct timespec){.tv_nsec = 100000}, NULL);
+}
+
+/* Holds the only buffer of the first pipe, until a thread parks waiting for it, then releases it */
+static void put_back_to_a_parked_producer(mtdp_pipe_transport transport)
+{
+    mtdp_pipe*  pipe = &pipeline->pipes[0];
+    mtdp_buffer buffer;
+    thrd_t      thread;
+    uint64_t    start;
+
+    TEST_ASSERT_TRUE(mtdp_pipe_set_transport(pipe, transport));
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    /* Pushed and pulled, as the consumer of the pipe would. */
+    buffer = mtdp_pipe_get_empty_buffer(pipe);
+    TEST_ASSERT_NOT_NULL(buffer);
+    TEST_ASSERT_TRUE(mtdp_pipe_push_buffer(pipe, buffer));
+    mtdp_pipe_signal_full(pipe, 1);
+    TEST_ASSERT_TRUE(mtdp_pipe_wait_full(pipe, MTDP_WAIT_BLOCK, TIMEOUT));
+    TEST_ASSERT_EQUAL_PTR(buffer, mtdp_pipe_get_full_buffer(pipe));
+    TEST_ASSERT_NULL(mtdp_pipe_get_empty_buffer(pipe));
+    got   = NULL;
+    start = mtdp_semaphore_now_us();
+    thrd_create(&thread, wait_empty, pipe);
+    while(!atomic_load(&pipe->pool_event.waiters)) {
+        thrd_yield();
+    }
+    thrd_sleep(&(struct timespec){.tv_nsec = 10000000}, NULL);
+    TEST_ASSERT_NULL(got);
+    TEST_ASSERT_TRUE(mtdp_pipe_put_back(pipe, buffer));
+    thrd_join(thread, NULL);
+    TEST_ASSERT_EQUAL_PTR(buffer, got);
+    TEST_ASSERT_LESS_THAN(TIMEOUT, mtdp_semaphore_now_us() - start);
+    TEST_ASSERT_TRUE(mtdp_pipe_unclaim(pipe, got));
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(1, mtdp_buffer_pool_size(&pipe->pool));
+}
+
+void setUp()
+{
+    fixture_stream_reset(ITEMS);
+    policy   = MTDP_WAIT_BLOCK;
+    pipeline = fixture_create(1, fixture_produce, fixture_pass, consume);
+    fixture_fill(pipeline, 0, 1, 1, sizeof(size_t));
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+void test_put_back_wakes_a_parked_producer()
+{
+    put_back_to_a_parked_producer(MTDP_PIPE_TRANSPORT_LOCKED);
+}
+
+void test_put_back_wakes_a_parked_producer_after_spinning()
+{
+    policy = MTDP_WAIT_SPIN_THEN_PARK;
+    put_back_to_a_parked_producer(MTDP_PIPE_TRANSPORT_LOCKED);
+}
+
+void test_put_back_wakes_a_parked_producer_on_lock_free_pipes()
+{
+    put_back_to_a_parked_producer(MTDP_PIPE_TRANSPORT_SPSC);
+    put_back_to_a_parked_producer(MTDP_PIPE_TRANSPORT_RING);
+    put_back_to_a_parked_producer(MTDP_PIPE_TRANSPORT_MPMC);
+}
+
+void test_parked_producer_times_out()
+{
+    mtdp_pipe*  pipe = &pipeline->pipes[0];
+    mtdp_buffer buffer;
+    uint64_t    start;
+
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    buffer = mtdp_pipe_get_empty_buffer(pipe);
+    start  = mtdp_semaphore_now_us();
+    TEST_ASSERT_NULL(mtdp_pipe_wait_empty_buffer(pipe, MTDP_WAIT_BLOCK, 20000));
+    TEST_ASSERT_GREATER_OR_EQUAL(20000, mtdp_semaphore_now_us() - start);
+    TEST_ASSERT_EQUAL(0, atomic_load(&pipe->pool_event.waiters));
+    TEST_ASSERT_TRUE(mtdp_pipe_unclaim(pipe, buffer));
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+}
+
+void test_producers_keep_up_with_a_slow_consumer()
+{
+    /* Every step but the sink keeps parking on a pool of a single buffer. */
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(0, fixture_stream.errors);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_put_back_wakes_a_parked_producer);
+    RUN_TEST(test_put_back_wakes_a_parked_producer_after_spinning);
+    RUN_TEST(test_put_back_wakes_a_parked_producer_on_lock_free_pipes);
+    RUN_TEST(test_parked_producer_times_out);
+    RUN_TEST(test_producers_keep_up_with_a_slow_consumer);
+    UNITY_END();
+}
@@ -0,0 +1,105 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <unity.h>
+
+#include "mtdp.h"
+#include "impl/buffer.h"
+
+#define ITEMS 64
+
+mtdp_buffer_reorder g_reorder;
+mtdp_buffer_reorder* reorder = &g_reorder;
+
+void setUp()
+{
+    mtdp_buffer_reorder_init(reorder);
+}
+
+void tearDown()
+{
+    mtdp_buffer_reorder_destroy(reorder);
+}
+
+void test_in_order()
+{
+    mtdp_buffer buf = NULL;
+
+    TEST_ASSERT_FALSE(mtdp_buffer_reorder_pop(reorder, &buf));
+    for(size_t i = 0; i != ITEMS; ++i) {
+        TEST_ASSERT_TRUE(mtdp_buffer_reorder_put(reorder, i, (mtdp_buffer)(i + 1)));
+        TEST_ASSERT_TRUE(mtdp_buffer_reorder_pop(reorder, &buf));
+        TEST_ASSERT_EQUAL(i + 1, buf);
+        TEST_ASSERT_FALSE(mtdp_buffer_reorder_pop(reorder, &buf));
+    }
+    TEST_ASSERT_FALSE(mtdp_buffer_reorder_put(reorder, 0, (mtdp_buffer)1));
+}
+
+void test_reversed_order()
+{
+    mtdp_buffer buf = NULL;
+
+    /* Every put but the last one lands beyond the next expected sequence number. */
+    for(size_t i = ITEMS; i--;) {
+        TEST_ASSERT_TRUE(mtdp_buffer_reorder_put(reorder, i, (mtdp_buffer)(i + 1)));
+        TEST_ASSERT_EQUAL(ITEMS - i, mtdp_buffer_reorder_size(reorder));
+        if(i) {
+            TEST_ASSERT_FALSE(mtdp_buffer_reorder_pop(reorder, &buf));
+        }
+    }
+    for(size_t i = 0; i != ITEMS; ++i) {
+        TEST_ASSERT_TRUE(mtdp_buffer_reorder_pop(reorder, &buf));
+        TEST_ASSERT_EQUAL(i + 1, buf);
+    }
+    TEST_ASSERT_FALSE(mtdp_buffer_reorder_pop(reorder, &buf));
+    TEST_ASSERT_EQUAL(0, mtdp_buffer_reorder_size(reorder));
+}
+
+void test_skips()
+{
+    mtdp_buffer buf = NULL;
+
+    TEST_ASSERT_TRUE(mtdp_buffer_reorder_put(reorder, 2, (mtdp_buffer)3));
+    TEST_ASSERT_TRUE(mtdp_buffer_reorder_skip(reorder, 1));
+    TEST_ASSERT_FALSE(mtdp_buffer_reorder_pop(reorder, &buf));
+    TEST_ASSERT_TRUE(mtdp_buffer_reorder_skip(reorder, 0));
+    TEST_ASSERT_TRUE(mtdp_buffer_reorder_pop(reorder, &buf));
+    TEST_ASSERT_EQUAL(3, buf);
+    TEST_ASSERT_FALSE(mtdp_buffer_reorder_pop(reorder, &buf));
+}
+
+void test_reset()
+{
+    mtdp_buffer buf = NULL;
+
+    TEST_ASSERT_TRUE(mtdp_buffer_reorder_put(reorder, 5, (mtdp_buffer)6));
+    TEST_ASSERT_TRUE(mtdp_buffer_reorder_put(reorder, 9, (mtdp_buffer)10));
+    TEST_ASSERT_TRUE(mtdp_buffer_reorder_take_any(reorder, &buf));
+    TEST_ASSERT_TRUE(mtdp_buffer_reorder_take_any(reorder, &buf));
+    TEST_ASSERT_FALSE(mtdp_buffer_reorder_take_any(reorder, &buf));
+    mtdp_buffer_reorder_reset(reorder);
+    TEST_ASSERT_TRUE(mtdp_buffer_reorder_put(reorder, 0, (mtdp_buffer)1));
+    TEST_ASSERT_TRUE(mtdp_buffer_reorder_pop(reorder, &buf));
+    TEST_ASSERT_EQUAL(1, buf);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_in_order);
+    RUN_TEST(test_reversed_order);
+    RUN_TEST(test_skips);
+    RUN_TEST(test_reset);
+    UNITY_END();
+}
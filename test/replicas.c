@@ -0,0 +1,232 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define REPLICAS 4
+#define BUFFERS  16
+#define ITEMS    20000
+#define DROPPED  7
+#define EXPECTED (ITEMS - (ITEMS + DROPPED - 1) / DROPPED)
+
+typedef struct {
+    size_t value, calls;
+    bool   pushed;
+} item;
+
+/*
+    The source numbers the items in order. Both stages take longer on some of them, so that the replicas
+    complete out of order, and drop every DROPPED-th item, pushing nothing for it. The sink checks the
+    input order is kept or, behind unordered replicas, counts how many times it sees every item.
+*/
+static size_t         produced, consumed, errors, next;
+static size_t         seen[ITEMS];
+static atomic_size_t  refused;
+static mtdp_pipeline* pipeline;
+
+static void produce(mtdp_source_context* context)
+{
+    if(produced == ITEMS) {
+        mtdp_source_finished(context);
+        return;
+    }
+    ((item*)context->output)->value  = produced++;
+    ((item*)context->output)->calls  = 0;
+    ((item*)context->output)->pushed = false;
+    context->ready_to_push           = true;
+}
+
+static void process(mtdp_stage_context* context)
+{
+    size_t value = ((item*)context->input)->value;
+
+    for(size_t i = value % 5 * 10; i--;) {
+        thrd_yield();
+    }
+    *(item*)context->output = *(item*)context->input;
+    context->ready_to_push  = value % DROPPED != 0;
+    context->ready_to_pull  = true;
+}
+
+/* Pushes the output and releases the input in two iterations */
+static void process_in_two_steps(mtdp_stage_context* context)
+{
+    item* i = (item*)context->input;
+
+    if(i->pushed) {
+        context->ready_to_pull = true;
+        return;
+    }
+    *(item*)context->output = *i;
+    i->pushed               = true;
+    context->ready_to_push  = true;
+    context->ready_to_pull  = false;
+}
+
+/* Pushes every input twice, in two iterations */
+static void process_twice(mtdp_stage_context* context)
+{
+    item* i = (item*)context->input;
+
+    *(item*)context->output = *i;
+    context->ready_to_push  = true;
+    context->ready_to_pull  = i->pushed;
+    i->pushed               = true;
+}
+
+/* Pushes every input twice, then counts the second push refused before releasing it */
+static void process_twice_ordered(mtdp_stage_context* context)
+{
+    item* i = (item*)context->input;
+
+    if(i->calls++ == 2) {
+        atomic_fetch_add(&refused, mtdp_errno == MTDP_BAD_CONFIG);
+        context->ready_to_pull = true;
+        return;
+    }
+    *(item*)context->output = *i;
+    context->ready_to_push  = true;
+    context->ready_to_pull  = false;
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    size_t value = ((item*)context->input)->value;
+
+    errors += value < next;
+    next = value + 1;
+    ++consumed;
+    context->ready_to_pull = true;
+}
+
+static void consume_unordered(mtdp_sink_context* context)
+{
+    ++seen[((item*)context->input)->value];
+    ++consumed;
+    context->ready_to_pull = true;
+}
+
+static void run(size_t expected)
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(expected, consumed);
+    TEST_ASSERT_EQUAL(0, errors);
+    for(size_t i = 0; i != 3; ++i) {
+        TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&pipeline->pipes[i].pool));
+    }
+}
+
+void setUp()
+{
+    produced = consumed = errors = next = 0;
+    memset(seen, 0, sizeof(seen));
+    atomic_store(&refused, 0);
+    pipeline = fixture_create(2, produce, process, consume);
+    mtdp_pipeline_get_stages(pipeline)[0].replicas = REPLICAS;
+    fixture_fill(pipeline, 0, 2, BUFFERS, sizeof(item));
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+void test_ordered_replicas_keep_the_input_order()
+{
+    run(EXPECTED);
+}
+
+void test_ordered_replicas_push_before_releasing()
+{
+    mtdp_pipeline_get_stages(pipeline)[0].process = process_in_two_steps;
+    run(EXPECTED);
+}
+
+void test_ordered_replicas_after_a_replicated_stage()
+{
+    mtdp_pipeline_get_stages(pipeline)[1].replicas = REPLICAS;
+    run(EXPECTED);
+}
+
+void test_ordered_replicas_drop_a_second_output()
+{
+    /* The sink would see an item twice, out of order, if the second output got through. */
+    mtdp_pipeline_get_stages(pipeline)[0].process = process_twice_ordered;
+    run(EXPECTED);
+    TEST_ASSERT_EQUAL(ITEMS, atomic_load(&refused));
+}
+
+void test_unordered_replicas_let_every_buffer_through_once()
+{
+    mtdp_pipeline_get_stages(pipeline)[0].unordered = true;
+    mtdp_pipeline_get_sink(pipeline)->process       = consume_unordered;
+    run(EXPECTED);
+    for(size_t i = 0; i != ITEMS; ++i) {
+        TEST_ASSERT_EQUAL(i % DROPPED != 0, seen[i]);
+    }
+}
+
+void test_unordered_replicas_push_any_number_of_outputs()
+{
+    mtdp_pipeline_get_stages(pipeline)[0].unordered = true;
+    mtdp_pipeline_get_stages(pipeline)[0].process   = process_twice;
+    mtdp_pipeline_get_sink(pipeline)->process       = consume_unordered;
+    run(2 * EXPECTED);
+    for(size_t i = 0; i != ITEMS; ++i) {
+        TEST_ASSERT_EQUAL(i % DROPPED ? 2 : 0, seen[i]);
+    }
+}
+
+void test_unordered_replicas_share_mpmc_pipes()
+{
+    mtdp_pipeline_get_stages(pipeline)[0].unordered = true;
+    mtdp_pipeline_get_stages(pipeline)[1].replicas  = REPLICAS;
+    mtdp_pipeline_get_stages(pipeline)[1].unordered = true;
+    mtdp_pipe_set_transport(&pipeline->pipes[0], MTDP_PIPE_TRANSPORT_MPMC);
+    mtdp_pipe_set_transport(&pipeline->pipes[1], MTDP_PIPE_TRANSPORT_MPMC);
+    mtdp_pipeline_get_sink(pipeline)->process = consume_unordered;
+    run(EXPECTED);
+    for(size_t i = 0; i != ITEMS; ++i) {
+        TEST_ASSERT_EQUAL(i % DROPPED != 0, seen[i]);
+    }
+}
+
+void test_ordered_replicas_need_locked_pipes()
+{
+    mtdp_pipe_set_transport(&pipeline->pipes[1], MTDP_PIPE_TRANSPORT_MPMC);
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_ordered_replicas_keep_the_input_order);
+    RUN_TEST(test_ordered_replicas_push_before_releasing);
+    RUN_TEST(test_ordered_replicas_after_a_replicated_stage);
+    RUN_TEST(test_ordered_replicas_drop_a_second_output);
+    RUN_TEST(test_ordered_replicas_need_locked_pipes);
+    RUN_TEST(test_unordered_replicas_let_every_buffer_through_once);
+    RUN_TEST(test_unordered_replicas_push_any_number_of_outputs);
+    RUN_TEST(test_unordered_replicas_share_mpmc_pipes);
+    UNITY_END();
+}
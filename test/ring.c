@@ -0,0 +1,119 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <unity.h>
+
+#include "mtdp.h"
+#include "impl/buffer.h"
+#include <threads.h>
+
+#define CAPACITY 16
+
+mtdp_buffer_ring g_ring;
+mtdp_buffer_ring* ring = &g_ring;
+
+void setUp()
+{
+    mtdp_buffer_ring_init(ring);
+    mtdp_buffer_ring_resize(ring, CAPACITY);
+}
+
+void tearDown()
+{
+    mtdp_buffer_ring_destroy(ring);
+}
+
+void test_black_box()
+{
+    const size_t PUSH_ATTEMPTS = CAPACITY + 4, POP_ATTEMPTS = CAPACITY + 8;
+    TEST_ASSERT_EQUAL(mtdp_buffer_ring_size(ring), 0);
+
+    mtdp_buffer buf = NULL;
+    for(size_t i = 0; i != PUSH_ATTEMPTS; ++i) {
+        if(mtdp_buffer_ring_push(ring, (mtdp_buffer)i)) {
+            TEST_ASSERT_EQUAL(mtdp_buffer_ring_size(ring), i + 1);
+        } else {
+            TEST_ASSERT_GREATER_OR_EQUAL(CAPACITY, i);
+        }
+    }
+
+    for(size_t i = 0; i != POP_ATTEMPTS; ++i) {
+        if(mtdp_buffer_ring_pop(ring, &buf)) {
+            TEST_ASSERT_EQUAL(mtdp_buffer_ring_size(ring), CAPACITY - i - 1);
+            TEST_ASSERT_EQUAL(i, buf);
+        } else {
+            TEST_ASSERT_GREATER_OR_EQUAL(CAPACITY, i);
+        }
+    }
+}
+
+void test_resize_keeps_order()
+{
+    mtdp_buffer buf = NULL;
+
+    /* Move the indices away from the beginning of the storage. */
+    for(size_t i = 0; i != CAPACITY / 2; ++i) {
+        mtdp_buffer_ring_push(ring, (mtdp_buffer)i);
+        mtdp_buffer_ring_pop(ring, &buf);
+    }
+    for(size_t i = 0; i != CAPACITY; ++i) {
+        TEST_ASSERT_TRUE(mtdp_buffer_ring_push(ring, (mtdp_buffer)i));
+    }
+    TEST_ASSERT_FALSE(mtdp_buffer_ring_resize(ring, CAPACITY - 1));
+    TEST_ASSERT_TRUE(mtdp_buffer_ring_resize(ring, CAPACITY));
+    for(size_t i = 0; i != CAPACITY; ++i) {
+        TEST_ASSERT_TRUE(mtdp_buffer_ring_pop(ring, &buf));
+        TEST_ASSERT_EQUAL(i, buf);
+    }
+}
+
+#define CONCURRENT_ITEMS 100000
+
+static int producer(void* arg)
+{
+    (void)arg;
+    for(size_t i = 1; i <= CONCURRENT_ITEMS; ++i) {
+        while(!mtdp_buffer_ring_push(ring, (mtdp_buffer)i)) {
+            thrd_yield();
+        }
+    }
+    return 0;
+}
+
+void test_concurrent_order()
+{
+    thrd_t      t;
+    mtdp_buffer buf;
+    size_t      expected = 1;
+
+    thrd_create(&t, producer, NULL);
+    while(expected <= CONCURRENT_ITEMS) {
+        if(mtdp_buffer_ring_pop(ring, &buf)) {
+            TEST_ASSERT_EQUAL(expected++, buf);
+        } else {
+            thrd_yield();
+        }
+    }
+    thrd_join(t, NULL);
+    TEST_ASSERT_EQUAL(mtdp_buffer_ring_size(ring), 0);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_black_box);
+    RUN_TEST(test_resize_keeps_order);
+    RUN_TEST(test_concurrent_order);
+    UNITY_END();
+}
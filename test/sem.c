@@ -0,0 +1,222 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <threads.h>
+#include <unity.h>
+
+#include "event.h"
+#include "sem.h"
+
+#define THREADS 4
+#define TOKENS  100000
+#define TIMEOUT 10000000 /* microseconds: a wake-up never takes that long */
+
+/* The threads acquire or release tokens, or wait for the event, and count what they got. */
+static mtdp_semaphore sem;
+static mtdp_event     event;
+static atomic_bool    condition;
+static atomic_size_t  acquired;
+
+static int release(void* arg)
+{
+    (void)arg;
+    for(size_t i = 0; i != TOKENS; ++i) {
+        mtdp_semaphore_release(&sem, 1);
+    }
+    return 0;
+}
+
+static int acquire(void* arg)
+{
+    size_t n = *(size_t*)arg;
+
+    for(size_t i = 0; i != n; ++i) {
+        if(mtdp_semaphore_try_acquire_for(&sem, TIMEOUT)) {
+            atomic_fetch_add(&acquired, 1);
+        }
+    }
+    return 0;
+}
+
+static int wait_condition(void* arg)
+{
+    uint32_t key;
+
+    (void)arg;
+    for(;;) {
+        key = mtdp_event_prepare(&event);
+        if(atomic_load(&condition)) {
+            mtdp_event_cancel(&event);
+            break;
+        }
+        mtdp_event_wait_for(&event, key, TIMEOUT);
+    }
+    atomic_fetch_add(&acquired, 1);
+    return 0;
+}
+
+/* Waits for every thread to sleep on the futex, so that the wake-up is not taken for granted */
+static void wait_sleepers(atomic_uint32_t* waiters, uint32_t n)
+{
+    while(atomic_load(waiters) != n) {
+        thrd_yield();
+    }
+    thrd_sleep(&(struct timespec){.tv_nsec = 10000000}, NULL);
+}
+
+void setUp()
+{
+    mtdp_semaphore_init(&sem);
+    mtdp_event_init(&event);
+    atomic_store(&condition, false);
+    atomic_store(&acquired, 0);
+}
+
+void tearDown()
+{
+    mtdp_semaphore_destroy(&sem);
+}
+
+void test_semaphore_counts_the_releases()
+{
+    TEST_ASSERT_FALSE(mtdp_semaphore_try_acquire(&sem));
+    mtdp_semaphore_release(&sem, 3);
+    for(size_t i = 0; i != 3; ++i) {
+        TEST_ASSERT_TRUE(mtdp_semaphore_try_acquire(&sem));
+    }
+    TEST_ASSERT_FALSE(mtdp_semaphore_try_acquire(&sem));
+    TEST_ASSERT_EQUAL(0, atomic_load(&sem.waiters));
+}
+
+void test_semaphore_acquire_times_out()
+{
+    uint64_t start = mtdp_semaphore_now_us();
+
+    TEST_ASSERT_FALSE(mtdp_semaphore_try_acquire_for(&sem, 20000));
+    TEST_ASSERT_GREATER_OR_EQUAL(20000, mtdp_semaphore_now_us() - start);
+    TEST_ASSERT_EQUAL(0, atomic_load(&sem.waiters));
+}
+
+void test_semaphore_release_wakes_a_sleeper()
+{
+    thrd_t   thread;
+    size_t   n     = 1;
+    uint64_t start = mtdp_semaphore_now_us();
+
+    thrd_create(&thread, acquire, &n);
+    wait_sleepers(&sem.waiters, 1);
+    mtdp_semaphore_release(&sem, 1);
+    thrd_join(thread, NULL);
+    TEST_ASSERT_EQUAL(1, atomic_load(&acquired));
+    TEST_ASSERT_LESS_THAN(TIMEOUT, mtdp_semaphore_now_us() - start);
+}
+
+void test_semaphore_release_of_many_wakes_every_sleeper()
+{
+    thrd_t threads[THREADS];
+    size_t n = 1;
+
+    for(size_t i = 0; i != THREADS; ++i) {
+        thrd_create(&threads[i], acquire, &n);
+    }
+    wait_sleepers(&sem.waiters, THREADS);
+    mtdp_semaphore_release(&sem, THREADS);
+    for(size_t i = 0; i != THREADS; ++i) {
+        thrd_join(threads[i], NULL);
+    }
+    TEST_ASSERT_EQUAL(THREADS, atomic_load(&acquired));
+}
+
+void test_semaphore_loses_no_token()
+{
+    thrd_t producers[THREADS], consumers[THREADS];
+    size_t n = TOKENS;
+
+    for(size_t i = 0; i != THREADS; ++i) {
+        thrd_create(&consumers[i], acquire, &n);
+        thrd_create(&producers[i], release, NULL);
+    }
+    for(size_t i = 0; i != THREADS; ++i) {
+        thrd_join(producers[i], NULL);
+        thrd_join(consumers[i], NULL);
+    }
+    TEST_ASSERT_EQUAL(THREADS * TOKENS, atomic_load(&acquired));
+    TEST_ASSERT_FALSE(mtdp_semaphore_try_acquire(&sem));
+}
+
+void test_semaphore_wait_released_returns_on_a_change()
+{
+    uint64_t start = mtdp_semaphore_now_us();
+
+    /* The count already moved: no wait at all. */
+    mtdp_semaphore_release(&sem, 1);
+    mtdp_semaphore_wait_released(&sem, 0, TIMEOUT);
+    TEST_ASSERT_LESS_THAN(TIMEOUT, mtdp_semaphore_now_us() - start);
+    mtdp_semaphore_wait_released(&sem, 1, 20000);
+    TEST_ASSERT_GREATER_OR_EQUAL(20000, mtdp_semaphore_now_us() - start);
+    TEST_ASSERT_TRUE(mtdp_semaphore_try_acquire(&sem));
+}
+
+void test_event_notify_without_waiters_is_free()
+{
+    mtdp_event_notify(&event);
+    TEST_ASSERT_EQUAL(0, atomic_load(&event.epoch));
+}
+
+void test_event_wakes_every_waiter()
+{
+    thrd_t   threads[THREADS];
+    uint64_t start = mtdp_semaphore_now_us();
+
+    for(size_t i = 0; i != THREADS; ++i) {
+        thrd_create(&threads[i], wait_condition, NULL);
+    }
+    wait_sleepers(&event.waiters, THREADS);
+    TEST_ASSERT_EQUAL(0, atomic_load(&acquired));
+    atomic_store(&condition, true);
+    mtdp_event_notify(&event);
+    for(size_t i = 0; i != THREADS; ++i) {
+        thrd_join(threads[i], NULL);
+    }
+    TEST_ASSERT_EQUAL(THREADS, atomic_load(&acquired));
+    TEST_ASSERT_LESS_THAN(TIMEOUT, mtdp_semaphore_now_us() - start);
+    TEST_ASSERT_EQUAL(0, atomic_load(&event.waiters));
+}
+
+void test_event_notified_after_prepare_does_not_sleep()
+{
+    uint64_t start = mtdp_semaphore_now_us();
+    uint32_t key   = mtdp_event_prepare(&event);
+
+    /* The notification lands between the check of the condition and the wait. */
+    mtdp_event_notify(&event);
+    mtdp_event_wait_for(&event, key, TIMEOUT);
+    TEST_ASSERT_LESS_THAN(TIMEOUT, mtdp_semaphore_now_us() - start);
+    TEST_ASSERT_EQUAL(0, atomic_load(&event.waiters));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_semaphore_counts_the_releases);
+    RUN_TEST(test_semaphore_acquire_times_out);
+    RUN_TEST(test_semaphore_release_wakes_a_sleeper);
+    RUN_TEST(test_semaphore_release_of_many_wakes_every_sleeper);
+    RUN_TEST(test_semaphore_loses_no_token);
+    RUN_TEST(test_semaphore_wait_released_returns_on_a_change);
+    RUN_TEST(test_event_notify_without_waiters_is_free);
+    RUN_TEST(test_event_wakes_every_waiter);
+    RUN_TEST(test_event_notified_after_prepare_does_not_sleep);
+    UNITY_END();
+}
@@ -0,0 +1,158 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define PIPELINES 6
+#define STAGES    2
+#define TASKS     (STAGES + 2)
+#define THREADS   2
+#define BUFFERS   8
+#define ITEMS     5000
+
+/*
+    Every pipeline runs its own numbered stream on the threads of the executor, fewer than
+    the tasks of all the pipelines together: each sink checks it receives its stream in order.
+*/
+typedef struct {
+    size_t items, produced, consumed, errors;
+} stream;
+
+static stream         streams[PIPELINES];
+static mtdp_executor* executor;
+static mtdp_pipeline* pipelines[PIPELINES];
+
+static void produce(mtdp_source_context* context)
+{
+    stream* s = (stream*)context->self;
+    if(s->produced == s->items) {
+        mtdp_source_finished(context);
+        return;
+    }
+    *(size_t*)context->output = s->produced++;
+    context->ready_to_push    = true;
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    stream* s = (stream*)context->self;
+    s->errors += *(size_t*)context->input != s->consumed++;
+    context->ready_to_pull = true;
+}
+
+/* Creates the executor with room for the tasks of n pipelines, then all the pipelines on it */
+static void create(size_t n)
+{
+    mtdp_pipeline_parameters parameters = {0};
+
+    executor = mtdp_executor_create(THREADS, n * TASKS);
+    TEST_ASSERT_NOT_NULL(executor);
+    parameters.params.internal_stages = STAGES;
+    parameters.params.executor        = executor;
+    for(size_t i = 0; i != PIPELINES; ++i) {
+        streams[i].items                             = ITEMS;
+        pipelines[i]                                 = fixture_create_with(&parameters, produce, fixture_pass, consume);
+        mtdp_pipeline_get_source(pipelines[i])->self = &streams[i];
+        mtdp_pipeline_get_sink(pipelines[i])->self   = &streams[i];
+        fixture_fill(pipelines[i], 0, STAGES, BUFFERS, sizeof(size_t));
+    }
+}
+
+void setUp()
+{
+    memset(streams, 0, sizeof(streams));
+    executor = NULL;
+}
+
+void tearDown()
+{
+    for(size_t i = 0; i != PIPELINES; ++i) {
+        fixture_destroy(pipelines[i]);
+    }
+    mtdp_executor_destroy(executor);
+}
+
+void test_pipelines_share_fewer_threads_than_tasks()
+{
+    create(PIPELINES);
+    for(size_t i = 0; i != PIPELINES; ++i) {
+        TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipelines[i]));
+        TEST_ASSERT_TRUE(mtdp_pipeline_start(pipelines[i]));
+    }
+    for(size_t i = 0; i != PIPELINES; ++i) {
+        mtdp_pipeline_wait(pipelines[i]);
+        TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipelines[i]));
+        TEST_ASSERT_EQUAL(ITEMS, streams[i].consumed);
+        TEST_ASSERT_EQUAL(0, streams[i].errors);
+    }
+}
+
+void test_enable_fails_past_the_capacity()
+{
+    create(2);
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipelines[0]));
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipelines[1]));
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(pipelines[2]));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(pipelines[2]->enabled);
+    /* The tasks of a disabled pipeline make room for another one. */
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipelines[0]));
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipelines[2]));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipelines[2]));
+    mtdp_pipeline_wait(pipelines[2]);
+    TEST_ASSERT_EQUAL(ITEMS, streams[2].consumed);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipelines[2]));
+    /* Replicas are tasks as well. */
+    mtdp_pipeline_get_stages(pipelines[0])[0].replicas = 2;
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(pipelines[0]));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipelines[1]));
+}
+
+void test_no_pipeline_starves()
+{
+    /* The first stream never ends: the others shall still get their turn and end. */
+    create(PIPELINES);
+    for(size_t i = 0; i != PIPELINES; ++i) {
+        TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipelines[i]));
+    }
+    streams[0].items = SIZE_MAX;
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipelines[0]));
+    for(size_t i = 1; i != PIPELINES; ++i) {
+        TEST_ASSERT_TRUE(mtdp_pipeline_start(pipelines[i]));
+    }
+    for(size_t i = 1; i != PIPELINES; ++i) {
+        mtdp_pipeline_wait(pipelines[i]);
+        TEST_ASSERT_EQUAL(ITEMS, streams[i].consumed);
+        TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipelines[i]));
+    }
+    TEST_ASSERT_TRUE(mtdp_pipeline_stop(pipelines[0]));
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipelines[0]));
+    TEST_ASSERT_TRUE(streams[0].consumed > 0);
+    TEST_ASSERT_EQUAL(0, streams[0].errors);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_pipelines_share_fewer_threads_than_tasks);
+    RUN_TEST(test_enable_fails_past_the_capacity);
+    RUN_TEST(test_no_pipeline_starves);
+    UNITY_END();
+}
@@ -0,0 +1,208 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define STAGES  3
+#define BUFFERS 8
+#define ITEMS   200000
+#define SPLICES 20
+
+/* Every stage marks the items it processes: the sink checks none of them is lost, reordered or marked twice. */
+typedef struct {
+    size_t   value;
+    unsigned marks;
+} item;
+
+static size_t         produced, consumed, errors, marked;
+static mtdp_pipeline* pipeline;
+
+static void produce(mtdp_source_context* context)
+{
+    item* i = (item*)context->output;
+    if(produced == ITEMS) {
+        mtdp_source_finished(context);
+        return;
+    }
+    i->value               = produced++;
+    i->marks               = 0;
+    context->ready_to_push = true;
+}
+
+static void mark(mtdp_stage_context* context)
+{
+    unsigned bit = 1u << (size_t)context->self;
+    item*    i   = (item*)context->output;
+
+    *i = *(item*)context->input;
+    errors += (i->marks & bit) != 0;
+    i->marks |= bit;
+    context->ready_to_pull = context->ready_to_push = true;
+}
+
+/* Pushes the odd inputs only, so that it often holds an output it claimed but did not push */
+static void mark_every_other(mtdp_stage_context* context)
+{
+    mark(context);
+    context->ready_to_push = ((item*)context->input)->value % 2;
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    item* i = (item*)context->input;
+    errors += i->value != consumed++;
+    /* The first and the last stages are never spliced out. */
+    errors += (i->marks & 5u) != 5u;
+    marked += (i->marks & 2u) != 0;
+    context->ready_to_pull = true;
+}
+
+/* Checks the items are still in order, the even ones being filtered out while the stage is in */
+static void consume_filtered(mtdp_sink_context* context)
+{
+    item* i = (item*)context->input;
+    errors += i->value < consumed || (i->marks & 5u) != 5u;
+    errors += (i->marks & 2u) && i->value % 2 == 0;
+    consumed = i->value + 1;
+    context->ready_to_pull = true;
+}
+
+void setUp()
+{
+    produced = consumed = errors = marked = 0;
+    pipeline = fixture_create(STAGES, produce, mark, consume);
+    for(size_t i = 0; i != STAGES; ++i) {
+        mtdp_pipeline_get_stages(pipeline)[i].self = (mtdp_stage_data)i;
+    }
+    fixture_fill(pipeline, 0, STAGES, BUFFERS, sizeof(item));
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+static void finish()
+{
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(ITEMS, consumed);
+    TEST_ASSERT_EQUAL(0, errors);
+    for(size_t i = 0; i <= STAGES; ++i) {
+        TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&pipeline->pipes[i].pool));
+    }
+}
+
+void test_stage_spliced_out_before_enabling()
+{
+    mtdp_pipeline_get_stages(pipeline)[1].spliced_out = true;
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    finish();
+    TEST_ASSERT_EQUAL(0, marked);
+}
+
+void test_stage_spliced_while_running()
+{
+    struct timespec pause = {0, 1000000};
+
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    for(size_t i = 0; i != SPLICES; ++i) {
+        TEST_ASSERT_TRUE(mtdp_pipeline_splice_out(pipeline, 1));
+        TEST_ASSERT_TRUE(mtdp_pipeline_get_stages(pipeline)[1].spliced_out);
+        thrd_sleep(&pause, NULL);
+        TEST_ASSERT_TRUE(mtdp_pipeline_splice_in(pipeline, 1));
+        thrd_sleep(&pause, NULL);
+    }
+    finish();
+    TEST_ASSERT_TRUE(marked > 0);
+}
+
+void test_stage_spliced_next_to_a_lock_free_pipe()
+{
+    mtdp_pipeline_get_stages(pipeline)[1].spliced_out = true;
+    mtdp_pipe_set_transport(&pipeline->pipes[2], MTDP_PIPE_TRANSPORT_SPSC);
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_splice_in(pipeline, 1));
+    TEST_ASSERT_TRUE(mtdp_pipeline_splice_out(pipeline, 1));
+    TEST_ASSERT_TRUE(mtdp_pipeline_splice_in(pipeline, 1));
+    finish();
+}
+
+void test_filtering_stage_spliced_next_to_lock_free_pipes()
+{
+    struct timespec     pause        = {0, 100000};
+    mtdp_pipe_transport transports[] = {MTDP_PIPE_TRANSPORT_SPSC, MTDP_PIPE_TRANSPORT_RING, MTDP_PIPE_TRANSPORT_MPMC};
+
+    mtdp_pipeline_get_stages(pipeline)[1].process = mark_every_other;
+    mtdp_pipeline_get_sink(pipeline)->process     = consume_filtered;
+    for(size_t t = 0; t != sizeof(transports) / sizeof(*transports); ++t) {
+        produced = consumed = errors = 0;
+        mtdp_pipe_set_transport(&pipeline->pipes[1], transports[t]);
+        mtdp_pipe_set_transport(&pipeline->pipes[2], transports[t]);
+        TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+        TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+        for(size_t i = 0; i != 2 * SPLICES; ++i) {
+            TEST_ASSERT_TRUE(mtdp_pipeline_splice_out(pipeline, 1));
+            thrd_sleep(&pause, NULL);
+            TEST_ASSERT_TRUE(mtdp_pipeline_splice_in(pipeline, 1));
+            thrd_sleep(&pause, NULL);
+        }
+        mtdp_pipeline_wait(pipeline);
+        TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+        TEST_ASSERT_EQUAL(ITEMS, consumed);
+        TEST_ASSERT_EQUAL(0, errors);
+        for(size_t i = 0; i <= STAGES; ++i) {
+            TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&pipeline->pipes[i].pool));
+        }
+    }
+}
+
+void test_splice_is_checked()
+{
+    TEST_ASSERT_FALSE(mtdp_pipeline_splice_in(pipeline, 1));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_splice_out(pipeline, STAGES));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_splice_out(NULL, 0));
+    TEST_ASSERT_EQUAL(MTDP_BAD_PTR, mtdp_errno);
+    mtdp_pipeline_get_stages(pipeline)[2].replicas = 2;
+    TEST_ASSERT_FALSE(mtdp_pipeline_splice_out(pipeline, 1));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    mtdp_pipeline_get_stages(pipeline)[1].spliced_out = true;
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    mtdp_pipeline_get_stages(pipeline)[2].replicas = 1;
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_FALSE(mtdp_pipeline_splice_in(pipeline, 1));
+    TEST_ASSERT_EQUAL(MTDP_ENABLED, mtdp_errno);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_stage_spliced_out_before_enabling);
+    RUN_TEST(test_stage_spliced_while_running);
+    RUN_TEST(test_stage_spliced_next_to_a_lock_free_pipe);
+    RUN_TEST(test_filtering_stage_spliced_next_to_lock_free_pipes);
+    RUN_TEST(test_splice_is_checked);
+    UNITY_END();
+}
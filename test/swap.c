@@ -0,0 +1,166 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define BUFFERS 8
+#define ITEMS   200000
+
+/*
+    The stage adds the offset it is given as user data: the sink checks that every item produced
+    after the swap returned got the new offset, and that a single replica never switches back.
+*/
+typedef struct {
+    size_t value, result;
+} item;
+
+static atomic_size_t  produced, swapped_at, inits;
+static size_t         consumed, errors, last_offset;
+static size_t         offsets[] = {1, 2};
+static mtdp_pipeline* pipeline;
+
+static void produce(mtdp_source_context* context)
+{
+    item* i = (item*)context->output;
+    if(atomic_load(&produced) == ITEMS) {
+        mtdp_source_finished(context);
+        return;
+    }
+    i->value               = atomic_fetch_add(&produced, 1);
+    context->ready_to_push = true;
+}
+
+static void init(mtdp_stage_context* context)
+{
+    (void)context;
+    atomic_fetch_add(&inits, 1);
+}
+
+static void add(mtdp_stage_context* context)
+{
+    item* i = (item*)context->output;
+    *i        = *(item*)context->input;
+    i->result = i->value + *(size_t*)context->self;
+    context->ready_to_pull = context->ready_to_push = true;
+}
+
+static void add_twice(mtdp_stage_context* context)
+{
+    add(context);
+    ((item*)context->output)->result += *(size_t*)context->self;
+}
+
+static void consume(mtdp_sink_context* context)
+{
+    item*  i      = (item*)context->input;
+    size_t offset = i->result - i->value;
+    ++consumed;
+    errors += i->value >= atomic_load(&swapped_at) && offset != 4;
+    errors += offset < last_offset && mtdp_pipeline_get_stages(pipeline)->replicas == 1;
+    last_offset            = offset;
+    context->ready_to_pull = true;
+}
+
+static void create(size_t executor_threads)
+{
+    mtdp_pipeline_parameters parameters = {0};
+
+    parameters.params.internal_stages  = 1;
+    parameters.params.executor_threads = executor_threads;
+    pipeline                           = fixture_create_with(&parameters, produce, add, consume);
+    mtdp_pipeline_get_stages(pipeline)->init = init;
+    mtdp_pipeline_get_stages(pipeline)->self = &offsets[0];
+    fixture_fill(pipeline, 0, 1, BUFFERS, sizeof(item));
+}
+
+void setUp()
+{
+    atomic_store(&produced, 0);
+    atomic_store(&swapped_at, SIZE_MAX);
+    atomic_store(&inits, 0);
+    consumed = errors = last_offset = 0;
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+static void run()
+{
+    size_t replicas = mtdp_pipeline_get_stages(pipeline)->replicas;
+
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    while(atomic_load(&produced) < ITEMS / 4) {
+        thrd_yield();
+    }
+    TEST_ASSERT_TRUE(mtdp_pipeline_swap_stage(pipeline, 0, add_twice, &offsets[1]));
+    atomic_store(&swapped_at, atomic_load(&produced));
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(ITEMS, consumed);
+    TEST_ASSERT_EQUAL(0, errors);
+    TEST_ASSERT_EQUAL(4, last_offset);
+    /* Switching callbacks restarts nothing. */
+    TEST_ASSERT_EQUAL(replicas ? replicas : 1, atomic_load(&inits));
+    TEST_ASSERT_EQUAL_PTR(add_twice, mtdp_pipeline_get_stages(pipeline)->process);
+}
+
+void test_swap_while_running()
+{
+    create(0);
+    run();
+}
+
+void test_swap_replicated_stage()
+{
+    create(0);
+    mtdp_pipeline_get_stages(pipeline)->replicas = 3;
+    run();
+}
+
+void test_swap_on_executor()
+{
+    create(2);
+    run();
+}
+
+void test_swap_is_checked()
+{
+    create(0);
+    TEST_ASSERT_FALSE(mtdp_pipeline_swap_stage(pipeline, 0, NULL, NULL));
+    TEST_ASSERT_EQUAL(MTDP_BAD_PTR, mtdp_errno);
+    TEST_ASSERT_FALSE(mtdp_pipeline_swap_stage(pipeline, 1, add, NULL));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+    TEST_ASSERT_TRUE(mtdp_pipeline_swap_stage(pipeline, 0, add_twice, &offsets[1]));
+    TEST_ASSERT_EQUAL_PTR(&offsets[1], mtdp_pipeline_get_stages(pipeline)->self);
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_FALSE(mtdp_pipeline_swap_stage(pipeline, 0, add, &offsets[0]));
+    TEST_ASSERT_EQUAL(MTDP_ENABLED, mtdp_errno);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_swap_while_running);
+    RUN_TEST(test_swap_replicated_stage);
+    RUN_TEST(test_swap_on_executor);
+    RUN_TEST(test_swap_is_checked);
+    UNITY_END();
+}
@@ -0,0 +1,151 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define STAGES  3
+#define BUFFERS 8
+#define ITEMS   50000
+
+/* The source numbers the buffers, every stage adds one, and the sink checks it receives them all in order. */
+static mtdp_pipeline* pipeline;
+
+static void increment(mtdp_stage_context* context)
+{
+    *(size_t*)context->output = *(size_t*)context->input + 1;
+    context->ready_to_pull = context->ready_to_push = true;
+}
+
+static void set_transports(mtdp_pipe_transport transport)
+{
+    for(size_t i = 0; i != STAGES + 1; ++i) {
+        TEST_ASSERT_TRUE(mtdp_pipe_set_transport(&pipeline->pipes[i], transport));
+    }
+}
+
+static void run()
+{
+    fixture_stream_reset(ITEMS);
+    fixture_stream.offset = STAGES;
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(0, fixture_stream.errors);
+    for(size_t i = 0; i != STAGES + 1; ++i) {
+        TEST_ASSERT_EQUAL(pipeline->pipes[i].total_buffers, mtdp_buffer_pool_size(&pipeline->pipes[i].pool));
+    }
+}
+
+void setUp()
+{
+    pipeline = fixture_create(STAGES, fixture_produce, increment, fixture_consume);
+    fixture_fill(pipeline, 0, STAGES, BUFFERS, sizeof(size_t));
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+void test_ring_keeps_the_order()
+{
+    set_transports(MTDP_PIPE_TRANSPORT_RING);
+    run();
+}
+
+void test_ring_runs_again_after_a_disable()
+{
+    set_transports(MTDP_PIPE_TRANSPORT_RING);
+    run();
+    run();
+}
+
+void test_ring_of_a_single_buffer()
+{
+    fixture_destroy(pipeline);
+    pipeline = fixture_create(STAGES, fixture_produce, increment, fixture_consume);
+    fixture_fill(pipeline, 0, STAGES, 1, sizeof(size_t));
+    set_transports(MTDP_PIPE_TRANSPORT_RING);
+    run();
+}
+
+void test_ring_next_to_the_other_transports()
+{
+    mtdp_pipe_set_transport(&pipeline->pipes[0], MTDP_PIPE_TRANSPORT_RING);
+    mtdp_pipe_set_transport(&pipeline->pipes[1], MTDP_PIPE_TRANSPORT_SPSC);
+    mtdp_pipe_set_transport(&pipeline->pipes[2], MTDP_PIPE_TRANSPORT_RING);
+    mtdp_pipe_set_transport(&pipeline->pipes[3], MTDP_PIPE_TRANSPORT_MPMC);
+    run();
+    /* Switching back and forth between runs returns every buffer to the pool. */
+    set_transports(MTDP_PIPE_TRANSPORT_LOCKED);
+    run();
+    set_transports(MTDP_PIPE_TRANSPORT_RING);
+    run();
+}
+
+void test_ring_around_a_fused_stage()
+{
+    /* The pipe bypassed by the fused stage keeps the locked transport. */
+    set_transports(MTDP_PIPE_TRANSPORT_RING);
+    mtdp_pipe_set_transport(&pipeline->pipes[2], MTDP_PIPE_TRANSPORT_LOCKED);
+    mtdp_pipeline_get_stages(pipeline)[2].fused = true;
+    run();
+}
+
+void test_ring_gives_back_an_unpublished_slot()
+{
+    mtdp_pipe*  pipe = &pipeline->pipes[0];
+    mtdp_buffer first, second;
+
+    set_transports(MTDP_PIPE_TRANSPORT_RING);
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    /* The slot given back by the producer is claimed again next, and nothing reaches the consumer. */
+    first  = mtdp_pipe_get_empty_buffer(pipe);
+    second = mtdp_pipe_get_empty_buffer(pipe);
+    TEST_ASSERT_TRUE(mtdp_pipe_unclaim(pipe, second));
+    TEST_ASSERT_EQUAL_PTR(second, mtdp_pipe_get_empty_buffer(pipe));
+    TEST_ASSERT_TRUE(mtdp_pipe_unclaim(pipe, second));
+    TEST_ASSERT_TRUE(mtdp_pipe_push_buffer(pipe, first));
+    TEST_ASSERT_EQUAL_PTR(first, mtdp_pipe_get_full_buffer(pipe));
+    TEST_ASSERT_NULL(mtdp_pipe_get_full_buffer(pipe));
+    TEST_ASSERT_TRUE(mtdp_pipe_put_back(pipe, first));
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&pipe->pool));
+}
+
+void test_ring_is_not_shared_by_replicas()
+{
+    set_transports(MTDP_PIPE_TRANSPORT_RING);
+    mtdp_pipeline_get_stages(pipeline)[1].replicas = 2;
+    TEST_ASSERT_FALSE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_EQUAL(MTDP_BAD_CONFIG, mtdp_errno);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_ring_keeps_the_order);
+    RUN_TEST(test_ring_runs_again_after_a_disable);
+    RUN_TEST(test_ring_of_a_single_buffer);
+    RUN_TEST(test_ring_next_to_the_other_transports);
+    RUN_TEST(test_ring_around_a_fused_stage);
+    RUN_TEST(test_ring_gives_back_an_unpublished_slot);
+    RUN_TEST(test_ring_is_not_shared_by_replicas);
+    UNITY_END();
+}
@@ -0,0 +1,141 @@
+/* Copyright (C) 2021-2022 Domenico Teodonio
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+#include <stdlib.h>
+#include <threads.h>
+#include <unity.h>
+
+#include "fixture.h"
+
+#define STAGES  2
+#define BUFFERS 64
+#define ITEMS   5000
+
+/*
+    The source numbers the buffers and the sink checks it receives them all in order. The source
+    yields now and then, so that the steps downstream also wait for input, not only for buffers.
+*/
+static bool           idle;
+static mtdp_pipeline* pipeline;
+
+static void produce(mtdp_source_context* context)
+{
+    if(idle) {
+        thrd_yield();
+        return;
+    }
+    if(fixture_stream.produced % 64 == 0) {
+        thrd_yield();
+    }
+    fixture_produce(context);
+}
+
+static void set_policy(mtdp_wait_policy policy)
+{
+    mtdp_pipeline_get_source(pipeline)->wait_policy = policy;
+    for(size_t i = 0; i != STAGES; ++i) {
+        mtdp_pipeline_get_stages(pipeline)[i].wait_policy = policy;
+    }
+    mtdp_pipeline_get_sink(pipeline)->wait_policy = policy;
+}
+
+static void run()
+{
+    TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+    TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+    mtdp_pipeline_wait(pipeline);
+    TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+    TEST_ASSERT_EQUAL(ITEMS, fixture_stream.consumed);
+    TEST_ASSERT_EQUAL(0, fixture_stream.errors);
+    for(size_t i = 0; i != STAGES + 1; ++i) {
+        TEST_ASSERT_EQUAL(BUFFERS, mtdp_buffer_pool_size(&pipeline->pipes[i].pool));
+    }
+}
+
+void setUp()
+{
+    fixture_stream_reset(ITEMS);
+    idle     = false;
+    pipeline = fixture_create(STAGES, produce, fixture_pass, fixture_consume);
+    fixture_fill(pipeline, 0, STAGES, BUFFERS, sizeof(size_t));
+}
+
+void tearDown()
+{
+    fixture_destroy(pipeline);
+}
+
+void test_block_completes_a_stream()
+{
+    set_policy(MTDP_WAIT_BLOCK);
+    run();
+}
+
+void test_spin_then_park_completes_a_stream()
+{
+    set_policy(MTDP_WAIT_SPIN_THEN_PARK);
+    run();
+}
+
+void test_yield_completes_a_stream()
+{
+    set_policy(MTDP_WAIT_YIELD);
+    run();
+}
+
+void test_spin_completes_a_stream()
+{
+    set_policy(MTDP_WAIT_SPIN);
+    run();
+}
+
+void test_policies_mix_along_a_pipeline()
+{
+    mtdp_pipeline_get_source(pipeline)->wait_policy   = MTDP_WAIT_SPIN;
+    mtdp_pipeline_get_stages(pipeline)[0].wait_policy = MTDP_WAIT_BLOCK;
+    mtdp_pipeline_get_stages(pipeline)[1].wait_policy = MTDP_WAIT_SPIN_THEN_PARK;
+    mtdp_pipeline_get_sink(pipeline)->wait_policy     = MTDP_WAIT_SPIN;
+    mtdp_pipe_set_transport(&pipeline->pipes[1], MTDP_PIPE_TRANSPORT_SPSC);
+    mtdp_pipe_set_transport(&pipeline->pipes[2], MTDP_PIPE_TRANSPORT_RING);
+    run();
+}
+
+void test_spinning_steps_honor_a_stop()
+{
+    /* Nothing is ever pushed: every step downstream keeps waiting for input until stopped. */
+    mtdp_wait_policy policies[] = {MTDP_WAIT_BLOCK, MTDP_WAIT_SPIN_THEN_PARK, MTDP_WAIT_YIELD, MTDP_WAIT_SPIN};
+
+    idle = true;
+    for(size_t i = 0; i != sizeof(policies) / sizeof(*policies); ++i) {
+        set_policy(policies[i]);
+        TEST_ASSERT_TRUE(mtdp_pipeline_enable(pipeline));
+        TEST_ASSERT_TRUE(mtdp_pipeline_start(pipeline));
+        thrd_sleep(&(struct timespec){.tv_nsec = 20000000}, NULL);
+        TEST_ASSERT_TRUE(mtdp_pipeline_stop(pipeline));
+        TEST_ASSERT_TRUE(mtdp_pipeline_disable(pipeline));
+        TEST_ASSERT_EQUAL(0, fixture_stream.consumed);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_block_completes_a_stream);
+    RUN_TEST(test_spin_then_park_completes_a_stream);
+    RUN_TEST(test_yield_completes_a_stream);
+    RUN_TEST(test_spin_completes_a_stream);
+    RUN_TEST(test_policies_mix_along_a_pipeline);
+    RUN_TEST(test_spinning_steps_honor_a_stop);
+    UNITY_END();
+}